@@ -4,6 +4,27 @@
 #include "hittable.h"
 #include "util.h"
 
+/* Solve for the intersection of ray R with an axis-aligned rectangle
+   in the plane where coordinate K_AXIS equals K, by checking that the
+   coordinates of the intersection point along A_AXIS and B_AXIS lie
+   within [A0, A1] x [B0, B1]. T_MIN and T_MAX limit the interval for
+   a valid hit, and the distance to the intersection (if any) is
+   stored in T. */
+inline bool hit_axis_rect(const ray& r, int a_axis, int b_axis, int k_axis,
+                          double a0, double a1, double b0, double b1,
+                          double k, double t_min, double t_max, double& t) {
+    t = (k-r.origin()[k_axis]) / r.direction()[k_axis];
+    if (t < t_min || t > t_max)
+        return false;
+
+    auto a = r.origin()[a_axis] + t*r.direction()[a_axis];
+    auto b = r.origin()[b_axis] + t*r.direction()[b_axis];
+    if (a < a0 || a > a1 || b < b0 || b > b1)
+        return false;
+
+    return true;
+}
+
 /* 
    An axis-aligned rectangle object infinitely thin in Z.
 */
@@ -24,6 +45,7 @@ public:
         output_box = aabb(point3(x0, y0, k-0.0001), point3(x1, y1, k+0.0001));
         return true;
     }
+    virtual void get_surface(const ray& r, hit_record& rec) const override;
 
 public:
     shared_ptr<material> mp;
@@ -50,6 +72,7 @@ public:
         output_box = aabb(point3(x0, k-0.0001, z0), point3(x1, k+0.0001, z1));
         return true;
     }
+    virtual void get_surface(const ray& r, hit_record& rec) const override;
 
 public:
     shared_ptr<material> mp;
@@ -76,88 +99,86 @@ public:
         output_box = aabb(point3(k-0.0001, y0, z0), point3(k+0.0001, y1, z1));
         return true;
     }
+    virtual void get_surface(const ray& r, hit_record& rec) const override;
 
 public:
     shared_ptr<material> mp;
     double y0, y1, z0, z1, k;
 };
 
-/* Solve for ray-rectangle intersection by checking that the XY
-   coordinates of the intersection point between the ray and the
-   plane of the rectangle lie within the bounds of the rectangle
-   face. T_MIN and T_MAX limit the interval for a valid hit, and
-   properties of the intersection (if any) are stored in REC. */
+/* Solve for ray-rectangle intersection with hit_axis_rect(). T_MIN
+   and T_MAX limit the interval for a valid hit, and the distance to
+   the intersection (if any) is stored in REC. */
 bool xy_rect::hit(const ray& r, double t_min, double t_max,
                   hit_record& rec) const {
-    auto t = (k-r.origin().z()) / r.direction().z();
-    if (t < t_min || t > t_max)
+    double t;
+    if (!hit_axis_rect(r, 0, 1, 2, x0, x1, y0, y1, k, t_min, t_max, t))
         return false;
 
-    auto x = r.origin().x() + t*r.direction().x();
-    auto y = r.origin().y() + t*r.direction().y();
-    if (x < x0 || x > x1 || y < y0 || y > y1)
-        return false;
+    rec.set_hit(t, this);
+    return true;    
+}
 
-    rec.u = (x-x0) / (x1-x0);
-    rec.v = (y-y0) / (y1-y0);
-    rec.t = t;
+/* Store information about the point of intersection of ray R in
+   REC, with texture coordinates spanning the rectangle. */
+void xy_rect::get_surface(const ray& r, hit_record& rec) const {
+    rec.p = r.at(rec.t);
+    rec.u = (rec.p.x()-x0) / (x1-x0);
+    rec.v = (rec.p.y()-y0) / (y1-y0);
     auto outward_normal = vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
-    rec.p = r.at(t);
-    return true;    
+    rec.set_footprint(r, vec3(x1-x0, 0, 0), vec3(0, y1-y0, 0));
+    rec.mat_ptr = mp.get();
 }
 
-/* Solve for ray-rectangle intersection by checking that the XZ
-   coordinates of the intersection point between the ray and the
-   plane of the rectangle lie within the bounds of the rectangle
-   face. T_MIN and T_MAX limit the interval for a valid hit, and
-   properties of the intersection (if any) are stored in REC. */
+/* Solve for ray-rectangle intersection with hit_axis_rect(). T_MIN
+   and T_MAX limit the interval for a valid hit, and the distance to
+   the intersection (if any) is stored in REC. */
 bool xz_rect::hit(const ray& r, double t_min, double t_max,
                   hit_record& rec) const {
-    auto t = (k-r.origin().y()) / r.direction().y();
-    if (t < t_min || t > t_max)
+    double t;
+    if (!hit_axis_rect(r, 0, 2, 1, x0, x1, z0, z1, k, t_min, t_max, t))
         return false;
 
-    auto x = r.origin().x() + t*r.direction().x();
-    auto z = r.origin().z() + t*r.direction().z();
-    if (x < x0 || x > x1 || z < z0 || z > z1)
-        return false;
+    rec.set_hit(t, this);
+    return true;    
+}
 
-    rec.u = (x-x0) / (x1-x0);
-    rec.v = (z-z0) / (z1-z0);
-    rec.t = t;
+/* Store information about the point of intersection of ray R in
+   REC, with texture coordinates spanning the rectangle. */
+void xz_rect::get_surface(const ray& r, hit_record& rec) const {
+    rec.p = r.at(rec.t);
+    rec.u = (rec.p.x()-x0) / (x1-x0);
+    rec.v = (rec.p.z()-z0) / (z1-z0);
     auto outward_normal = vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
-    rec.p = r.at(t);
-    return true;    
+    rec.set_footprint(r, vec3(x1-x0, 0, 0), vec3(0, 0, z1-z0));
+    rec.mat_ptr = mp.get();
 }
 
-/* Solve for ray-rectangle intersection by checking that the YZ
-   coordinates of the intersection point between the ray and the
-   plane of the rectangle lie within the bounds of the rectangle
-   face. T_MIN and T_MAX limit the interval for a valid hit, and
-   properties of the intersection (if any) are stored in REC. */
+/* Solve for ray-rectangle intersection with hit_axis_rect(). T_MIN
+   and T_MAX limit the interval for a valid hit, and the distance to
+   the intersection (if any) is stored in REC. */
 bool yz_rect::hit(const ray& r, double t_min, double t_max,
                   hit_record& rec) const {
-    auto t = (k-r.origin().x()) / r.direction().x();
-    if (t < t_min || t > t_max)
+    double t;
+    if (!hit_axis_rect(r, 1, 2, 0, y0, y1, z0, z1, k, t_min, t_max, t))
         return false;
 
-    auto y = r.origin().y() + t*r.direction().y();
-    auto z = r.origin().z() + t*r.direction().z();
-    if (y < y0 || y > y1 || z < z0 || z > z1)
-        return false;
+    rec.set_hit(t, this);
+    return true;    
+}
 
-    rec.u = (y-y0) / (y1-y0);
-    rec.v = (z-z0) / (z1-z0);
-    rec.t = t;
+/* Store information about the point of intersection of ray R in
+   REC, with texture coordinates spanning the rectangle. */
+void yz_rect::get_surface(const ray& r, hit_record& rec) const {
+    rec.p = r.at(rec.t);
+    rec.u = (rec.p.y()-y0) / (y1-y0);
+    rec.v = (rec.p.z()-z0) / (z1-z0);
     auto outward_normal = vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
-    rec.p = r.at(t);
-    return true;    
+    rec.set_footprint(r, vec3(0, y1-y0, 0), vec3(0, 0, z1-z0));
+    rec.mat_ptr = mp.get();
 }
 
 #endif
@@ -0,0 +1,149 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "util.h"
+
+/*
+   An affine transform, stored as the top three rows of a 4x4 matrix
+   (the bottom row is always 0 0 0 1). Column 3 holds the translation
+   and columns 0-2 the linear part.
+*/
+class affine {
+public:
+    affine() : m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}} {}
+
+    static affine translation(const vec3& offset);
+    static affine rotation_x(double angle);
+    static affine rotation_y(double angle);
+    static affine rotation_z(double angle);
+    static affine scaling(const vec3& factors);
+
+    /* Transforms a point (translation applies). */
+    point3 point(const point3& p) const {
+        return point3(m[0][0]*p[0] + m[0][1]*p[1] + m[0][2]*p[2] + m[0][3],
+                      m[1][0]*p[0] + m[1][1]*p[1] + m[1][2]*p[2] + m[1][3],
+                      m[2][0]*p[0] + m[2][1]*p[1] + m[2][2]*p[2] + m[2][3]);
+    }
+
+    /* Transforms a direction (translation does not apply). */
+    vec3 vector(const vec3& v) const {
+        return vec3(m[0][0]*v[0] + m[0][1]*v[1] + m[0][2]*v[2],
+                    m[1][0]*v[0] + m[1][1]*v[1] + m[1][2]*v[2],
+                    m[2][0]*v[0] + m[2][1]*v[1] + m[2][2]*v[2]);
+    }
+
+    /* Transforms ray R, and its differentials if it has any. */
+    ray transform(const ray& r) const {
+        ray out(point(r.origin()), vector(r.direction()), r.time());
+        if (r.has_differentials)
+            out.set_differentials(point(r.rx_origin), vector(r.rx_direction),
+                                  point(r.ry_origin), vector(r.ry_direction));
+        return out;
+    }
+
+    /* Returns the inverse transform. The linear part must not be
+       singular. */
+    affine inverse() const;
+
+    /* Returns the matrix that maps surface normals through this
+       transform (the inverse transpose of the linear part). */
+    affine normal_matrix() const;
+
+public:
+    double m[3][4];
+};
+
+/* Returns the transform that applies B first, then A. */
+inline affine operator*(const affine& a, const affine& b) {
+    affine c;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            c.m[i][j] = a.m[i][0]*b.m[0][j] + a.m[i][1]*b.m[1][j]
+                      + a.m[i][2]*b.m[2][j];
+        }
+        c.m[i][3] += a.m[i][3];
+    }
+    return c;
+}
+
+affine affine::translation(const vec3& offset) {
+    affine a;
+    a.m[0][3] = offset.x();
+    a.m[1][3] = offset.y();
+    a.m[2][3] = offset.z();
+    return a;
+}
+
+/* Rotations are counter-clockwise by ANGLE degrees about the axis. */
+affine affine::rotation_x(double angle) {
+    auto radians = degrees_to_radians(angle);
+    auto s = sin(radians), c = cos(radians);
+    affine a;
+    a.m[1][1] = c;  a.m[1][2] = -s;
+    a.m[2][1] = s;  a.m[2][2] = c;
+    return a;
+}
+
+affine affine::rotation_y(double angle) {
+    auto radians = degrees_to_radians(angle);
+    auto s = sin(radians), c = cos(radians);
+    affine a;
+    a.m[0][0] = c;   a.m[0][2] = s;
+    a.m[2][0] = -s;  a.m[2][2] = c;
+    return a;
+}
+
+affine affine::rotation_z(double angle) {
+    auto radians = degrees_to_radians(angle);
+    auto s = sin(radians), c = cos(radians);
+    affine a;
+    a.m[0][0] = c;  a.m[0][1] = -s;
+    a.m[1][0] = s;  a.m[1][1] = c;
+    return a;
+}
+
+affine affine::scaling(const vec3& factors) {
+    affine a;
+    a.m[0][0] = factors.x();
+    a.m[1][1] = factors.y();
+    a.m[2][2] = factors.z();
+    return a;
+}
+
+/* Inverts the linear part by cofactors and then undoes the
+   translation in the inverted frame. */
+affine affine::inverse() const {
+    const auto& a = m;
+    double c00 = a[1][1]*a[2][2] - a[1][2]*a[2][1];
+    double c01 = a[1][2]*a[2][0] - a[1][0]*a[2][2];
+    double c02 = a[1][0]*a[2][1] - a[1][1]*a[2][0];
+    double inv_det = 1.0 / (a[0][0]*c00 + a[0][1]*c01 + a[0][2]*c02);
+
+    affine r;
+    r.m[0][0] = c00 * inv_det;
+    r.m[0][1] = (a[0][2]*a[2][1] - a[0][1]*a[2][2]) * inv_det;
+    r.m[0][2] = (a[0][1]*a[1][2] - a[0][2]*a[1][1]) * inv_det;
+    r.m[1][0] = c01 * inv_det;
+    r.m[1][1] = (a[0][0]*a[2][2] - a[0][2]*a[2][0]) * inv_det;
+    r.m[1][2] = (a[0][2]*a[1][0] - a[0][0]*a[1][2]) * inv_det;
+    r.m[2][0] = c02 * inv_det;
+    r.m[2][1] = (a[0][1]*a[2][0] - a[0][0]*a[2][1]) * inv_det;
+    r.m[2][2] = (a[0][0]*a[1][1] - a[0][1]*a[1][0]) * inv_det;
+
+    vec3 t = r.vector(vec3(a[0][3], a[1][3], a[2][3]));
+    r.m[0][3] = -t.x();
+    r.m[1][3] = -t.y();
+    r.m[2][3] = -t.z();
+    return r;
+}
+
+affine affine::normal_matrix() const {
+    affine inv = inverse();
+    affine n;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            n.m[i][j] = inv.m[j][i];
+    return n;
+}
+
+#endif
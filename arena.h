@@ -0,0 +1,122 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "util.h"
+
+/*
+   An arena that owns the objects of a scene. Objects are allocated
+   from one pool per type, so all spheres sit next to each other, as
+   do all materials of one kind, all textures and all BVH nodes, and
+   there is no separate allocation or control block per object.
+
+   make() returns a shared_ptr that does not own the object (it has no
+   control block), so the existing scene-building code keeps working
+   unchanged and copying the handle never touches a reference count.
+   Every handle is only valid while the arena is alive, so the arena
+   must outlive the world built from it. Destroying the arena frees
+   each pool in a few large blocks.
+*/
+class scene_arena {
+public:
+    scene_arena() {}
+    scene_arena(const scene_arena&) = delete;
+    scene_arena& operator=(const scene_arena&) = delete;
+
+    ~scene_arena() {
+        /* Destroy pools in reverse order of first use. */
+        for (auto it = pools.rbegin(); it != pools.rend(); ++it)
+            it->reset();
+    }
+
+    /* Constructs a T from ARGS in the pool for T and returns a
+       non-owning handle to it. The constructor may itself make objects
+       of T (as bvh_node makes its children), so the object is recorded
+       as constructed only once its constructor returns. If it throws,
+       its slot is left empty and is never destroyed. */
+    template <typename T, typename... Args>
+    shared_ptr<T> make(Args&&... args) {
+        auto& p = pool_for<T>();
+        T* object = p.allocate();
+        size_t entry = p.constructed.size();
+        p.constructed.push_back(nullptr);
+        new (object) T(std::forward<Args>(args)...);
+        p.constructed[entry] = object;
+        return shared_ptr<T>(shared_ptr<T>(), object);
+    }
+
+    /* Number of bytes reserved across all pools. */
+    size_t memory_size() const {
+        size_t total = 0;
+        for (const auto& p : pools)
+            total += p->reserved_bytes();
+        return total;
+    }
+
+private:
+    struct pool_base {
+        virtual ~pool_base() {}
+        virtual size_t reserved_bytes() const = 0;
+    };
+
+    /* Storage for objects of type T, in blocks of BLOCK_SIZE objects.
+       Blocks are never moved, so handles stay valid. CONSTRUCTED holds
+       one entry per object made, in the order they were started: the
+       object, or nullptr if its constructor has not returned. */
+    template <typename T>
+    struct pool : pool_base {
+        static const size_t block_size =
+            sizeof(T) >= 4096 ? 4 : 16384 / sizeof(T);
+
+        using slot = typename std::aligned_storage<sizeof(T),
+                                                   alignof(T)>::type;
+
+        std::vector<std::unique_ptr<slot[]>> blocks;
+        size_t used_in_block = block_size;
+        std::vector<T*> constructed;
+
+        T* allocate() {
+            if (used_in_block == block_size) {
+                blocks.emplace_back(new slot[block_size]);
+                used_in_block = 0;
+            }
+            return reinterpret_cast<T*>(&blocks.back()[used_in_block++]);
+        }
+
+        virtual size_t reserved_bytes() const override {
+            return blocks.size() * block_size * sizeof(slot);
+        }
+
+        virtual ~pool() {
+            if (std::is_trivially_destructible<T>::value)
+                return;
+
+            for (auto it = constructed.rbegin(); it != constructed.rend(); ++it)
+                if (*it)
+                    (*it)->~T();
+        }
+    };
+
+    template <typename T>
+    pool<T>& pool_for() {
+        auto found = index.find(std::type_index(typeid(T)));
+        if (found != index.end())
+            return *static_cast<pool<T>*>(pools[found->second].get());
+
+        index.emplace(std::type_index(typeid(T)), pools.size());
+        pools.emplace_back(new pool<T>());
+        return *static_cast<pool<T>*>(pools.back().get());
+    }
+
+    std::vector<std::unique_ptr<pool_base>> pools;
+    std::unordered_map<std::type_index, size_t> index;
+};
+
+#endif
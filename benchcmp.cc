@@ -0,0 +1,243 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+   Compares a run of scenebench with a baseline run, scene by scene,
+   and exits with status 1 if any scene regressed: its render took
+   more than THRESHOLD percent longer (5 by default), its peak memory
+   grew by more than RSS_THRESHOLD percent (10 by default), or it is
+   missing. Scenes whose rays or image checksum changed are reported
+   too, since their times measure different work. Runs made with
+   different settings cannot be compared, and give status 2.
+
+   Times are only as steady as the machine: on a shared one, raise
+   scenebench's --repeat or the thresholds.
+
+   Usage: benchcmp [--threshold pct] [--rss-threshold pct]
+                   baseline.json current.json
+*/
+
+namespace {
+
+/* A JSON value, as much of one as scenebench writes. */
+struct json_value {
+    enum kind_t { null, number, string, array, object } kind = null;
+    double num = 0;
+    std::string str;
+    std::vector<json_value> items;
+    std::map<std::string, json_value> fields;
+
+    const json_value& operator[](const std::string& key) const {
+        static const json_value none;
+        auto found = fields.find(key);
+        return found == fields.end() ? none : found->second;
+    }
+};
+
+/* A recursive descent parser over TEXT. Strings may not hold escapes
+   other than \" and \\. */
+class json_parser {
+public:
+    json_parser(const std::string& _text) : text(_text), pos(0) {}
+
+    bool parse(json_value& out) {
+        return value(out) && (skip_space(), pos == text.size());
+    }
+
+private:
+    void skip_space() {
+        while (pos < text.size() && isspace((unsigned char)text[pos]))
+            pos++;
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if (text.compare(pos, n, word) != 0)
+            return false;
+        pos += n;
+        return true;
+    }
+
+    bool string_value(std::string& out) {
+        if (text[pos] != '"')
+            return false;
+        for (pos++; pos < text.size() && text[pos] != '"'; pos++) {
+            if (text[pos] == '\\' && ++pos == text.size())
+                return false;
+            out += text[pos];
+        }
+        return pos++ < text.size();
+    }
+
+    bool value(json_value& out) {
+        skip_space();
+        if (pos >= text.size())
+            return false;
+
+        char c = text[pos];
+        if (c == '{') {
+            out.kind = json_value::object;
+            pos++;
+            skip_space();
+            if (pos < text.size() && text[pos] == '}')
+                return ++pos, true;
+            while (true) {
+                std::string key;
+                skip_space();
+                if (pos >= text.size() || !string_value(key))
+                    return false;
+                skip_space();
+                if (pos >= text.size() || text[pos++] != ':' ||
+                    !value(out.fields[key]))
+                    return false;
+                skip_space();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                return pos < text.size() && text[pos++] == '}';
+            }
+        }
+        if (c == '[') {
+            out.kind = json_value::array;
+            pos++;
+            skip_space();
+            if (pos < text.size() && text[pos] == ']')
+                return ++pos, true;
+            while (true) {
+                out.items.emplace_back();
+                if (!value(out.items.back()))
+                    return false;
+                skip_space();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                return pos < text.size() && text[pos++] == ']';
+            }
+        }
+        if (c == '"') {
+            out.kind = json_value::string;
+            return string_value(out.str);
+        }
+        if (literal("null"))
+            return true;
+
+        char* end;
+        out.kind = json_value::number;
+        out.num = strtod(text.c_str() + pos, &end);
+        if (end == text.c_str() + pos)
+            return false;
+        pos = end - text.c_str();
+        return true;
+    }
+
+    const std::string& text;
+    size_t pos;
+};
+
+bool load_json(const std::string& path, json_value& out) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "ERROR: Could not open '" << path << "'.\n";
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    std::string contents = text.str();
+    if (!json_parser(contents).parse(out) ||
+        out["scenes"].kind != json_value::array) {
+        std::cerr << "ERROR: '" << path << "' is not a scenebench run.\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+    double threshold = 5, rss_threshold = 10;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-' && argv[i][1] == '-'; i += 2) {
+        if (strcmp(argv[i], "--threshold") == 0)
+            threshold = atof(argv[i+1]);
+        else if (strcmp(argv[i], "--rss-threshold") == 0)
+            rss_threshold = atof(argv[i+1]);
+        else {
+            i = argc;
+            break;
+        }
+    }
+    if (argc - i != 2) {
+        std::cerr << "Usage: " << argv[0] << " [--threshold pct] "
+                  << "[--rss-threshold pct] baseline.json current.json\n";
+        return 2;
+    }
+
+    json_value base, current;
+    if (!load_json(argv[i], base) || !load_json(argv[i+1], current))
+        return 2;
+
+    for (const char* setting : { "width", "samples_per_pixel", "seed",
+                                 "max_depth" }) {
+        if (base[setting].num != current[setting].num) {
+            std::cerr << "ERROR: The runs differ in " << setting << " ("
+                      << base[setting].num << " and "
+                      << current[setting].num << ").\n";
+            return 2;
+        }
+    }
+
+    std::map<std::string, const json_value*> found;
+    for (const auto& scene : current["scenes"].items)
+        found[scene["name"].str] = &scene;
+
+    printf("%-20s %10s %10s %8s %9s %9s %8s  %s\n", "scene", "base ms",
+           "ms", "time", "base Mr/s", "Mr/s", "rss", "");
+    int regressions = 0;
+    for (const auto& b : base["scenes"].items) {
+        const std::string& name = b["name"].str;
+        auto it = found.find(name);
+        if (it == found.end()) {
+            printf("%-20s %10s %10s %8s %9s %9s %8s  REGRESSED: missing\n",
+                   name.c_str(), "", "", "", "", "", "");
+            regressions++;
+            continue;
+        }
+        const json_value& c = *it->second;
+
+        double time_change = 100 * (c["render_s"].num / b["render_s"].num - 1);
+        double rss_change =
+            100 * (c["peak_rss_kb"].num / b["peak_rss_kb"].num - 1);
+
+        std::string verdict;
+        if (time_change > threshold)
+            verdict += " time";
+        if (rss_change > rss_threshold)
+            verdict += " memory";
+        if (!verdict.empty()) {
+            verdict = "REGRESSED:" + verdict;
+            regressions++;
+        }
+        if (c["rays"].num != b["rays"].num ||
+            c["checksum"].num != b["checksum"].num)
+            verdict += verdict.empty() ? "output changed" : ", output changed";
+
+        printf("%-20s %10.2f %10.2f %+7.1f%% %9.2f %9.2f %+7.1f%%  %s\n",
+               name.c_str(), 1e3 * b["render_s"].num, 1e3 * c["render_s"].num,
+               time_change, b["mrays_per_s"].num, c["mrays_per_s"].num,
+               rss_change, verdict.c_str());
+    }
+
+    if (regressions)
+        printf("%d scene(s) regressed.\n", regressions);
+    return regressions ? 1 : 0;
+}
@@ -2,6 +2,7 @@
 #define BVH_H
 
 #include <algorithm>
+#include "arena.h"
 #include "hittable.h"
 #include "hittable-list.h"
 #include "util.h"
@@ -13,11 +14,14 @@
 class bvh_node : public hittable {
 public:
     bvh_node();
-    bvh_node(const hittable_list& list, double time0, double time1)
-        : bvh_node(list.objects, 0, list.objects.size(), time0, time1) {}
+    bvh_node(const hittable_list& list, double time0, double time1,
+             scene_arena* arena = nullptr)
+        : bvh_node(list.objects, 0, list.objects.size(), time0, time1,
+                   arena) {}
         
     bvh_node(const std::vector<shared_ptr<hittable>>& src_objects,
-             size_t start, size_t end, double time0, double time1);
+             size_t start, size_t end, double time0, double time1,
+             scene_arena* arena = nullptr);
     
     virtual bool hit(const ray& r, double t_min, double t_max,
                      hit_record& rec) const override;
@@ -65,9 +69,11 @@ bool box_z_compare(const shared_ptr<hittable> a,
 
 /* Builds the BVH from the list of "hittable" objects SRC_OBJECTS.
    START and END initially index the start and end of the list, but
-   are updated recursively as the BVH is built. */
+   are updated recursively as the BVH is built. Child nodes are
+   allocated from ARENA if one is given. */
 bvh_node::bvh_node(const std::vector<shared_ptr<hittable>>& src_objects,
-                   size_t start, size_t end, double time0, double time1) {
+                   size_t start, size_t end, double time0, double time1,
+                   scene_arena* arena) {
     auto objects = src_objects;
 
     /* Randomly choose the axis for splitting the list of ojects. */
@@ -94,8 +100,16 @@ bvh_node::bvh_node(const std::vector<shared_ptr<hittable>>& src_objects,
     else {
         std::sort(objects.begin() + start, objects.begin() + end, comparator);
         auto mid = start + object_span/2;
-        left = make_shared<bvh_node>(objects, start, mid, time0, time1);
-        right = make_shared<bvh_node>(objects, mid, end, time0, time1);
+        if (arena) {
+            left = arena->make<bvh_node>(objects, start, mid,
+                                         time0, time1, arena);
+            right = arena->make<bvh_node>(objects, mid, end,
+                                          time0, time1, arena);
+        }
+        else {
+            left = make_shared<bvh_node>(objects, start, mid, time0, time1);
+            right = make_shared<bvh_node>(objects, mid, end, time0, time1);
+        }
     }
 
     /* Check that BVH is valid. */
@@ -58,6 +58,17 @@ public:
                    random_double(time0, time1));
     }
 
+    /* As above, and attaches ray differentials through the screen
+       locations offset by DS horizontally and DT vertically (one
+       pixel each), using the same lens position and time. */
+    ray get_ray(double s, double t, double ds, double dt) const {
+        ray r = get_ray(s, t);
+        vec3 target = r.origin() + r.direction();
+        r.set_differentials(r.origin(), target + ds*horizontal - r.origin(),
+                            r.origin(), target + dt*vertical - r.origin());
+        return r;
+    }
+
 private:
     vec3 origin;             /* Camera position. */
     vec3 lower_left_corner;  /* Lower left corner of the screen. */
@@ -0,0 +1,121 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include "framebuffer.h"
+#include "image-io.h"
+#include "integrator.h"
+
+/*
+   Checkpoints of a render in progress, from which an interrupted
+   render resumes (main --resume).
+
+   Every sample draws its random numbers from a sequence seeded by the
+   render's seed, its pixel and its index (see trace_sample()), so the
+   accumulation buffer and its per-pixel sample counts capture the
+   whole state of the render: resuming takes the missing samples of
+   each pixel, in order, and gives the same image as a render that was
+   never interrupted.
+
+   Checkpoint file layout (little-endian):
+       checkpoint_file_header
+       accumulation buffer (see image-io.h)
+*/
+
+/* The settings a render was started with, which a resumed render
+   must keep. */
+struct render_settings {
+    int32_t scene_index;  /* Built-in scene, -1 for a scene file, or -2
+                             for a mesh. */
+    int32_t image_width, image_height;
+    int32_t samples_per_pixel;
+    int32_t max_depth;
+    uint32_t flags;  /* render_flag bits. */
+    uint64_t seed;   /* Base of every sample's random sequence. */
+    uint64_t scene_hash;  /* Hash of the scene file (main --scene) or
+                             mesh (main --mesh). */
+};
+
+enum render_flag : uint32_t {
+    render_baked_textures = 1  /* Noise textures were baked (main --bake). */
+};
+
+const char checkpoint_file_magic[8] = { 'R', 'T', 'C', 'K', 'P', 'T', 0, 0 };
+const uint32_t checkpoint_file_version = 2;
+
+struct checkpoint_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    render_settings settings;
+};
+
+/* Writes a checkpoint of IMAGE, rendered with SETTINGS, to PATH. The
+   checkpoint is written to a temporary file, flushed to disk and then
+   renamed over PATH, so a crash at any point leaves either the old or
+   the new checkpoint complete. Returns false if it could not be
+   written. */
+bool save_checkpoint(const std::string& path, const render_settings& settings,
+                     const framebuffer& image) {
+    checkpoint_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, checkpoint_file_magic, sizeof(h.magic));
+    h.version = checkpoint_file_version;
+    h.settings = settings;
+
+    auto temporary = path + ".tmp";
+    FILE* f = fopen(temporary.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && write_accumulation(image, f)
+        && fflush(f) == 0
+        && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+
+    /* Make the rename itself durable. */
+    auto slash = path.find_last_of('/');
+    auto directory = slash == std::string::npos ? std::string(".")
+                                                : path.substr(0, slash + 1);
+    int fd = open(directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return true;
+}
+
+/* Reads the checkpoint at PATH into SETTINGS and IMAGE. Returns false
+   if it is missing or malformed. */
+bool load_checkpoint(const std::string& path, render_settings& settings,
+                     framebuffer& image) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+
+    checkpoint_file_header h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1
+        && memcmp(h.magic, checkpoint_file_magic, sizeof(h.magic)) == 0
+        && h.version == checkpoint_file_version
+        && read_accumulation(f, image)
+        && image.width == h.settings.image_width
+        && image.height == h.settings.image_height;
+    fclose(f);
+
+    if (ok)
+        settings = h.settings;
+    return ok;
+}
+
+#endif
@@ -1,13 +1,28 @@
 #ifndef COLOR_H
 #define COLOR_H
 
+#include <cmath>
 #include <iostream>
-#include "vec3.h"
+#include "profile.h"
+#include "util.h"
 
-/* Converts PIXEL_COLOR to RGB values, scales by SAMPLES_PER_PIXEL,
-   and writes the resulting color as RGB values to OUT. */
-void write_color(std::ostream &out, color pixel_color, 
-                 int samples_per_pixel) {
+/*
+   Conversions between sRGB-encoded and linear color components. Image
+   files store sRGB, while shading and filtering need linear values.
+*/
+
+inline double srgb_to_linear(double c) {
+    return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
+inline double linear_to_srgb(double c) {
+    return c <= 0.0031308 ? 12.92 * c : 1.055 * pow(c, 1.0/2.4) - 0.055;
+}
+
+/* Converts PIXEL_COLOR to 8-bit RGB values in RGB, scaled by
+   SAMPLES_PER_PIXEL and gamma corrected for gamma = 2.0. */
+inline void color_to_rgb8(color pixel_color, int samples_per_pixel,
+                          unsigned char rgb[3]) {
     auto r = pixel_color.r();
     auto g = pixel_color.g();
     auto b = pixel_color.b();
@@ -19,9 +34,21 @@ void write_color(std::ostream &out, color pixel_color,
     g = sqrt(scale * g);
     b = sqrt(scale * b);
 
-    out << static_cast<int>(256 * clamp(r, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * clamp(g, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * clamp(b, 0.0, 0.999)) << '\n';
+    rgb[0] = static_cast<unsigned char>(256 * clamp(r, 0.0, 0.999));
+    rgb[1] = static_cast<unsigned char>(256 * clamp(g, 0.0, 0.999));
+    rgb[2] = static_cast<unsigned char>(256 * clamp(b, 0.0, 0.999));
+}
+
+/* Converts PIXEL_COLOR to RGB values, scales by SAMPLES_PER_PIXEL,
+   and writes the resulting color as RGB values to OUT. */
+void write_color(std::ostream &out, color pixel_color,
+                 int samples_per_pixel) {
+    PROFILE_SCOPE(stage_output);
+    unsigned char rgb[3];
+    color_to_rgb8(pixel_color, samples_per_pixel, rgb);
+    out << static_cast<int>(rgb[0]) << ' '
+        << static_cast<int>(rgb[1]) << ' '
+        << static_cast<int>(rgb[2]) << '\n';
 }
 
 #endif
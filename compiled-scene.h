@@ -0,0 +1,747 @@
+#ifndef COMPILED_SCENE_H
+#define COMPILED_SCENE_H
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include "aarect.h"
+#include "box.h"
+#include "bvh.h"
+#include "flat-bvh.h"
+#include "hittable-list.h"
+#include "mapped-file.h"
+#include "material.h"
+#include "moving-sphere.h"
+#include "profile.h"
+#include "sphere.h"
+#include "texture.h"
+
+/*
+   A compiled form of a scene for rendering. The built-in primitives,
+   materials and textures are copied into flat arrays of tagged
+   records and dispatched with a switch on the tag instead of through
+   virtual calls, so the hot paths can be inlined. All primitives sit
+   under one flat BVH, and transformed objects become instances with
+   their own subtree in the same node array.
+
+   Objects of any other type (triangle meshes or user-defined
+   "hittable", "material" and "texture" classes) are kept as external
+   records and still reached through their virtual functions.
+
+   Texture graphs are compiled into a flat program (see add_texture()):
+   solid colors become constants, identical subgraphs are merged, and
+   checkers nested in checkers are folded away, so a lookup follows at
+   most one branch whatever the depth of the original graph.
+
+   The arrays are either owned by the scene or point straight into a
+   memory-mapped scene file (see scene-io.h).
+*/
+
+enum prim_kind : uint32_t {
+    prim_sphere,
+    prim_moving_sphere,
+    prim_xy_rect,
+    prim_xz_rect,
+    prim_yz_rect,
+    prim_instance,  /* A transformed subtree (see flat_instance). */
+    prim_external   /* Any other hittable, tested virtually. */
+};
+
+enum material_kind : uint32_t {
+    mat_lambertian,
+    mat_metal,
+    mat_dielectric,
+    mat_diffuse_light,
+    mat_external
+};
+
+enum texture_kind : uint32_t {
+    tex_solid,
+    tex_checker,
+    tex_noise,
+    tex_image,
+    tex_baked,
+    tex_external
+};
+
+/* Material index for hits whose material is only known virtually. */
+const uint32_t no_material = 0xffffffff;
+
+struct flat_sphere {
+    double center[3];
+    double radius;
+};
+
+struct flat_moving_sphere {
+    double center0[3], center1[3];
+    double time0, time1;
+    double radius;
+};
+
+/* A rectangle in the plane where the normal axis equals K, spanning
+   [A0, A1] x [B0, B1] along the other two axes (in x, y, z order). */
+struct flat_rect {
+    double a0, a1, b0, b1, k;
+};
+
+struct flat_primitive {
+    uint32_t kind;      /* A prim_kind. */
+    uint32_t material;  /* Index into compiled_scene::materials. */
+    union {
+        flat_sphere sph;
+        flat_moving_sphere msph;
+        flat_rect rect;
+        uint32_t index;  /* Into instances (prim_instance) or externals. */
+    };
+};
+
+struct flat_material {
+    uint32_t kind;        /* A material_kind. */
+    uint32_t texture;     /* Albedo or emission texture, if any. */
+    color albedo;         /* Color of a metal. */
+    double fuzz;          /* Fuzz of a metal. */
+    double ir;            /* Index of refraction of a dielectric. */
+    const material* ptr;  /* The original material (none if loaded). */
+};
+
+/* One instruction of the texture program. A checker branches to one
+   of two other instructions, and every other kind yields a color. */
+struct flat_texture {
+    uint32_t kind;       /* A texture_kind. */
+    uint32_t even, odd;  /* Branch targets of a checker. */
+    color value;         /* Color of a solid texture. */
+    const texture* ptr;  /* The original texture. */
+};
+
+struct flat_instance {
+    affine object_to_world;
+    affine world_to_object;
+    affine normal_to_world;
+    uint32_t root;  /* Root node of the instanced subtree. */
+};
+
+/* The closest hit found by compiled_scene::hit. */
+struct flat_hit {
+    static const int max_depth = 4;
+
+    double t;                      /* Distance along the ray. */
+    uint32_t prim;                 /* Innermost primitive hit. */
+    int depth;                     /* Number of enclosing instances. */
+    uint32_t instances[max_depth]; /* Enclosing instances, outermost first. */
+    hit_record ext;                /* Hit on an external primitive. */
+};
+
+class compiled_scene {
+public:
+    compiled_scene() : root(0), time0(0), time1(0) {}
+    compiled_scene(const hittable_list& world, double time0, double time1);
+
+    compiled_scene(const compiled_scene&) = delete;
+    compiled_scene& operator=(const compiled_scene&) = delete;
+
+    /* Finds the closest hit of ray R in [T_MIN, T_MAX] and stores it
+       in H. Only the distance and primitive are recorded. */
+    bool hit(const ray& r, double t_min, double t_max, flat_hit& h) const;
+
+    /* Fills REC with the surface information for hit H of ray R and
+       returns the index of its material (or no_material, in which
+       case REC.MAT_PTR holds the material). */
+    uint32_t get_surface(const ray& r, const flat_hit& h,
+                         hit_record& rec) const;
+
+    color emitted(uint32_t mat, const hit_record& rec) const;
+    bool scatter(uint32_t mat, const ray& r_in, const hit_record& rec,
+                 color& attenuation, ray& scattered) const;
+    color texture_value(uint32_t tex, double u, double v, const point3& p,
+                        const texture_footprint& fp) const;
+
+public:
+    array_view<flat_primitive> prims;
+    array_view<flat_node> nodes;
+    array_view<flat_material> materials;
+    array_view<flat_texture> textures;
+    array_view<flat_instance> instances;
+    std::vector<const hittable*> externals;
+    uint32_t root;  /* Root node of the whole scene, if NODES is not empty. */
+    double time0, time1;  /* Time span the primitive bounds cover. */
+
+    /* Backing storage for scenes compiled in memory. */
+    std::vector<flat_primitive> owned_prims;
+    std::vector<flat_node> owned_nodes;
+    std::vector<flat_material> owned_materials;
+    std::vector<flat_texture> owned_textures;
+    std::vector<flat_instance> owned_instances;
+
+    /* Backing storage for scenes loaded from a scene file: the mapping
+       and the textures made for it. */
+    mapped_file file;
+    std::vector<shared_ptr<const texture>> owned_texture_objects;
+
+private:
+    uint32_t primitive_surface(const ray& r, const flat_hit& h,
+                               hit_record& rec) const;
+    bool hit_tree(uint32_t node, const ray& r, double t_min, double& t_max,
+                  flat_hit& h, int depth) const;
+
+    void gather(const hittable* object, std::vector<flat_primitive>& out,
+                std::vector<flat_bounds>& bounds, int depth);
+    uint32_t build_tree(std::vector<flat_primitive>& tree_prims,
+                        const std::vector<flat_bounds>& bounds);
+    /* What is known about the checker squares at the point a texture
+       is looked up: every checker tests the same point, so below one
+       checker the outcome of any other is known. */
+    enum checker_parity { parity_unknown, parity_even, parity_odd };
+
+    uint32_t add_material(const material* m);
+    uint32_t add_texture(const texture* t,
+                         checker_parity parity = parity_unknown);
+    uint32_t intern_texture(const flat_texture& ft, const void* identity);
+
+    std::unordered_map<const material*, uint32_t> material_index;
+    std::map<std::pair<const texture*, int>, uint32_t> texture_index;
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t, double, double,
+                        double, const void*>, uint32_t> texture_code;
+};
+
+/* Primitives per leaf of the scene BVH. */
+const uint32_t scene_leaf_prims = 2;
+
+compiled_scene::compiled_scene(const hittable_list& world,
+                               double _time0, double _time1)
+    : root(0), time0(_time0), time1(_time1) {
+    std::vector<flat_primitive> top;
+    std::vector<flat_bounds> bounds;
+    gather(&world, top, bounds, 0);
+    root = build_tree(top, bounds);
+
+    prims = array_view<flat_primitive>(owned_prims.data(), owned_prims.size());
+    nodes = array_view<flat_node>(owned_nodes.data(), owned_nodes.size());
+    materials = array_view<flat_material>(owned_materials.data(),
+                                          owned_materials.size());
+    textures = array_view<flat_texture>(owned_textures.data(),
+                                        owned_textures.size());
+    instances = array_view<flat_instance>(owned_instances.data(),
+                                          owned_instances.size());
+}
+
+/* Appends the primitives making up OBJECT to OUT, and their bounds
+   to BOUNDS. Lists, BVH nodes and boxes are flattened into their
+   parts, and transforms nested less than flat_hit::max_depth deep
+   become instances. */
+void compiled_scene::gather(const hittable* object,
+                            std::vector<flat_primitive>& out,
+                            std::vector<flat_bounds>& bounds, int depth) {
+    const std::type_info& type = typeid(*object);
+
+    if (type == typeid(hittable_list)) {
+        for (const auto& child : static_cast<const hittable_list*>(object)->objects)
+            gather(child.get(), out, bounds, depth);
+        return;
+    }
+
+    if (type == typeid(bvh_node)) {
+        auto node = static_cast<const bvh_node*>(object);
+        gather(node->left.get(), out, bounds, depth);
+        if (node->right != node->left)
+            gather(node->right.get(), out, bounds, depth);
+        return;
+    }
+
+    if (type == typeid(box)) {
+        gather(&static_cast<const box*>(object)->sides, out, bounds, depth);
+        return;
+    }
+
+    aabb box_bounds(point3(-infinity, -infinity, -infinity),
+                    point3(infinity, infinity, infinity));
+    object->bounding_box(time0, time1, box_bounds);
+
+    /* Records are zeroed first so scene files are reproducible. */
+    flat_primitive prim;
+    memset(&prim, 0, sizeof(prim));
+    prim.material = no_material;
+
+    auto set_rect = [&](prim_kind kind, double a0, double a1, double b0,
+                        double b1, double k, const material* m) {
+        prim.kind = kind;
+        prim.material = add_material(m);
+        prim.rect = flat_rect{ a0, a1, b0, b1, k };
+    };
+
+    if (type == typeid(sphere)) {
+        auto s = static_cast<const sphere*>(object);
+        prim.kind = prim_sphere;
+        prim.material = add_material(s->mat_ptr.get());
+        prim.sph = flat_sphere{ { s->center.x(), s->center.y(), s->center.z() },
+                                s->radius };
+    }
+    else if (type == typeid(moving_sphere)) {
+        auto s = static_cast<const moving_sphere*>(object);
+        prim.kind = prim_moving_sphere;
+        prim.material = add_material(s->mat_ptr.get());
+        prim.msph = flat_moving_sphere{
+            { s->center0.x(), s->center0.y(), s->center0.z() },
+            { s->center1.x(), s->center1.y(), s->center1.z() },
+            s->time0, s->time1, s->radius };
+    }
+    else if (type == typeid(xy_rect)) {
+        auto q = static_cast<const xy_rect*>(object);
+        set_rect(prim_xy_rect, q->x0, q->x1, q->y0, q->y1, q->k, q->mp.get());
+    }
+    else if (type == typeid(xz_rect)) {
+        auto q = static_cast<const xz_rect*>(object);
+        set_rect(prim_xz_rect, q->x0, q->x1, q->z0, q->z1, q->k, q->mp.get());
+    }
+    else if (type == typeid(yz_rect)) {
+        auto q = static_cast<const yz_rect*>(object);
+        set_rect(prim_yz_rect, q->y0, q->y1, q->z0, q->z1, q->k, q->mp.get());
+    }
+    else if (dynamic_cast<const transformed*>(object) &&
+             depth < flat_hit::max_depth) {
+        auto tr = static_cast<const transformed*>(object);
+        std::vector<flat_primitive> inner;
+        std::vector<flat_bounds> inner_bounds;
+        gather(tr->ptr.get(), inner, inner_bounds, depth+1);
+        if (inner.empty())
+            return;
+
+        flat_instance inst;
+        memset(static_cast<void*>(&inst), 0, sizeof(inst));
+        inst.object_to_world = tr->object_to_world;
+        inst.world_to_object = tr->world_to_object;
+        inst.normal_to_world = tr->normal_to_world;
+        inst.root = build_tree(inner, inner_bounds);
+
+        prim.kind = prim_instance;
+        prim.index = static_cast<uint32_t>(owned_instances.size());
+        owned_instances.push_back(inst);
+    }
+    else {
+        prim.kind = prim_external;
+        prim.index = static_cast<uint32_t>(externals.size());
+        externals.push_back(object);
+    }
+
+    flat_bounds b;
+    b.grow(box_bounds);
+    out.push_back(prim);
+    bounds.push_back(b);
+}
+
+/* Builds a BVH over TREE_PRIMS and appends the primitives (in leaf
+   order) and nodes to the scene arrays. Returns the root node. */
+uint32_t compiled_scene::build_tree(std::vector<flat_primitive>& tree_prims,
+                                    const std::vector<flat_bounds>& bounds) {
+    std::vector<uint32_t> order;
+    auto tree_nodes = build_flat_bvh(bounds, order, scene_leaf_prims);
+
+    uint32_t prim_base = static_cast<uint32_t>(owned_prims.size());
+    uint32_t node_base = static_cast<uint32_t>(owned_nodes.size());
+
+    for (uint32_t i : order)
+        owned_prims.push_back(tree_prims[i]);
+
+    for (auto n : tree_nodes) {
+        n.offset += n.count ? prim_base : node_base;
+        owned_nodes.push_back(n);
+    }
+
+    return node_base;
+}
+
+/* Returns the index of material M, adding it on first use. */
+uint32_t compiled_scene::add_material(const material* m) {
+    auto found = material_index.find(m);
+    if (found != material_index.end())
+        return found->second;
+
+    flat_material fm;
+    fm.ptr = m;
+    fm.texture = 0;
+    fm.albedo = color(0, 0, 0);
+    fm.fuzz = fm.ir = 0;
+
+    const std::type_info& type = typeid(*m);
+    if (type == typeid(lambertian)) {
+        fm.kind = mat_lambertian;
+        fm.texture = add_texture(static_cast<const lambertian*>(m)->albedo.get());
+    }
+    else if (type == typeid(metal)) {
+        fm.kind = mat_metal;
+        fm.albedo = static_cast<const metal*>(m)->albedo;
+        fm.fuzz = static_cast<const metal*>(m)->fuzz;
+    }
+    else if (type == typeid(dielectric)) {
+        fm.kind = mat_dielectric;
+        fm.ir = static_cast<const dielectric*>(m)->ir;
+    }
+    else if (type == typeid(diffuse_light)) {
+        fm.kind = mat_diffuse_light;
+        fm.texture = add_texture(static_cast<const diffuse_light*>(m)->emit.get());
+    }
+    else
+        fm.kind = mat_external;
+
+    uint32_t index = static_cast<uint32_t>(owned_materials.size());
+    owned_materials.push_back(fm);
+    material_index[m] = index;
+    return index;
+}
+
+/* Returns the entry point of texture T in the texture program,
+   compiling it (and any textures it refers to) on first use. PARITY
+   is what enclosing checkers have already decided. */
+uint32_t compiled_scene::add_texture(const texture* t, checker_parity parity) {
+    auto found = texture_index.find({t, parity});
+    if (found != texture_index.end())
+        return found->second;
+
+    flat_texture ft;
+    ft.ptr = t;
+    ft.even = ft.odd = 0;
+    ft.value = color(0, 0, 0);
+    const void* identity = t;
+    uint32_t index;
+
+    const std::type_info& type = typeid(*t);
+    if (type == typeid(solid_color)) {
+        ft.kind = tex_solid;
+        ft.value = t->value(0, 0, point3());
+        identity = nullptr;
+        index = intern_texture(ft, identity);
+    }
+    else if (type == typeid(checker_texture)) {
+        auto c = static_cast<const checker_texture*>(t);
+
+        /* A checker below another checker always takes the same side. */
+        if (parity != parity_unknown)
+            index = add_texture(parity == parity_odd ? c->odd.get()
+                                                     : c->even.get(), parity);
+        else {
+            ft.kind = tex_checker;
+            ft.even = add_texture(c->even.get(), parity_even);
+            ft.odd = add_texture(c->odd.get(), parity_odd);
+            index = ft.even == ft.odd ? ft.even : intern_texture(ft, nullptr);
+        }
+    }
+    else {
+        if (type == typeid(noise_texture))
+            ft.kind = tex_noise;
+        else if (type == typeid(image_texture)) {
+            ft.kind = tex_image;
+
+            /* Textures of the same image are interchangeable. */
+            identity = static_cast<const image_texture*>(t)->image.get();
+        }
+        else if (type == typeid(baked_texture))
+            ft.kind = tex_baked;
+        else
+            ft.kind = tex_external;
+        index = intern_texture(ft, identity);
+    }
+
+    texture_index[{t, parity}] = index;
+    return index;
+}
+
+/* Returns the index of an instruction equal to FT, adding it if there
+   is none. Constants and checkers are compared by value, and other
+   instructions by IDENTITY. */
+uint32_t compiled_scene::intern_texture(const flat_texture& ft,
+                                        const void* identity) {
+    auto key = std::make_tuple(ft.kind, ft.even, ft.odd, ft.value.x(),
+                               ft.value.y(), ft.value.z(), identity);
+    auto found = texture_code.find(key);
+    if (found != texture_code.end())
+        return found->second;
+
+    uint32_t index = static_cast<uint32_t>(owned_textures.size());
+    owned_textures.push_back(ft);
+    texture_code[key] = index;
+    return index;
+}
+
+bool compiled_scene::hit(const ray& r, double t_min, double t_max,
+                         flat_hit& h) const {
+    PROFILE_SCOPE(stage_intersect);
+    if (nodes.empty())
+        return false;
+
+    if (!hit_tree(root, r, t_min, t_max, h, 0))
+        return false;
+
+    h.t = t_max;
+    return true;
+}
+
+/* Finds the closest hit of ray R in the subtree at NODE, nested in
+   DEPTH instances, lowering T_MAX to its distance. */
+bool compiled_scene::hit_tree(uint32_t node, const ray& r, double t_min,
+                              double& t_max, flat_hit& h, int depth) const {
+    auto test_leaf = [&](uint32_t first, uint32_t count, double& t_far) {
+        bool hit_leaf = false;
+
+        for (uint32_t i = first; i < first + count; i++) {
+            const flat_primitive& p = prims[i];
+            double t;
+            bool found = false;
+
+            switch (p.kind) {
+                case prim_sphere:
+                    found = hit_sphere(point3(p.sph.center[0], p.sph.center[1],
+                                              p.sph.center[2]),
+                                       p.sph.radius, r, t_min, t_far, t);
+                    break;
+
+                case prim_moving_sphere: {
+                    const flat_moving_sphere& s = p.msph;
+                    double f = (r.time() - s.time0) / (s.time1 - s.time0);
+                    point3 c0(s.center0[0], s.center0[1], s.center0[2]);
+                    point3 c1(s.center1[0], s.center1[1], s.center1[2]);
+                    found = hit_sphere(c0 + f*(c1 - c0), s.radius, r,
+                                       t_min, t_far, t);
+                    break;
+                }
+
+                case prim_xy_rect:
+                    found = hit_axis_rect(r, 0, 1, 2, p.rect.a0, p.rect.a1,
+                                          p.rect.b0, p.rect.b1, p.rect.k,
+                                          t_min, t_far, t);
+                    break;
+
+                case prim_xz_rect:
+                    found = hit_axis_rect(r, 0, 2, 1, p.rect.a0, p.rect.a1,
+                                          p.rect.b0, p.rect.b1, p.rect.k,
+                                          t_min, t_far, t);
+                    break;
+
+                case prim_yz_rect:
+                    found = hit_axis_rect(r, 1, 2, 0, p.rect.a0, p.rect.a1,
+                                          p.rect.b0, p.rect.b1, p.rect.k,
+                                          t_min, t_far, t);
+                    break;
+
+                case prim_instance: {
+                    const flat_instance& inst = instances[p.index];
+                    ray local(inst.world_to_object.point(r.origin()),
+                              inst.world_to_object.vector(r.direction()),
+                              r.time());
+                    if (hit_tree(inst.root, local, t_min, t_far, h, depth+1)) {
+                        h.instances[depth] = i;
+                        hit_leaf = true;
+                    }
+                    continue;
+                }
+
+                default:
+                    if (externals[p.index]->hit(r, t_min, t_far, h.ext)) {
+                        t = h.ext.t;
+                        found = true;
+                    }
+                    break;
+            }
+
+            if (found) {
+                t_far = t;
+                h.prim = i;
+                h.depth = depth;
+                hit_leaf = true;
+            }
+        }
+
+        return hit_leaf;
+    };
+
+    /* Small trees are a single leaf, tested without a box test. */
+    if (nodes[node].count != 0) {
+        PROFILE_TALLY(tally);
+        PROFILE_ADD(tally, count_prim_tests, nodes[node].count);
+        PROFILE_COMMIT(tally);
+        return test_leaf(nodes[node].offset, nodes[node].count, t_max);
+    }
+
+    return traverse_flat_bvh(nodes.data(), node, r, t_min, t_max, test_leaf);
+}
+
+uint32_t compiled_scene::get_surface(const ray& r, const flat_hit& h,
+                                     hit_record& rec) const {
+    PROFILE_SCOPE(stage_surface);
+    if (h.depth == 0)
+        return primitive_surface(r, h, rec);
+
+    /* Follow the ray into the frame of the innermost instance,
+       keeping the ray outside each instance for the way back. */
+    ray outer[flat_hit::max_depth];
+    ray local = r;
+    for (int d = 0; d < h.depth; d++) {
+        const flat_instance& inst = instances[prims[h.instances[d]].index];
+        outer[d] = local;
+        local = inst.world_to_object.transform(local);
+    }
+
+    uint32_t mat = primitive_surface(local, h, rec);
+
+    /* Map the point and normal back out through each instance. */
+    for (int d = h.depth - 1; d >= 0; d--) {
+        const flat_instance& inst = instances[prims[h.instances[d]].index];
+        rec.p = inst.object_to_world.point(rec.p);
+        auto outward_normal = rec.front_face ? rec.normal : -rec.normal;
+        rec.set_face_normal(outer[d], unit_vector(
+            inst.normal_to_world.vector(outward_normal)));
+    }
+
+    return mat;
+}
+
+/* Fills REC for hit H on its innermost primitive, where R is the ray
+   in the frame of that primitive. */
+uint32_t compiled_scene::primitive_surface(const ray& r, const flat_hit& h,
+                                           hit_record& rec) const {
+    const flat_primitive& p = prims[h.prim];
+
+    if (p.kind == prim_external) {
+        rec = h.ext;
+        rec.finalize(r);
+        return no_material;
+    }
+
+    rec.t = h.t;
+    rec.p = r.at(h.t);
+    rec.mat_ptr = materials[p.material].ptr;
+
+    /* Surface derivatives for the texture footprint, if known. */
+    vec3 outward_normal, dpdu, dpdv;
+    bool has_tangents = false;
+
+    switch (p.kind) {
+        case prim_sphere: {
+            point3 c(p.sph.center[0], p.sph.center[1], p.sph.center[2]);
+            outward_normal = (rec.p - c) / p.sph.radius;
+            sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+            has_tangents = r.has_differentials &&
+                sphere::get_sphere_tangents(outward_normal, p.sph.radius,
+                                            dpdu, dpdv);
+            break;
+        }
+
+        case prim_moving_sphere: {
+            const flat_moving_sphere& s = p.msph;
+            double f = (r.time() - s.time0) / (s.time1 - s.time0);
+            point3 c0(s.center0[0], s.center0[1], s.center0[2]);
+            point3 c1(s.center1[0], s.center1[1], s.center1[2]);
+            outward_normal = (rec.p - (c0 + f*(c1 - c0))) / s.radius;
+            break;
+        }
+
+        default: {
+            int a_axis = p.kind == prim_yz_rect ? 1 : 0;
+            int b_axis = p.kind == prim_xy_rect ? 1 : 2;
+            int k_axis = 3 - a_axis - b_axis;
+            rec.u = (rec.p[a_axis]-p.rect.a0) / (p.rect.a1-p.rect.a0);
+            rec.v = (rec.p[b_axis]-p.rect.b0) / (p.rect.b1-p.rect.b0);
+            outward_normal[k_axis] = 1;
+            dpdu[a_axis] = p.rect.a1 - p.rect.a0;
+            dpdv[b_axis] = p.rect.b1 - p.rect.b0;
+            has_tangents = r.has_differentials;
+            break;
+        }
+    }
+    rec.set_face_normal(r, outward_normal);
+    if (has_tangents)
+        rec.set_footprint(r, dpdu, dpdv);
+
+    return p.material;
+}
+
+/* Dispatches material::emitted on the material tag. */
+color compiled_scene::emitted(uint32_t mat, const hit_record& rec) const {
+    if (mat == no_material)
+        return rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
+
+    const flat_material& m = materials[mat];
+    switch (m.kind) {
+        case mat_diffuse_light:
+            return texture_value(m.texture, rec.u, rec.v, rec.p,
+                                 texture_footprint());
+        case mat_external:
+            return m.ptr->emitted(rec.u, rec.v, rec.p);
+        default:
+            return color(0, 0, 0);
+    }
+}
+
+/* Dispatches material::scatter on the material tag. The built-in
+   materials scatter non-virtually from the parameters in their
+   records, and diffuse albedo textures are looked up through
+   texture_value(). */
+bool compiled_scene::scatter(uint32_t mat, const ray& r_in,
+                             const hit_record& rec, color& attenuation,
+                             ray& scattered) const {
+    PROFILE_SCOPE(stage_scatter);
+    if (mat == no_material)
+        return rec.mat_ptr->scatter(r_in, rec, attenuation, scattered);
+
+    const flat_material& m = materials[mat];
+    switch (m.kind) {
+        case mat_lambertian:
+            lambertian::scatter_ray(r_in, rec, scattered);
+            attenuation = texture_value(m.texture, rec.u, rec.v, rec.p,
+                                        rec.footprint);
+            return true;
+
+        case mat_metal:
+            attenuation = m.albedo;
+            return metal::scatter_ray(r_in, rec, m.fuzz, scattered);
+
+        case mat_dielectric:
+            attenuation = color(1.0, 1.0, 1.0);
+            dielectric::scatter_ray(r_in, rec, m.ir, scattered);
+            return true;
+
+        case mat_diffuse_light:
+            return false;
+
+        default:
+            return m.ptr->scatter(r_in, rec, attenuation, scattered);
+    }
+}
+
+/* Runs the texture program from instruction TEX: checkers branch
+   until an instruction yields a color, dispatched on its tag. */
+color compiled_scene::texture_value(uint32_t tex, double u, double v,
+                                    const point3& p,
+                                    const texture_footprint& fp) const {
+    PROFILE_SCOPE(stage_texture);
+    while (true) {
+        const flat_texture& t = textures[tex];
+        switch (t.kind) {
+            case tex_solid:
+                return t.value;
+
+            case tex_checker:
+                tex = checker_texture::is_odd(p) ? t.odd : t.even;
+                break;
+
+            case tex_noise:
+                return static_cast<const noise_texture*>(t.ptr)
+                    ->noise_texture::value(u, v, p);
+
+            case tex_image:
+                return static_cast<const image_texture*>(t.ptr)
+                    ->image_texture::filtered_value(u, v, p, fp);
+
+            case tex_baked:
+                return static_cast<const baked_texture*>(t.ptr)
+                    ->baked_texture::value(u, v, p);
+
+            default:
+                return t.ptr->filtered_value(u, v, p, fp);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,307 @@
+#include "util.h"
+#include "scenes.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include "camera.h"
+#include "compiled-scene.h"
+#include "framebuffer.h"
+#include "image-io.h"
+#include "integrator.h"
+#include "scene-pass.h"
+#include "texture-bake.h"
+
+/*
+   Measures how fast renders converge: for each scene of
+   select_scene(), renders a candidate progressively, one sample per
+   pixel per pass, and after each pass compares the image with a
+   high-sample reference. The curve is written as CSV, one row per
+   pass:
+
+       scene,name,spp,time_s,rmse,relmse
+
+   where TIME_S is the wall-clock time since the candidate's scene
+   began to build (so baking counts against it), RMSE is the root mean
+   square error of the pixel channels, and RELMSE the mean of
+   (c - r)^2 / (r^2 + 0.01), which weighs dark and bright regions
+   alike. Comparisons are left out of the time. A sampler, integrator
+   or texture change is judged by the time its curve takes to reach a
+   given error, e.g. with --target.
+
+   The reference for each scene is rendered with REF_SPP samples
+   (1024 by default), a maximum depth of 50 and no baking, from a seed
+   of its own so its noise is independent of the candidate's. It is
+   cached in CACHE_DIR (convergence-cache by default) as an
+   accumulation buffer, and rendered again only if missing or with
+   --refresh, e.g. after a change that should alter the image.
+
+   The candidate is rendered until it has SPP samples (256 by
+   default), --time seconds have passed, or its relMSE is at most
+   --target. Its options are the maximum depth, baking of noise
+   textures (--bake), threads (all cores by default) and seed.
+
+   Usage: convergence [--width n] [--ref-spp n] [--spp n] [--time s]
+                      [--target relmse] [--max-depth n] [--bake]
+                      [--threads n] [--seed n] [--scenes i,j,...]
+                      [--cache dir] [--refresh] [output.csv]
+
+   Run it from the top of the repository, where the texture images
+   are. The CSV goes to standard output if no file is given.
+*/
+
+namespace {
+
+const int reference_depth = 50;
+const uint64_t reference_seed = 0x7265666572656e63;
+const double relmse_epsilon = 0.01;
+
+struct convergence_settings {
+    int width = 200;
+    int reference_spp = 1024;
+    int samples_per_pixel = 256;
+    double time_limit = 0;    /* Seconds, or 0 for no limit. */
+    double target = 0;        /* relMSE to stop at, or 0 for none. */
+    int max_depth = 50;
+    bool bake = false;
+    int threads = 0;
+    uint64_t seed = 0;
+    std::string cache_dir = "convergence-cache";
+    bool refresh = false;
+};
+
+/* A scene built as main builds it, and the size of its image. */
+struct bench_scene {
+    scene_arena arena;
+    scene_setup setup;
+    shared_ptr<compiled_scene> compiled;
+    int width, height;
+};
+
+/* Builds scene INDEX into SCENE at WIDTH pixels across, baking its
+   noise textures if BAKE is set. */
+void build_scene(int index, int width, bool bake, bench_scene& scene) {
+    /* Start from the random sequence of a fresh process, so random
+       scenes are the ones main renders, and the same in every run. */
+    thread_random() = random_generator();
+    select_scene(index, scene.arena, scene.setup);
+    collapse_transforms(scene.setup.world);
+    if (bake)
+        bake_noise_textures(scene.setup.world);
+    scene.compiled = make_shared<compiled_scene>(scene.setup.world, 0.0, 1.0);
+    scene.width = width;
+    scene.height = static_cast<int>(width / scene.setup.aspect_ratio);
+}
+
+/* Adds sample PASS to every pixel of IMAGE, handing rows out to
+   THREADS threads. */
+void render_pass(const bench_scene& scene, int max_depth, uint64_t seed,
+                 int pass, int threads, framebuffer& image) {
+    camera cam = scene_camera(scene.setup);
+    std::atomic<int> next_row(0);
+    auto work = [&]() {
+        for (int y; (y = next_row++) < scene.height; ) {
+            for (int x = 0; x < scene.width; x++)
+                image.add(x, y, trace_sample(*scene.compiled, cam,
+                                             scene.setup.background,
+                                             scene.width, scene.height,
+                                             max_depth, seed, x,
+                                             scene.height-1-y, pass), 1);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int w = 1; w < threads; w++)
+        workers.emplace_back(work);
+    work();
+    for (auto& w : workers)
+        w.join();
+}
+
+/* Errors of an image against a reference (see above). */
+struct image_error {
+    double rmse, relmse;
+};
+
+/* Compares IMAGE with REFERENCE, pixel by pixel. Channels the
+   reference has no finite value for are left out. */
+image_error compare_images(const framebuffer& image,
+                           const framebuffer& reference) {
+    double squared = 0, relative = 0;
+    size_t n = 0;
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            color c = image.average(x, y);
+            color r = reference.average(x, y);
+            for (int a = 0; a < 3; a++) {
+                if (!std::isfinite(r[a]))
+                    continue;
+                double d = (c[a] - r[a]) * (c[a] - r[a]);
+                squared += d;
+                relative += d / (r[a] * r[a] + relmse_epsilon);
+                n++;
+            }
+        }
+    }
+    return n ? image_error{ sqrt(squared / n), relative / n }
+             : image_error{ 0, 0 };
+}
+
+/* Loads the reference of scene INDEX from the cache, or renders and
+   caches it. */
+void reference_image(int index, const convergence_settings& settings,
+                     framebuffer& reference) {
+    std::ostringstream name;
+    name << settings.cache_dir << "/scene" << index << "-w" << settings.width
+         << "-s" << settings.reference_spp << ".rtacc";
+    std::string path = name.str();
+
+    bench_scene scene;
+    build_scene(index, settings.width, false, scene);
+    if (!settings.refresh && load_accumulation(path, reference) &&
+        reference.width == scene.width && reference.height == scene.height)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    reference = framebuffer(scene.width, scene.height);
+    for (int pass = 0; pass < settings.reference_spp; pass++) {
+        std::cerr << "\rReference for scene " << index << ", pass "
+                  << pass + 1 << " of " << settings.reference_spp << ' '
+                  << std::flush;
+        render_pass(scene, reference_depth, reference_seed, pass,
+                    settings.threads, reference);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "in " << elapsed.count() << " s\n";
+
+    mkdir(settings.cache_dir.c_str(), 0755);
+    if (!write_image(reference, path))
+        std::cerr << "WARNING: Could not write reference '" << path << "'.\n";
+}
+
+/* Renders the candidate of scene INDEX progressively against
+   REFERENCE, appending a CSV row per pass to CSV. */
+void converge(int index, const convergence_settings& settings,
+              const framebuffer& reference, std::ostringstream& csv) {
+    using clock = std::chrono::steady_clock;
+    std::chrono::duration<double> elapsed(0);
+    auto start = clock::now();
+
+    bench_scene scene;
+    build_scene(index, settings.width, settings.bake, scene);
+    framebuffer image(scene.width, scene.height);
+
+    image_error error = { 0, 0 };
+    int pass = 0;
+    while (pass < settings.samples_per_pixel) {
+        render_pass(scene, settings.max_depth, settings.seed, pass,
+                    settings.threads, image);
+        pass++;
+        elapsed += clock::now() - start;
+
+        error = compare_images(image, reference);
+        char row[160];
+        snprintf(row, sizeof(row), "%d,%s,%d,%.6f,%.9g,%.9g\n", index,
+                 scene_names[index], pass, elapsed.count(), error.rmse,
+                 error.relmse);
+        csv << row;
+        std::cerr << "\rScene " << index << ", " << pass << " spp, "
+                  << elapsed.count() << " s, relMSE " << error.relmse
+                  << "   " << std::flush;
+
+        if ((settings.target > 0 && error.relmse <= settings.target) ||
+            (settings.time_limit > 0 && elapsed.count() >= settings.time_limit))
+            break;
+        start = clock::now();
+    }
+
+    std::cerr << "\rScene " << index << " (" << scene_names[index] << "): ";
+    if (settings.target > 0 && error.relmse <= settings.target)
+        std::cerr << "reached relMSE " << settings.target << " in "
+                  << elapsed.count() << " s at " << pass << " spp\n";
+    else
+        std::cerr << "relMSE " << error.relmse << ", RMSE " << error.rmse
+                  << " after " << elapsed.count() << " s at " << pass
+                  << " spp\n";
+}
+
+}
+
+int main(int argc, char** argv) {
+    convergence_settings settings;
+    std::vector<int> scenes;
+    std::string output = "-";
+    bool usage = false;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--width" && a + 1 < argc)
+            usage |= (settings.width = atoi(argv[++a])) < 2;
+        else if (arg == "--ref-spp" && a + 1 < argc)
+            usage |= (settings.reference_spp = atoi(argv[++a])) < 1;
+        else if (arg == "--spp" && a + 1 < argc)
+            usage |= (settings.samples_per_pixel = atoi(argv[++a])) < 1;
+        else if (arg == "--time" && a + 1 < argc)
+            settings.time_limit = atof(argv[++a]);
+        else if (arg == "--target" && a + 1 < argc)
+            settings.target = atof(argv[++a]);
+        else if (arg == "--max-depth" && a + 1 < argc)
+            usage |= (settings.max_depth = atoi(argv[++a])) < 1;
+        else if (arg == "--bake")
+            settings.bake = true;
+        else if (arg == "--threads" && a + 1 < argc)
+            settings.threads = atoi(argv[++a]);
+        else if (arg == "--seed" && a + 1 < argc)
+            settings.seed = strtoull(argv[++a], nullptr, 10);
+        else if (arg == "--cache" && a + 1 < argc)
+            settings.cache_dir = argv[++a];
+        else if (arg == "--refresh")
+            settings.refresh = true;
+        else if (arg == "--scenes" && a + 1 < argc) {
+            std::istringstream list(argv[++a]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                int index = atoi(item.c_str());
+                usage |= index < 0 || index >= scene_count;
+                scenes.push_back(index);
+            }
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+            usage = true;
+        else
+            output = arg;
+    }
+    if (usage) {
+        std::cerr << "Usage: " << argv[0] << " [--width n] [--ref-spp n] "
+                  << "[--spp n] [--time s] [--target relmse] [--max-depth n] "
+                  << "[--bake] [--threads n] [--seed n] [--scenes i,j,...] "
+                  << "[--cache dir] [--refresh] [output.csv]\n";
+        return 1;
+    }
+    if (settings.threads <= 0)
+        settings.threads = std::max(1u, std::thread::hardware_concurrency());
+    if (scenes.empty())
+        for (int index = 0; index < scene_count; index++)
+            scenes.push_back(index);
+
+    std::ostringstream csv;
+    csv << "scene,name,spp,time_s,rmse,relmse\n";
+    for (int index : scenes) {
+        framebuffer reference;
+        reference_image(index, settings, reference);
+        converge(index, settings, reference, csv);
+    }
+
+    FILE* f = output == "-" ? stdout : fopen(output.c_str(), "w");
+    if (!f || fputs(csv.str().c_str(), f) < 0 ||
+        (f != stdout ? fclose(f) : fflush(f)) != 0) {
+        std::cerr << "ERROR: Could not write '" << output << "'.\n";
+        return 1;
+    }
+}
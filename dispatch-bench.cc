@@ -0,0 +1,94 @@
+#include "util.h"
+#include "scenes.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "camera.h"
+#include "integrator.h"
+#include "scene-pass.h"
+
+/*
+   Compares rendering each scene through the virtual "hittable" graph
+   with rendering its compiled, tag-dispatched form.
+
+   Usage: dispatch-bench [image_width] [samples_per_pixel] [scene]
+
+   Both renders start from the same random seed, so they trace the
+   same paths and should produce the same image. Each render is
+   repeated and the fastest time is reported.
+*/
+
+const int repetitions = 5;
+
+/* Renders WIDTH x HEIGHT pixels with SPP samples each into PIXELS,
+   tracing with WORLD (a hittable or a compiled_scene). Returns the
+   wall time in seconds. */
+template <typename World>
+double render(const World& world, const camera& cam, const color& background,
+              int width, int height, int spp, std::vector<color>& pixels) {
+    const int max_depth = 50;
+    pixels.assign(width * height, color(0, 0, 0));
+    seed_random(1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            color pixel_color(0, 0, 0);
+            for (int s = 0; s < spp; ++s) {
+                auto u = (i + random_double()) / (width-1);
+                auto v = (j + random_double()) / (height-1);
+                ray r = cam.get_ray(u, v, 1.0 / (width-1), 1.0 / (height-1));
+                pixel_color += ray_color(r, background, world, max_depth);
+            }
+            pixels[j*width + i] = pixel_color;
+        }
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : 160;
+    int spp = argc > 2 ? atoi(argv[2]) : 8;
+    int first = argc > 3 ? atoi(argv[3]) : 0;
+    int last = argc > 3 ? first : scene_count-1;
+
+    printf("%-6s %12s %12s %8s %12s\n",
+           "scene", "virtual(s)", "compiled(s)", "speedup", "max diff");
+
+    for (int index = first; index <= last; index++) {
+        scene_arena arena;
+        scene_setup setup;
+        select_scene(index, arena, setup);
+        collapse_transforms(setup.world);
+        compiled_scene scene(setup.world, 0.0, 1.0);
+
+        camera cam = scene_camera(setup);
+        int height = static_cast<int>(width / setup.aspect_ratio);
+
+        std::vector<color> virtual_pixels, compiled_pixels;
+        double virtual_time = infinity, compiled_time = infinity;
+        for (int rep = 0; rep < repetitions; rep++) {
+            virtual_time = fmin(virtual_time,
+                                render(setup.world, cam, setup.background,
+                                       width, height, spp, virtual_pixels));
+            compiled_time = fmin(compiled_time,
+                                 render(scene, cam, setup.background,
+                                        width, height, spp, compiled_pixels));
+        }
+
+        double max_diff = 0;
+        for (size_t i = 0; i < virtual_pixels.size(); i++) {
+            for (int c = 0; c < 3; c++) {
+                double d = fabs(virtual_pixels[i][c] - compiled_pixels[i][c]);
+                max_diff = fmax(max_diff, d / spp);
+            }
+        }
+
+        printf("%-6d %12.3f %12.3f %7.2fx %12.3g\n", index, virtual_time,
+               compiled_time, virtual_time / compiled_time, max_diff);
+    }
+}
@@ -0,0 +1,339 @@
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "aabb.h"
+#include "profile.h"
+#include "util.h"
+
+/*
+   A bounding volume hierarchy stored as a flat array of nodes over a
+   flat array of primitives, used where primitives are plain data
+   rather than "hittable" objects (triangle meshes and compiled
+   scenes).
+
+   Nodes are stored depth-first, so the left child of an interior node
+   immediately follows it and OFFSET holds the index of the right
+   child. For leaves, OFFSET is the first primitive and COUNT the
+   number of primitives in the leaf. Several trees may share one node
+   array, each with its own root.
+*/
+struct flat_node {
+    float bmin[3];    /* Lower corner of the node bounding box. */
+    float bmax[3];    /* Upper corner of the node bounding box. */
+    uint32_t offset;  /* Right child (interior) or first primitive (leaf). */
+    uint32_t count;   /* Number of primitives, or 0 for interior nodes. */
+};
+
+const float flat_float_max = std::numeric_limits<float>::max();
+
+/* A single-precision bounding box used while building the tree. */
+struct flat_bounds {
+    float lo[3] = { flat_float_max, flat_float_max, flat_float_max };
+    float hi[3] = { -flat_float_max, -flat_float_max, -flat_float_max };
+
+    void grow(const float* p) {
+        for (int a = 0; a < 3; a++) {
+            lo[a] = std::min(lo[a], p[a]);
+            hi[a] = std::max(hi[a], p[a]);
+        }
+    }
+
+    void grow(const flat_bounds& b) {
+        for (int a = 0; a < 3; a++) {
+            lo[a] = std::min(lo[a], b.lo[a]);
+            hi[a] = std::max(hi[a], b.hi[a]);
+        }
+    }
+
+    /* Grows the bounds to enclose BOX, rounding outwards so that the
+       single-precision box never cuts into the double-precision one. */
+    void grow(const aabb& box) {
+        for (int a = 0; a < 3; a++) {
+            float l = static_cast<float>(box.min()[a]);
+            float h = static_cast<float>(box.max()[a]);
+            if (l > box.min()[a]) l = std::nextafter(l, -flat_float_max);
+            if (h < box.max()[a]) h = std::nextafter(h, flat_float_max);
+            lo[a] = std::min(lo[a], l);
+            hi[a] = std::max(hi[a], h);
+        }
+    }
+
+    float area() const {
+        if (lo[0] > hi[0]) return 0.0f;
+        float dx = hi[0]-lo[0], dy = hi[1]-lo[1], dz = hi[2]-lo[2];
+        return 2.0f * (dx*dy + dy*dz + dz*dx);
+    }
+
+    float centroid(int axis) const { return 0.5f * (lo[axis] + hi[axis]); }
+};
+
+/*
+   BVH construction. Primitives are split with a binned surface area
+   heuristic over the centroids of their bounds.
+*/
+
+namespace flat_bvh_build {
+
+const int bin_count = 16;
+const int max_depth = 60;
+
+struct builder {
+    const std::vector<flat_bounds>& prim_bounds;
+    std::vector<uint32_t>& order;
+    std::vector<flat_node> nodes;
+    uint32_t max_leaf;
+
+    builder(const std::vector<flat_bounds>& b, std::vector<uint32_t>& o,
+            uint32_t leaf)
+        : prim_bounds(b), order(o), max_leaf(leaf) {}
+
+    uint32_t build(uint32_t start, uint32_t end, int depth);
+};
+
+/* Recursively builds the subtree over primitives ORDER[START, END)
+   and returns the index of its root node. */
+uint32_t builder::build(uint32_t start, uint32_t end, int depth) {
+    uint32_t node_index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(flat_node());
+
+    flat_bounds box, centroid_box;
+    for (uint32_t i = start; i < end; i++) {
+        const flat_bounds& b = prim_bounds[order[i]];
+        float c[3] = { b.centroid(0), b.centroid(1), b.centroid(2) };
+        box.grow(b);
+        centroid_box.grow(c);
+    }
+
+    auto make_leaf = [&]() {
+        flat_node& n = nodes[node_index];
+        std::copy(box.lo, box.lo + 3, n.bmin);
+        std::copy(box.hi, box.hi + 3, n.bmax);
+        n.offset = start;
+        n.count = end - start;
+        return node_index;
+    };
+
+    /* Depth is capped so traversal stacks never overflow. */
+    uint32_t span = end - start;
+    if (span <= max_leaf || depth >= max_depth)
+        return make_leaf();
+
+    /* Split along the axis with the widest centroid spread. */
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+        if (centroid_box.hi[a] - centroid_box.lo[a] >
+            centroid_box.hi[axis] - centroid_box.lo[axis])
+            axis = a;
+    }
+
+    float lo = centroid_box.lo[axis];
+    float extent = centroid_box.hi[axis] - lo;
+    if (extent <= 0.0f)
+        return make_leaf();
+
+    /* Bin the centroids and pick the cheapest bin boundary. */
+    flat_bounds bin_box[bin_count];
+    uint32_t bin_prims[bin_count] = {};
+    float bin_scale = bin_count / extent;
+
+    auto bin_of = [&](uint32_t prim) {
+        float c = prim_bounds[prim].centroid(axis);
+        int b = static_cast<int>((c - lo) * bin_scale);
+        return std::min(b, bin_count-1);
+    };
+
+    for (uint32_t i = start; i < end; i++) {
+        int b = bin_of(order[i]);
+        bin_box[b].grow(prim_bounds[order[i]]);
+        bin_prims[b]++;
+    }
+
+    float left_area[bin_count-1];
+    uint32_t left_prims[bin_count-1];
+    flat_bounds acc;
+    uint32_t acc_prims = 0;
+    for (int b = 0; b < bin_count-1; b++) {
+        acc.grow(bin_box[b]);
+        acc_prims += bin_prims[b];
+        left_area[b] = acc.area();
+        left_prims[b] = acc_prims;
+    }
+
+    int best_split = -1;
+    float best_cost = flat_float_max;
+    acc = flat_bounds();
+    acc_prims = 0;
+    for (int b = bin_count-1; b > 0; b--) {
+        acc.grow(bin_box[b]);
+        acc_prims += bin_prims[b];
+        if (left_prims[b-1] == 0 || acc_prims == 0)
+            continue;
+
+        float cost = left_area[b-1] * left_prims[b-1] + acc.area() * acc_prims;
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_split = b;
+        }
+    }
+
+    /* Compare against the cost of intersecting every primitive. */
+    if (best_split < 0 ||
+        (span <= 2*max_leaf && best_cost >= box.area() * span))
+        return make_leaf();
+
+    auto mid_it = std::partition(order.begin() + start, order.begin() + end,
+                                 [&](uint32_t prim) {
+                                     return bin_of(prim) < best_split;
+                                 });
+    uint32_t mid = static_cast<uint32_t>(mid_it - order.begin());
+
+    build(start, mid, depth+1);
+    uint32_t right = build(mid, end, depth+1);
+
+    flat_node& n = nodes[node_index];
+    std::copy(box.lo, box.lo + 3, n.bmin);
+    std::copy(box.hi, box.hi + 3, n.bmax);
+    n.offset = right;
+    n.count = 0;
+    return node_index;
+}
+
+} // namespace flat_bvh_build
+
+/* Builds a BVH over primitives with bounds PRIM_BOUNDS, with at most
+   MAX_LEAF primitives per leaf. On return ORDER lists the primitives
+   in leaf order, and leaf offsets index into ORDER. */
+std::vector<flat_node> build_flat_bvh(const std::vector<flat_bounds>& prim_bounds,
+                                      std::vector<uint32_t>& order,
+                                      uint32_t max_leaf) {
+    order.resize(prim_bounds.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = static_cast<uint32_t>(i);
+
+    if (order.empty())
+        return std::vector<flat_node>();
+
+    flat_bvh_build::builder b(prim_bounds, order, max_leaf);
+    b.nodes.reserve(2 * order.size() / max_leaf + 1);
+    b.build(0, static_cast<uint32_t>(order.size()), 0);
+    b.nodes.shrink_to_fit();
+    return std::move(b.nodes);
+}
+
+/* Checks the NODE_COUNT nodes of NODES, read from a file, before they
+   are traversed: the children of each interior node must follow it
+   in the array, and each leaf must lie within PRIM_COUNT primitives.
+   Returns the height of every node (0 for a leaf), or an empty vector
+   if a node is malformed. Since children follow their parents, one
+   pass from the end finds the heights even of shared nodes. A tree
+   is only safe to traverse if its root is at most
+   flat_bvh_build::max_depth high. */
+std::vector<int> flat_bvh_heights(const flat_node* nodes, size_t node_count,
+                                  size_t prim_count) {
+    std::vector<int> height(node_count, 0);
+    for (size_t i = node_count; i-- > 0; ) {
+        const flat_node& n = nodes[i];
+        if (n.count == 0) {
+            if (n.offset <= i + 1 || n.offset >= node_count)
+                return std::vector<int>();
+            height[i] = 1 + std::max(height[i + 1], height[n.offset]);
+        }
+        else if (n.offset > prim_count || n.count > prim_count - n.offset)
+            return std::vector<int>();
+    }
+    return height;
+}
+
+/* Traverses the tree rooted at NODES[ROOT] front to back, calling
+   LEAF(first, count, t_max) for every leaf the ray R enters within
+   [T_MIN, T_MAX]. LEAF tests its primitives, lowers T_MAX to the
+   closest hit it finds and returns true if it found one. Returns
+   true if any leaf reported a hit. */
+template <typename LeafFn>
+bool traverse_flat_bvh(const flat_node* nodes, uint32_t root, const ray& r,
+                       double t_min, double& t_max, LeafFn&& leaf) {
+    const vec3 org = r.origin();
+    const vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(),
+                       1.0 / r.direction().z());
+    const int dir_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0,
+                             inv_dir.z() < 0 };
+
+    /* Returns the distance at which the ray enters the box of node N,
+       or infinity if it misses the box within [T_MIN, T_FAR]. The
+       exit distance is padded by a few ulps so that rounding never
+       culls a box that the ray grazes (Ize 2013). */
+    const double robust_pad = 1 + 4*std::numeric_limits<double>::epsilon();
+    auto box_entry = [&](const flat_node& n, double t_far) {
+        double t0 = t_min, t1 = t_far;
+        for (int a = 0; a < 3; a++) {
+            double near = dir_neg[a] ? n.bmax[a] : n.bmin[a];
+            double far = dir_neg[a] ? n.bmin[a] : n.bmax[a];
+            double tn = (near - org[a]) * inv_dir[a];
+            double tf = (far - org[a]) * inv_dir[a] * robust_pad;
+            t0 = tn > t0 ? tn : t0;
+            t1 = tf < t1 ? tf : t1;
+        }
+        return t0 <= t1 ? t0 : infinity;
+    };
+
+    if (box_entry(nodes[root], t_max) == infinity)
+        return false;
+
+    /* Deferred nodes and the distance at which the ray enters them. */
+    uint32_t stack[flat_bvh_build::max_depth + 4];
+    double stack_t[flat_bvh_build::max_depth + 4];
+    int stack_size = 0;
+    uint32_t node_index = root;
+    bool hit_anything = false;
+    PROFILE_TALLY(tally);
+
+    while (true) {
+        const flat_node& n = nodes[node_index];
+        PROFILE_ADD(tally, count_bvh_nodes, 1);
+
+        if (n.count == 0) {
+
+            /* Descend into the nearer child and defer the farther. */
+            uint32_t near_child = node_index + 1;
+            uint32_t far_child = n.offset;
+            double t_near = box_entry(nodes[near_child], t_max);
+            double t_far = box_entry(nodes[far_child], t_max);
+            if (t_far < t_near) {
+                std::swap(near_child, far_child);
+                std::swap(t_near, t_far);
+            }
+
+            if (t_near != infinity) {
+                if (t_far != infinity) {
+                    stack[stack_size] = far_child;
+                    stack_t[stack_size++] = t_far;
+                }
+                node_index = near_child;
+                continue;
+            }
+        }
+        else {
+            PROFILE_ADD(tally, count_prim_tests, n.count);
+            if (leaf(n.offset, n.count, t_max))
+                hit_anything = true;
+        }
+
+        /* Resume with the next deferred node the ray can still reach
+           before the closest hit found so far. */
+        while (stack_size > 0 && stack_t[stack_size-1] > t_max)
+            stack_size--;
+        if (stack_size == 0)
+            break;
+        node_index = stack[--stack_size];
+    }
+
+    PROFILE_COMMIT(tally);
+    return hit_anything;
+}
+
+#endif
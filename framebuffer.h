@@ -0,0 +1,64 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <cstdint>
+#include <vector>
+#include "color.h"
+#include "tone-map.h"
+#include "util.h"
+
+/*
+   An image held in memory while it is rendered, as an accumulation
+   buffer: the linear sum of the samples taken in each pixel and how
+   many there were. Nothing is clamped or gamma corrected until the
+   image is written through a tone_map, so the buffer can be saved
+   (see image-io.h) and regraded later. Rows run from the top of the
+   image.
+
+   Sums are kept in double precision, so a saved buffer reproduces the
+   render exactly.
+*/
+class framebuffer {
+public:
+    framebuffer() : width(0), height(0) {}
+    framebuffer(int w, int h)
+        : width(w), height(h), pixels(static_cast<size_t>(w) * h),
+          samples(static_cast<size_t>(w) * h, 0) {}
+
+    color& at(int x, int y) {
+        return pixels[static_cast<size_t>(y) * width + x];
+    }
+    const color& at(int x, int y) const {
+        return pixels[static_cast<size_t>(y) * width + x];
+    }
+
+    uint32_t sample_count(int x, int y) const {
+        return samples[static_cast<size_t>(y) * width + x];
+    }
+
+    /* Adds COUNT samples adding up to SUM to pixel (X, Y). */
+    void add(int x, int y, const color& sum, uint32_t count) {
+        at(x, y) += sum;
+        samples[static_cast<size_t>(y) * width + x] += count;
+    }
+
+    /* Returns the mean of the samples in pixel (X, Y). */
+    color average(int x, int y) const {
+        auto count = sample_count(x, y);
+        return count ? at(x, y) * (1.0 / count) : color(0, 0, 0);
+    }
+
+    /* Returns pixel (X, Y) as 8-bit RGB in RGB, tone mapped by TONE.
+       The default is the gamma 2 curve write_color() prints. */
+    void rgb8(int x, int y, unsigned char rgb[3],
+              const tone_map& tone = tone_map()) const {
+        tone.apply(at(x, y), sample_count(x, y), rgb);
+    }
+
+public:
+    int width, height;
+    std::vector<color> pixels;      /* Sums of samples, row by row from the top. */
+    std::vector<uint32_t> samples;  /* Samples taken in each pixel. */
+};
+
+#endif
@@ -30,19 +30,18 @@ public:
 
 /* Determines the closest point of intersection between a ray R and
    a list of objects, subject to the valid hit interval T_MIN to
-   T_MAX. Information about the point of closest intersection (if
-   any) is stored in REC. */
+   T_MAX. The closest intersection (if any) is stored in REC. Objects
+   only write REC when they report a closer hit, so no temporary
+   record is needed. */
 bool hittable_list::hit(const ray& r, double t_min, double t_max,
                         hit_record& rec) const {
-    hit_record temp_rec;
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
     for (const auto& object : objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+        if (object->hit(r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
 
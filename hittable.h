@@ -2,14 +2,27 @@
 #define HITTABLE_H
 
 #include "aabb.h"
+#include "affine.h"
 #include "util.h"
 
 /* Reference to the material class to avoid circular references since
    hittable objects and materials need to know about each other. */
 class material;
+class hittable;
 
 /* A hit record contains information about the point of intersection
-   between a ray and an object. */
+   between a ray and an object.
+
+   Intersection happens in two phases. hittable::hit only finds the
+   closest hit, recording T, the object OBJ that was hit and (for
+   objects made of many primitives) the primitive index PRIM. Once the
+   closest hit is known, finalize() fills in the remaining surface
+   information, so that normals, texture coordinates and materials
+   are computed for one hit per ray instead of for every candidate.
+
+   MAT_PTR does not own the material. Materials are owned by the
+   objects of the scene, which outlive every ray traced through it,
+   so hits never touch a reference count. */
 struct hit_record {
     point3 p;                      /* The point of intersection. */
     vec3 normal;                   /* The surface normal at P. */
@@ -17,18 +30,67 @@ struct hit_record {
     double u;                      /* U coordinate for texture lookups. */
     double v;                      /* V coordinate for texture lookups. */
     bool front_face;               /* True if ray outside, false if inside. */
-    shared_ptr<material> mat_ptr;  /* Reference to object material type. */
+    const material* mat_ptr;       /* Object material (owned by the scene). */
+    texture_footprint footprint;   /* Pixel footprint in texture space. */
+
+    const hittable* obj;           /* Outermost object reporting the hit. */
+    int prim;                      /* Primitive index within the object. */
+
+    /* Objects wrapped by transforms (e.g. translate) are recorded
+       innermost first, while OBJ holds the outermost transform.
+       Transforms nested deeper than MAX_NESTING complete the surface
+       of what they wrap at once instead (see transformed::hit). */
+    static const int max_nesting = 4;
+    const hittable* inner[max_nesting];
+    int nesting;
+
+    /* Records a hit at distance T on primitive PRIM of object O. */
+    inline void set_hit(double _t, const hittable* o, int _prim = 0) {
+        t = _t;
+        obj = o;
+        prim = _prim;
+        nesting = 0;
+    }
+
+    /* Records that transform O wraps the object hit so far. Returns
+       false, recording nothing, if transforms are nested too deeply. */
+    inline bool push(const hittable* o) {
+        if (nesting == max_nesting)
+            return false;
+        inner[nesting++] = obj;
+        obj = o;
+        return true;
+    }
+
+    /* Removes and returns the object wrapped by the current one. */
+    inline const hittable* pop() {
+        return inner[--nesting];
+    }
 
     /* Sets OUTWARD_NORMAL based on direction of ray R. */
     inline void set_face_normal(const ray& r, const vec3& outward_normal) {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    /* Sets FOOTPRINT from the differentials of ray R, given the
+       partial derivatives DPDU and DPDV of the surface point with
+       respect to the texture coordinates. Call after P and NORMAL
+       are set. */
+    inline void set_footprint(const ray& r, const vec3& dpdu, const vec3& dpdv);
+
+    /* Fills in the surface information for the hit of ray R. */
+    inline void finalize(const ray& r);
 };
 
 /*
    An abstract class for anything enclosed in a bounding box that a
    ray might intersect with or hit (hence "hittable").
+
+   hit() must only write REC when it reports a hit, and then at least
+   through set_hit(). get_surface() completes the record for a hit
+   previously reported on this object; objects whose hit() already
+   fills in the whole record need not override it.
 */
 class hittable {
 public:
@@ -36,80 +98,107 @@ public:
                      hit_record& rec) const = 0;            
     virtual bool bounding_box(double time0, double time1,
                               aabb& output_box) const = 0;
+    virtual void get_surface(const ray& r, hit_record& rec) const {}
 };
 
+/* Intersects the offset rays of R with the tangent plane at P, then
+   solves for the texture coordinate derivatives in the least-squares
+   sense (Igehy 1999; Pharr et al., Physically Based Rendering). */
+void hit_record::set_footprint(const ray& r, const vec3& dpdu,
+                               const vec3& dpdv) {
+    footprint = texture_footprint();
+    if (!r.has_differentials)
+        return;
+
+    auto plane = dot(normal, p);
+    auto dx_dot = dot(normal, r.rx_direction);
+    auto dy_dot = dot(normal, r.ry_direction);
+    if (dx_dot == 0 || dy_dot == 0)
+        return;
+
+    auto tx = (plane - dot(normal, r.rx_origin)) / dx_dot;
+    auto ty = (plane - dot(normal, r.ry_origin)) / dy_dot;
+    vec3 dpdx = r.rx_origin + tx*r.rx_direction - p;
+    vec3 dpdy = r.ry_origin + ty*r.ry_direction - p;
+
+    auto a00 = dot(dpdu, dpdu), a01 = dot(dpdu, dpdv), a11 = dot(dpdv, dpdv);
+    auto det = a00*a11 - a01*a01;
+    if (fabs(det) < 1e-12 * a00 * a11)
+        return;
+
+    auto inv_det = 1.0 / det;
+    auto bx0 = dot(dpdu, dpdx), bx1 = dot(dpdv, dpdx);
+    auto by0 = dot(dpdu, dpdy), by1 = dot(dpdv, dpdy);
+    footprint.dudx = (a11*bx0 - a01*bx1) * inv_det;
+    footprint.dvdx = (a00*bx1 - a01*bx0) * inv_det;
+    footprint.dudy = (a11*by0 - a01*by1) * inv_det;
+    footprint.dvdy = (a00*by1 - a01*by0) * inv_det;
+}
+
+void hit_record::finalize(const ray& r) {
+    obj->get_surface(r, *this);
+}
+
 /*
-   A class for translated objects, implemented by shifting the
-   incident rays relative to the object.
+   Stands in for an object whose surface has already been filled into
+   the hit record, so there is nothing left to complete.
 */
-class translate : public hittable {
+class resolved_surface : public hittable {
 public:
-    translate(shared_ptr<hittable> p, const vec3& displacement)
-        : ptr(p), offset(displacement) {}
-
     virtual bool hit(const ray& r, double t_min, double t_max,
-                     hit_record& rec) const override;
-    virtual bool bounding_box(double time0, double time1,
-                              aabb& output_box) const override;
-   
-public:
-    shared_ptr<hittable> ptr;
-    vec3 offset;
-};
-
-/* Compute ray-object intersection with a ray shifted by offset in
-   the opposite direction, then add it back in the hit record. */
-bool translate::hit(const ray& r, double t_min, double t_max,
-                    hit_record& rec) const {
-    ray moved_r(r.origin() - offset, r.direction(), r.time());
-    if (!ptr->hit(moved_r, t_min, t_max, rec))
+                     hit_record& rec) const override {
         return false;
-
-    rec.p += offset;
-    rec.set_face_normal(moved_r, rec.normal);
-
-    return true;
-}
-
-/* Construct the bounding box around the original object and then
-   apply the offset. */
-bool translate::bounding_box(double time0, double time1,
-                             aabb& output_box) const {
-    if (!ptr->bounding_box(time0, time1, output_box))
+    }
+    virtual bool bounding_box(double time0, double time1,
+                              aabb& output_box) const override {
         return false;
+    }
 
-    output_box = aabb(output_box.min() + offset, output_box.max() + offset);
-    
-    return true;
-}
+    static const resolved_surface* instance() {
+        static const resolved_surface surface;
+        return &surface;
+    }
+};
 
 /*
-   a class for objects rotated counter-clockwise about Y.
+   A class for objects placed in the scene by an affine transform,
+   implemented by transforming the incident rays into the object's
+   frame. The inverse and normal matrices are precomputed, so a hit
+   costs the same however the transform was built up.
 */
-class rotate_y : public hittable {
+class transformed : public hittable {
 public:
-    rotate_y(shared_ptr<hittable> p, double angle);
+    transformed(shared_ptr<hittable> p, const affine& object_to_world);
 
     virtual bool hit(const ray& r, double t_min, double t_max,
                      hit_record& rec) const override;
     virtual bool bounding_box(double time0, double time1,
                               aabb& output_box) const override {
-    output_box = bbox;
-    return hasbox;
+        output_box = bbox;
+        return hasbox;
+    }
+    virtual void get_surface(const ray& r, hit_record& rec) const override;
+
+    /* Returns ray R in the object's frame. Directions are not
+       normalized, so distances T along both rays agree. */
+    ray to_object(const ray& r) const {
+        return world_to_object.transform(r);
     }
 
 public:
-    shared_ptr<hittable> ptr;
-    double sin_theta;
-    double cos_theta;
+    shared_ptr<hittable> ptr;  /* The transformed object. */
+    affine object_to_world;    /* Maps the object into the scene. */
+    affine world_to_object;    /* Inverse of OBJECT_TO_WORLD. */
+    affine normal_to_world;    /* Maps object normals into the scene. */
     bool hasbox;
     aabb bbox;
 };
 
-rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p) {
-    auto radians = degrees_to_radians(angle);
-    sin_theta = sin(radians);
-    cos_theta = cos(radians);
+/* Precomputes the inverse and normal matrices, and bounds the object
+   by transforming the eight corners of its own bounding box. */
+transformed::transformed(shared_ptr<hittable> p, const affine& m)
+    : ptr(p), object_to_world(m), world_to_object(m.inverse()),
+      normal_to_world(m.normal_matrix()) {
     hasbox = ptr->bounding_box(0, 1, bbox);
 
     point3 min(infinity, infinity, infinity);
@@ -122,10 +211,7 @@ rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p) {
                 auto y = j*bbox.max().y() + (1-j)*bbox.min().y();
                 auto z = k*bbox.max().z() + (1-k)*bbox.min().z();
 
-                auto newx = cos_theta*x + sin_theta*z;
-                auto newz = -sin_theta*x + cos_theta*z;
-
-                vec3 tester(newx, y, newz);
+                vec3 tester = object_to_world.point(point3(x, y, z));
 
                 for (int c = 0; c < 3; c++) {
                     min[c] = fmin(min[c], tester[c]);
@@ -138,35 +224,80 @@ rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p) {
     bbox = aabb(min, max);
 }
 
-bool rotate_y::hit(const ray& r, double t_min, double t_max,
-                   hit_record& rec) const {
-    auto origin = r.origin();
-    auto direction = r.direction();
+/* Compute ray-object intersection with the ray in the object's
+   frame. The distance T is unchanged by the transform. If transforms
+   nest too deeply to defer the surface, it is completed now and
+   mapped into the scene, and the wrapped objects are replaced by a
+   resolved_surface. */
+bool transformed::hit(const ray& r, double t_min, double t_max,
+                      hit_record& rec) const {
+    hit_record temp_rec = rec;
+    if (!ptr->hit(to_object(r), t_min, t_max, temp_rec))
+        return false;
+
+    if (!temp_rec.push(this)) {
+        temp_rec.finalize(to_object(r));
+        temp_rec.p = object_to_world.point(temp_rec.p);
+        auto outward_normal = temp_rec.front_face ? temp_rec.normal
+                                                  : -temp_rec.normal;
+        temp_rec.set_face_normal(
+            r, unit_vector(normal_to_world.vector(outward_normal)));
+        temp_rec.set_hit(temp_rec.t, resolved_surface::instance(),
+                         temp_rec.prim);
+    }
 
-    origin[0] = cos_theta*r.origin()[0] - sin_theta*r.origin()[2];
-    origin[2] = sin_theta*r.origin()[0] + cos_theta*r.origin()[2];
+    rec = temp_rec;
+    return true;
+}
 
-    direction[0] = cos_theta*r.direction()[0] - sin_theta*r.direction()[2];
-    direction[2] = sin_theta*r.direction()[0] + cos_theta*r.direction()[2];
+/* Complete the hit of the wrapped object with the ray in its frame,
+   then map the point and normal back into the scene. */
+void transformed::get_surface(const ray& r, hit_record& rec) const {
+    rec.pop()->get_surface(to_object(r), rec);
 
-    ray rotated_r(origin, direction, r.time());
+    rec.p = object_to_world.point(rec.p);
+    auto outward_normal = rec.front_face ? rec.normal : -rec.normal;
+    rec.set_face_normal(r, unit_vector(normal_to_world.vector(outward_normal)));
+}
 
-    if (!ptr->hit(rotated_r, t_min, t_max, rec))
-        return false;
+/*
+   Convenience classes for single transforms. Each is a transformed
+   object, so collapse_transforms() can fold chains of them into one.
+*/
 
-    auto p = rec.p;
-    auto normal = rec.normal;
+/* An object translated by DISPLACEMENT. */
+class translate : public transformed {
+public:
+    translate(shared_ptr<hittable> p, const vec3& displacement)
+        : transformed(p, affine::translation(displacement)) {}
+};
 
-    p[0] = cos_theta*rec.p[0] + sin_theta*rec.p[2];
-    p[2] = -sin_theta*rec.p[0] + cos_theta*rec.p[2];
+/* An object rotated counter-clockwise about X by ANGLE degrees. */
+class rotate_x : public transformed {
+public:
+    rotate_x(shared_ptr<hittable> p, double angle)
+        : transformed(p, affine::rotation_x(angle)) {}
+};
 
-    normal[0] = cos_theta*rec.normal[0] + sin_theta*rec.normal[2];
-    normal[2] = -sin_theta*rec.normal[0] + cos_theta*rec.normal[2];
+/* An object rotated counter-clockwise about Y by ANGLE degrees. */
+class rotate_y : public transformed {
+public:
+    rotate_y(shared_ptr<hittable> p, double angle)
+        : transformed(p, affine::rotation_y(angle)) {}
+};
 
-    rec.p = p;
-    rec.set_face_normal(rotated_r, normal);
+/* An object rotated counter-clockwise about Z by ANGLE degrees. */
+class rotate_z : public transformed {
+public:
+    rotate_z(shared_ptr<hittable> p, double angle)
+        : transformed(p, affine::rotation_z(angle)) {}
+};
 
-    return true;
-}
+/* An object scaled by FACTORS along each axis about the origin. */
+class scale : public transformed {
+public:
+    scale(shared_ptr<hittable> p, const vec3& factors)
+        : transformed(p, affine::scaling(factors)) {}
+};
 
 #endif
@@ -0,0 +1,310 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "framebuffer.h"
+#include "profile.h"
+#include "rtw_stb_image_write.h"
+#include "tone-map.h"
+
+/*
+   Writing of rendered images. The format follows the extension of
+   the output path:
+
+       .ppm     binary PPM (P6), 8-bit tone-mapped RGB
+       .pfm     PFM, mean linear radiance as 32-bit float RGB
+       .png     PNG, 8-bit tone-mapped RGB
+       .rtacc   the accumulation buffer itself (see below)
+
+   The path "-" writes a binary PPM to standard output. 8-bit pixels go
+   through a tone_map, by default the one whose values write_color()
+   prints, and PFM pixels are scaled by its exposure.
+*/
+
+enum image_format { format_ppm, format_pfm, format_png, format_accumulation };
+
+/* Returns the format written for PATH (PPM if its extension is not
+   known). */
+inline image_format image_format_for(const std::string& path) {
+    auto ends_with = [&](const char* suffix) {
+        auto n = strlen(suffix);
+        return path.size() >= n && path.compare(path.size() - n, n, suffix) == 0;
+    };
+    if (ends_with(".pfm"))
+        return format_pfm;
+    if (ends_with(".png"))
+        return format_png;
+    if (ends_with(".rtacc"))
+        return format_accumulation;
+    return format_ppm;
+}
+
+/* Returns the pixels of IMAGE as 8-bit RGB tone mapped by TONE, row
+   by row from the top. */
+inline std::vector<unsigned char> image_rgb8(const framebuffer& image,
+                                             const tone_map& tone) {
+    std::vector<unsigned char> rgb(3 * static_cast<size_t>(image.width)
+                                   * image.height);
+    for (int y = 0; y < image.height; y++)
+        for (int x = 0; x < image.width; x++)
+            image.rgb8(x, y, &rgb[3 * (static_cast<size_t>(y) * image.width + x)],
+                       tone);
+    return rgb;
+}
+
+/* Writes IMAGE to F as a binary PPM. */
+bool write_ppm(const framebuffer& image, FILE* f, const tone_map& tone) {
+    auto rgb = image_rgb8(image, tone);
+    return fprintf(f, "P6\n%d %d\n255\n", image.width, image.height) > 0
+        && fwrite(rgb.data(), 1, rgb.size(), f) == rgb.size();
+}
+
+/* Writes IMAGE to F as a PFM, whose rows run from the bottom and
+   whose negative scale marks little-endian floats. */
+bool write_pfm(const framebuffer& image, FILE* f, const tone_map& tone) {
+    if (fprintf(f, "PF\n%d %d\n-1.0\n", image.width, image.height) <= 0)
+        return false;
+
+    auto scale = exp2(tone.exposure);
+    std::vector<float> row(3 * static_cast<size_t>(image.width));
+    for (int y = image.height-1; y >= 0; y--) {
+        for (int x = 0; x < image.width; x++) {
+            color c = scale * image.average(x, y);
+            for (int i = 0; i < 3; i++)
+                row[3*x + i] = static_cast<float>(c[i]);
+        }
+        if (fwrite(row.data(), sizeof(float), row.size(), f) != row.size())
+            return false;
+    }
+    return true;
+}
+
+#ifdef RTW_HAVE_STB_IMAGE_WRITE
+
+/* Writes IMAGE to F as a PNG, encoded by stb_image_write. */
+bool write_png(const framebuffer& image, FILE* f, const tone_map& tone) {
+    auto rgb = image_rgb8(image, tone);
+    struct sink {
+        FILE* f;
+        bool ok;
+    } out = { f, true };
+    auto write = [](void* context, void* data, int size) {
+        auto s = static_cast<sink*>(context);
+        s->ok = s->ok && fwrite(data, 1, size, s->f) == static_cast<size_t>(size);
+    };
+    return stbi_write_png_to_func(write, &out, image.width, image.height, 3,
+                                  rgb.data(), 3 * image.width) != 0
+        && out.ok;
+}
+
+#else
+
+/* Writes IMAGE to F as a PNG whose image data is stored in
+   uncompressed deflate blocks, for builds without stb_image_write.
+   The file is about as large as a P6, but any PNG reader opens it. */
+bool write_png(const framebuffer& image, FILE* f, const tone_map& tone) {
+    auto rgb = image_rgb8(image, tone);
+    size_t row_bytes = 3 * static_cast<size_t>(image.width);
+
+    /* Each row is preceded by filter type 0 (none). */
+    std::vector<uint8_t> raw;
+    raw.reserve((row_bytes + 1) * image.height);
+    for (int y = 0; y < image.height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * row_bytes,
+                   rgb.begin() + (y + 1) * row_bytes);
+    }
+
+    /* A zlib stream of stored blocks, ending in the Adler-32 of RAW. */
+    std::vector<uint8_t> z = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    size_t pos = 0;
+    do {
+        size_t n = std::min<size_t>(raw.size() - pos, 65535);
+        bool last = pos + n == raw.size();
+        z.push_back(last ? 1 : 0);
+        z.push_back(n & 0xff);
+        z.push_back(n >> 8);
+        z.push_back(~n & 0xff);
+        z.push_back((~n >> 8) & 0xff);
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+        pos += n;
+    } while (pos < raw.size());
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8)
+        z.push_back((adler >> shift) & 0xff);
+
+    static const auto crc_table = [] {
+        std::array<uint32_t, 256> table;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }();
+
+    /* Writes a chunk of TYPE holding DATA, as length, type, data and
+       the CRC of type and data. */
+    auto chunk = [&](const char* type, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> c;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            c.push_back((data.size() >> shift) & 0xff);
+        c.insert(c.end(), type, type + 4);
+        c.insert(c.end(), data.begin(), data.end());
+        uint32_t crc = 0xffffffff;
+        for (size_t i = 4; i < c.size(); i++)
+            crc = crc_table[(crc ^ c[i]) & 0xff] ^ (crc >> 8);
+        crc ^= 0xffffffff;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            c.push_back((crc >> shift) & 0xff);
+        return fwrite(c.data(), 1, c.size(), f) == c.size();
+    };
+
+    std::vector<uint8_t> header;
+    for (uint32_t v : { static_cast<uint32_t>(image.width),
+                        static_cast<uint32_t>(image.height) })
+        for (int shift = 24; shift >= 0; shift -= 8)
+            header.push_back((v >> shift) & 0xff);
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });  /* 8-bit RGB. */
+
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    return fwrite(signature, 1, 8, f) == 8
+        && chunk("IHDR", header)
+        && chunk("IDAT", z)
+        && chunk("IEND", {});
+}
+
+#endif
+
+/*
+   Accumulation buffer file layout (little-endian), which holds a
+   framebuffer exactly as rendered, before any tone mapping:
+       accumulation_file_header
+       double sums[height][width][3]    at sums_offset
+       uint32_t samples[height][width]  at samples_offset
+   Rows run from the top of the image, and offsets are from the start
+   of the header (which may be embedded in a larger file).
+*/
+
+const char accumulation_file_magic[8] = { 'R', 'T', 'A', 'C', 'C', 0, 0, 0 };
+const uint32_t accumulation_file_version = 1;
+
+struct accumulation_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t reserved;
+    uint64_t sums_offset;
+    uint64_t samples_offset;
+};
+
+/* Writes the accumulation buffer IMAGE to F. */
+bool write_accumulation(const framebuffer& image, FILE* f) {
+    accumulation_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, accumulation_file_magic, sizeof(h.magic));
+    h.version = accumulation_file_version;
+    h.width = image.width;
+    h.height = image.height;
+    h.sums_offset = sizeof(h);
+    h.samples_offset = h.sums_offset + image.pixels.size() * sizeof(color);
+
+    return fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(image.pixels.data(), sizeof(color), image.pixels.size(), f)
+           == image.pixels.size()
+        && fwrite(image.samples.data(), sizeof(uint32_t), image.samples.size(), f)
+           == image.samples.size();
+}
+
+/* Reads an accumulation buffer starting at the current position of F
+   into IMAGE. The size and offsets in the header are checked against
+   the length of F before anything is allocated. Returns false if it
+   is malformed. */
+bool read_accumulation(FILE* f, framebuffer& image) {
+    static_assert(sizeof(color) == 3 * sizeof(double),
+                  "colors are stored as three doubles");
+
+    long start = ftell(f);
+    accumulation_file_header h;
+    if (start < 0 || fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, accumulation_file_magic, sizeof(h.magic)) != 0 ||
+        h.version != accumulation_file_version ||
+        h.width == 0 || h.height == 0 ||
+        h.width > INT_MAX || h.height > INT_MAX)
+        return false;
+
+    if (fseek(f, 0, SEEK_END) != 0)
+        return false;
+    long end = ftell(f);
+    if (end < start)
+        return false;
+    uint64_t length = static_cast<uint64_t>(end - start);
+
+    /* The pixel count is bounded by the file before it is multiplied. */
+    uint64_t pixels = uint64_t(h.width) * h.height;
+    if (pixels > length / sizeof(color) ||
+        h.sums_offset > length ||
+        pixels * sizeof(color) > length - h.sums_offset ||
+        h.samples_offset > length ||
+        pixels * sizeof(uint32_t) > length - h.samples_offset)
+        return false;
+
+    image = framebuffer(static_cast<int>(h.width), static_cast<int>(h.height));
+    return fseek(f, start + static_cast<long>(h.sums_offset), SEEK_SET) == 0
+        && fread(image.pixels.data(), sizeof(color), image.pixels.size(), f)
+           == image.pixels.size()
+        && fseek(f, start + static_cast<long>(h.samples_offset), SEEK_SET) == 0
+        && fread(image.samples.data(), sizeof(uint32_t), image.samples.size(), f)
+           == image.samples.size();
+}
+
+/* Reads the accumulation buffer file at PATH into IMAGE. Returns false
+   if the file is missing or malformed. */
+bool load_accumulation(const std::string& path, framebuffer& image) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+
+    bool ok = read_accumulation(f, image);
+    fclose(f);
+    return ok;
+}
+
+/* Writes IMAGE to PATH in the format of its extension (see above),
+   tone mapped by TONE. Returns false if the file could not be
+   written. */
+bool write_image(const framebuffer& image, const std::string& path,
+                 const tone_map& tone = tone_map()) {
+    PROFILE_SCOPE(stage_output);
+    bool to_stdout = path == "-";
+    FILE* f = to_stdout ? stdout : fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool ok;
+    switch (to_stdout ? format_ppm : image_format_for(path)) {
+        case format_pfm:          ok = write_pfm(image, f, tone); break;
+        case format_png:          ok = write_png(image, f, tone); break;
+        case format_accumulation: ok = write_accumulation(image, f); break;
+        default:                  ok = write_ppm(image, f, tone); break;
+    }
+
+    if (to_stdout)
+        return fflush(f) == 0 && ok;
+    return fclose(f) == 0 && ok;
+}
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef IMAGE_STREAM_H
+#define IMAGE_STREAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "framebuffer.h"
+
+/*
+   A binary PPM (P6) file written tile by tile as a render progresses,
+   for images too large to keep in memory whole. The file is created at
+   its full size and mapped, and each finished tile is copied straight
+   into the mapping, so only the tiles being rendered are held in
+   framebuffers.
+
+   The file is a valid image at every moment. Regions not rendered yet
+   show a magenta and black checkerboard, and the header carries a
+   comment of fixed width counting the finished tiles, e.g.
+
+       P6
+       # tiles 0000042 of 0000960
+       16384 9216
+       255
+
+   so other programs can watch the render fill in. Tiles may be
+   written from several threads at once.
+*/
+class streamed_image {
+public:
+    streamed_image() : base(nullptr), length(0), pixels_offset(0),
+                       width(0), height(0), tile_count(0), tiles_done(0) {}
+    ~streamed_image() { close(); }
+
+    streamed_image(const streamed_image&) = delete;
+    streamed_image& operator=(const streamed_image&) = delete;
+
+    /* Creates the file at PATH for a WIDTH x HEIGHT image rendered in
+       TILE_COUNT tiles, with every pixel marked unfinished. Returns
+       false if the file cannot be created or mapped. */
+    bool create(const std::string& path, int width, int height,
+                int tile_count);
+
+    /* Copies TILE, whose top left pixel is (X0, Y0) in the image, into
+       the file and counts it as finished. */
+    void write_tile(const framebuffer& tile, int x0, int y0);
+
+    /* Schedules rows [Y0, Y1) to be written back and drops their pages
+       from this process, once no tile in progress covers them. */
+    void release_rows(int y0, int y1);
+
+    /* Writes everything back and unmaps the file. Returns false if
+       the file could not be written. */
+    bool close();
+
+    bool is_open() const { return base != nullptr; }
+
+private:
+    static const int marker_size = 8;  /* Squares of the unfinished mark. */
+
+    unsigned char* pixel(int x, int y) {
+        return static_cast<unsigned char*>(base) + pixels_offset
+               + 3 * (static_cast<size_t>(y) * width + x);
+    }
+
+    void write_progress();
+
+    /* Calls madvise/msync on the whole pages covering bytes [FROM, TO). */
+    void release_bytes(size_t from, size_t to);
+
+    void* base;
+    size_t length;
+    size_t pixels_offset;
+    size_t progress_offset;  /* Digits of the finished tile count. */
+    int width, height;
+    int tile_count;
+    std::atomic<int> tiles_done;
+    std::mutex progress_mutex;
+};
+
+bool streamed_image::create(const std::string& path, int _width, int _height,
+                            int _tile_count) {
+    close();
+    width = _width;
+    height = _height;
+    tile_count = _tile_count;
+    tiles_done = 0;
+
+    char header[96];
+    int prefix = snprintf(header, sizeof(header), "P6\n# tiles ");
+    progress_offset = prefix;
+    int header_size = snprintf(header + prefix, sizeof(header) - prefix,
+                               "0000000 of %07d\n%d %d\n255\n", tile_count,
+                               width, height) + prefix;
+    pixels_offset = header_size;
+    length = pixels_offset + 3 * static_cast<size_t>(width) * height;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    /* The mapping stays valid after the descriptor is closed. */
+    void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    base = p;
+
+    memcpy(base, header, header_size);
+
+    /* Mark every pixel unfinished, releasing the rows as they are
+       filled so the mark never holds the whole image in memory. */
+    const int band = 64;
+    for (int y0 = 0; y0 < height; y0 += band) {
+        int y1 = std::min(y0 + band, height);
+        for (int y = y0; y < y1; y++) {
+            for (int x = 0; x < width; x++) {
+                unsigned char* px = pixel(x, y);
+                bool odd = (x / marker_size + y / marker_size) & 1;
+                px[0] = odd ? 0 : 255;
+                px[1] = 0;
+                px[2] = odd ? 0 : 255;
+            }
+        }
+        release_rows(y0, y1);
+    }
+    return true;
+}
+
+void streamed_image::write_tile(const framebuffer& tile, int x0, int y0) {
+    for (int y = 0; y < tile.height; y++)
+        for (int x = 0; x < tile.width; x++)
+            tile.rgb8(x, y, pixel(x0 + x, y0 + y));
+
+    tiles_done++;
+    write_progress();
+}
+
+/* Writes the count of finished tiles into the header, in place. */
+void streamed_image::write_progress() {
+    std::lock_guard<std::mutex> lock(progress_mutex);
+    char digits[16];
+    snprintf(digits, sizeof(digits), "%07d", tiles_done.load());
+    memcpy(static_cast<unsigned char*>(base) + progress_offset, digits, 7);
+}
+
+void streamed_image::release_rows(int y0, int y1) {
+    release_bytes(pixels_offset + 3 * static_cast<size_t>(y0) * width,
+                  pixels_offset + 3 * static_cast<size_t>(y1) * width);
+}
+
+void streamed_image::release_bytes(size_t from, size_t to) {
+    /* Only whole pages can be released, so pages shared with rows
+       outside the range are kept. */
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t first = (from + page - 1) / page * page;
+    size_t last = to / page * page;
+    if (to == length)
+        last = (to + page - 1) / page * page;
+    if (first >= last)
+        return;
+
+    auto start = static_cast<unsigned char*>(base) + first;
+    msync(start, last - first, MS_ASYNC);
+    madvise(start, last - first, MADV_DONTNEED);
+}
+
+bool streamed_image::close() {
+    if (!base)
+        return true;
+    bool ok = msync(base, length, MS_SYNC) == 0;
+    munmap(base, length);
+    base = nullptr;
+    length = 0;
+    return ok;
+}
+
+#endif
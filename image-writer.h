@@ -0,0 +1,112 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include "framebuffer.h"
+#include "image-io.h"
+#include "util.h"
+
+/*
+   A stage that writes finished images on its own thread, so encoding
+   and file output overlap rendering of the next frame or pass.
+   Images are queued with submit() and written in order; the images
+   must not change once submitted.
+*/
+class image_writer {
+public:
+    image_writer() : failures(0), busy(false), stopping(false) {
+        worker = std::thread([this]() { run(); });
+    }
+
+    ~image_writer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    image_writer(const image_writer&) = delete;
+    image_writer& operator=(const image_writer&) = delete;
+
+    /* Queues IMAGE to be written to PATH, tone mapped by TONE (see
+       write_image()), and returns at once. */
+    void submit(shared_ptr<const framebuffer> image, const std::string& path,
+                const tone_map& tone = tone_map()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(job{std::move(image), path, tone});
+        }
+        wake.notify_all();
+    }
+
+    /* Returns the number of images queued or being written. */
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size() + (busy ? 1 : 0);
+    }
+
+    /* Waits until every queued image is written. Returns false if any
+       image could not be written since the last wait. */
+    bool wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return queue.empty() && !busy; });
+        bool ok = failures == 0;
+        failures = 0;
+        return ok;
+    }
+
+private:
+    struct job {
+        shared_ptr<const framebuffer> image;
+        std::string path;
+        tone_map tone;
+    };
+
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable wake;  /* Signals queued images or stopping. */
+    std::condition_variable idle;  /* Signals an empty queue. */
+    std::deque<job> queue;
+    int failures;
+    bool busy;      /* An image is being written. */
+    bool stopping;
+    std::thread worker;
+};
+
+/* Writes queued images until the writer is destroyed and the queue
+   is empty. */
+void image_writer::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty())
+            return;
+
+        job next = std::move(queue.front());
+        queue.pop_front();
+        busy = true;
+        lock.unlock();
+
+        bool ok = write_image(*next.image, next.path, next.tone);
+        if (!ok)
+            std::cerr << "ERROR: Could not write image '" << next.path
+                      << "'.\n";
+
+        lock.lock();
+        busy = false;
+        if (!ok)
+            failures++;
+        idle.notify_all();
+    }
+}
+
+#endif
@@ -0,0 +1,579 @@
+#ifndef INCREMENTAL_RENDER_H
+#define INCREMENTAL_RENDER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "camera.h"
+#include "compiled-scene.h"
+#include "framebuffer.h"
+#include "integrator.h"
+
+/*
+   Incremental re-rendering after an edit to the scene, for look
+   development. The image is rendered in tiles, and each tile keeps a
+   footprint of the space its rays went through: one bit per cell of
+   a coarse grid over the scene, set for every cell crossed by a
+   camera ray of the tile or any of its bounces, up to where it hit
+   or left the scene.
+
+   After an edit the changed primitives are found by comparing the
+   compiled scenes before and after it (see scene_changes()), and only
+   the tiles whose footprint meets the old or the new bounds of a
+   changed primitive are rendered again. Every sample has its own
+   random sequence (see trace_sample()), so a path that came nowhere
+   near the edit bounces exactly as it did before, and the image is
+   the one a full render of the edited scene gives, bit for bit.
+
+   The camera, background and render settings are fixed; a change to
+   any of them needs a full render().
+*/
+
+/*
+   A grid of at most RESOLUTION^3 cells over a box enclosing the
+   scene. The cell walls along each axis are placed at quantiles of
+   the faces of the primitives' boxes, so cells are small where the
+   objects are, and a huge ground plane or backdrop does not make
+   every cell huge. Sets of cells are bitsets of WORDS 64-bit words.
+*/
+class ray_grid {
+public:
+    static const int resolution = 32;
+    static const int words = resolution * resolution * resolution / 64;
+
+    ray_grid() {}
+    ray_grid(const std::vector<aabb>& boxes);
+
+    bool contains(const aabb& box) const {
+        for (int a = 0; a < 3; a++)
+            if (walls[a].empty() || box.min()[a] < walls[a].front() ||
+                box.max()[a] > walls[a].back())
+                return false;
+        return true;
+    }
+
+    /* Adds to CELLS every cell ray R crosses for T in [0, T_MAX]. */
+    void mark_ray(uint64_t* cells, const ray& r, double t_max) const;
+
+    /* Adds to CELLS every cell BOX overlaps. */
+    void mark_box(uint64_t* cells, const aabb& box) const;
+
+public:
+    std::vector<double> walls[3];  /* Increasing cell walls along each axis. */
+
+private:
+    /* Returns the cell along axis A holding coordinate X, clamped. */
+    int cell_of(int a, double x) const {
+        int cell = static_cast<int>(std::upper_bound(walls[a].begin(),
+                                                     walls[a].end(), x)
+                                    - walls[a].begin()) - 1;
+        return std::min(std::max(cell, 0), int(walls[a].size()) - 2);
+    }
+
+    static void mark(uint64_t* cells, int x, int y, int z) {
+        int index = (z * resolution + y) * resolution + x;
+        cells[index >> 6] |= uint64_t(1) << (index & 63);
+    }
+};
+
+/* The outer walls are padded slightly so surfaces on the faces of the
+   scene fall inside the grid, and so a flat scene still has cells of
+   non-zero size. Unbounded primitives are left outside the grid. */
+ray_grid::ray_grid(const std::vector<aabb>& boxes) {
+    if (boxes.empty())
+        return;
+
+    for (int a = 0; a < 3; a++) {
+        std::vector<double> faces;
+        for (const auto& box : boxes) {
+            if (std::isfinite(box.min()[a]) && std::isfinite(box.max()[a])) {
+                faces.push_back(box.min()[a]);
+                faces.push_back(box.max()[a]);
+            }
+        }
+        if (faces.empty()) {
+            for (int b = 0; b < 3; b++)
+                walls[b].clear();
+            return;
+        }
+        std::sort(faces.begin(), faces.end());
+
+        double pad = 1e-3 * (faces.back() - faces.front()) + 1e-3;
+        walls[a].push_back(faces.front() - pad);
+        for (int c = 1; c < resolution; c++) {
+            double wall = faces[c * faces.size() / resolution];
+            if (wall > walls[a].back())
+                walls[a].push_back(wall);
+        }
+        walls[a].push_back(faces.back() + pad);
+    }
+}
+
+/* Clips the ray to the grid, then steps from cell to cell along it
+   (after Amanatides and Woo), crossing one wall at a time. */
+void ray_grid::mark_ray(uint64_t* cells, const ray& r, double t_max) const {
+    if (walls[0].empty())
+        return;
+    const point3& o = r.origin();
+    const vec3& d = r.direction();
+
+    double t0 = 0, t1 = t_max;
+    for (int a = 0; a < 3; a++) {
+        double lo = walls[a].front(), hi = walls[a].back();
+        if (d[a] == 0) {
+            if (o[a] < lo || o[a] > hi)
+                return;
+            continue;
+        }
+        double ta = (lo - o[a]) / d[a];
+        double tb = (hi - o[a]) / d[a];
+        if (ta > tb)
+            std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+    }
+    if (t0 > t1)
+        return;
+
+    int cell[3], step[3];
+    double next[3];
+    point3 p = r.at(t0);
+    for (int a = 0; a < 3; a++) {
+        cell[a] = cell_of(a, p[a]);
+        step[a] = d[a] > 0 ? 1 : d[a] < 0 ? -1 : 0;
+        next[a] = step[a] == 0 ? infinity
+                : (walls[a][cell[a] + (step[a] > 0)] - o[a]) / d[a];
+    }
+
+    while (true) {
+        mark(cells, cell[0], cell[1], cell[2]);
+
+        int a = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2)
+                                  : (next[1] < next[2] ? 1 : 2);
+        if (next[a] > t1)
+            return;
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= int(walls[a].size()) - 1)
+            return;
+        next[a] = (walls[a][cell[a] + (step[a] > 0)] - o[a]) / d[a];
+    }
+}
+
+/* The box is grown by a little, so a ray grazing a wall the box
+   touches is never missed through rounding. */
+void ray_grid::mark_box(uint64_t* cells, const aabb& box) const {
+    if (walls[0].empty())
+        return;
+
+    int first[3], last[3];
+    for (int a = 0; a < 3; a++) {
+        double margin = 1e-9 * (walls[a].back() - walls[a].front());
+        first[a] = cell_of(a, box.min()[a] - margin);
+        last[a] = cell_of(a, box.max()[a] + margin);
+    }
+
+    for (int z = first[2]; z <= last[2]; z++)
+        for (int y = first[1]; y <= last[1]; y++)
+            for (int x = first[0]; x <= last[0]; x++)
+                mark(cells, x, y, z);
+}
+
+/* As ray_color() for compiled scenes, but adds the cells each ray
+   segment crosses to CELLS. The random sequence is used the same
+   way, so the color is the same. */
+color ray_color_marked(const ray& r, const color& background,
+                       const compiled_scene& scene, int depth,
+                       const ray_grid& grid, uint64_t* cells) {
+    flat_hit h;
+    hit_record rec;
+
+    if (depth <= 0)
+        return color(0, 0, 0);
+
+    if (!scene.hit(r, 0.001, infinity, h)) {
+        grid.mark_ray(cells, r, infinity);
+        return background;
+    }
+    grid.mark_ray(cells, r, h.t);
+    uint32_t mat = scene.get_surface(r, h, rec);
+
+    ray scattered;
+    color attenuation;
+    color emitted = scene.emitted(mat, rec);
+
+    if (!scene.scatter(mat, r, rec, attenuation, scattered))
+        return emitted;
+
+    return emitted + attenuation * ray_color_marked(scattered, background,
+                                                    scene, depth-1,
+                                                    grid, cells);
+}
+
+/*
+   Finding what an edit changed. Each top-level primitive of a scene
+   is described by a key holding its bounds and everything a ray can
+   see of it, down through its material and texture program; an
+   instance holds its transforms and the keys of its subtree. Keys
+   refer to nothing by index, so primitives match between two
+   compilations whatever order their BVHs put them in.
+
+   Noise, image and other textures and external primitives and
+   materials are compared by identity, like the texture program
+   merges them, so edits to them must replace the object rather than
+   modify it in place.
+*/
+namespace scene_diff {
+
+template <typename T>
+void append(std::string& key, const T& value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_texture(std::string& key, const compiled_scene& scene,
+                    uint32_t tex) {
+    const flat_texture& ft = scene.textures[tex];
+    append(key, ft.kind);
+    if (ft.kind == tex_solid)
+        append(key, ft.value);
+    else if (ft.kind == tex_checker) {
+        append_texture(key, scene, ft.even);
+        append_texture(key, scene, ft.odd);
+    }
+    else if (ft.kind == tex_image)
+        append(key, static_cast<const void*>(
+            static_cast<const image_texture*>(ft.ptr)->image.get()));
+    else
+        append(key, ft.ptr);
+}
+
+void append_material(std::string& key, const compiled_scene& scene,
+                     uint32_t mat) {
+    if (mat == no_material) {
+        append(key, mat);
+        return;
+    }
+
+    const flat_material& fm = scene.materials[mat];
+    append(key, fm.kind);
+    switch (fm.kind) {
+        case mat_lambertian:
+        case mat_diffuse_light:
+            append_texture(key, scene, fm.texture);
+            break;
+        case mat_metal:
+            append(key, fm.albedo);
+            append(key, fm.fuzz);
+            break;
+        case mat_dielectric:
+            append(key, fm.ir);
+            break;
+        default:
+            append(key, fm.ptr);
+            break;
+    }
+}
+
+/* Calls VISIT(P) for each primitive P in the leaves of the subtree at
+   NODE, without entering instances. */
+template <typename Visit>
+void for_each_leaf_prim(const compiled_scene& scene, uint32_t node,
+                        Visit visit) {
+    if (scene.nodes.empty())
+        return;
+
+    std::vector<uint32_t> stack(1, node);
+    while (!stack.empty()) {
+        const flat_node& n = scene.nodes[stack.back()];
+        uint32_t index = stack.back();
+        stack.pop_back();
+        if (n.count) {
+            for (uint32_t p = n.offset; p < n.offset + n.count; p++)
+                visit(p);
+        } else {
+            stack.push_back(n.offset);
+            stack.push_back(index + 1);
+        }
+    }
+}
+
+aabb node_box(const flat_node& n) {
+    return aabb(point3(n.bmin[0], n.bmin[1], n.bmin[2]),
+                point3(n.bmax[0], n.bmax[1], n.bmax[2]));
+}
+
+/* Returns the bounds of primitive P of SCENE in its own frame. */
+aabb prim_bounds(const compiled_scene& scene, uint32_t p) {
+    const flat_primitive& prim = scene.prims[p];
+    aabb box(point3(-infinity, -infinity, -infinity),
+             point3(infinity, infinity, infinity));
+
+    auto sphere_box = [](const double* c, double r) {
+        return aabb(point3(c[0] - r, c[1] - r, c[2] - r),
+                    point3(c[0] + r, c[1] + r, c[2] + r));
+    };
+    auto rect_box = [&](int a, int b, int k) {
+        point3 lo, hi;
+        lo[a] = prim.rect.a0; hi[a] = prim.rect.a1;
+        lo[b] = prim.rect.b0; hi[b] = prim.rect.b1;
+        lo[k] = hi[k] = prim.rect.k;
+        return aabb(lo, hi);
+    };
+
+    switch (prim.kind) {
+        case prim_sphere:
+            return sphere_box(prim.sph.center, prim.sph.radius);
+        case prim_moving_sphere:
+            return surrounding_box(
+                sphere_box(prim.msph.center0, prim.msph.radius),
+                sphere_box(prim.msph.center1, prim.msph.radius));
+        case prim_xy_rect:
+            return rect_box(0, 1, 2);
+        case prim_xz_rect:
+            return rect_box(0, 2, 1);
+        case prim_yz_rect:
+            return rect_box(1, 2, 0);
+        case prim_instance: {
+            const flat_instance& inst = scene.instances[prim.index];
+            aabb local = node_box(scene.nodes[inst.root]);
+            point3 lo(infinity, infinity, infinity);
+            point3 hi(-infinity, -infinity, -infinity);
+            for (int c = 0; c < 8; c++) {
+                point3 corner((c & 1 ? local.max() : local.min()).x(),
+                              (c & 2 ? local.max() : local.min()).y(),
+                              (c & 4 ? local.max() : local.min()).z());
+                point3 q = inst.object_to_world.point(corner);
+                for (int a = 0; a < 3; a++) {
+                    lo[a] = fmin(lo[a], q[a]);
+                    hi[a] = fmax(hi[a], q[a]);
+                }
+            }
+            return aabb(lo, hi);
+        }
+        default:
+            scene.externals[prim.index]->bounding_box(scene.time0,
+                                                      scene.time1, box);
+            return box;
+    }
+}
+
+void append_prim(std::string& key, const compiled_scene& scene, uint32_t p) {
+    const flat_primitive& prim = scene.prims[p];
+    append(key, prim.kind);
+    append(key, prim_bounds(scene, p));
+
+    switch (prim.kind) {
+        case prim_instance: {
+            const flat_instance& inst = scene.instances[prim.index];
+            append(key, inst.object_to_world);
+            for_each_leaf_prim(scene, inst.root, [&](uint32_t q) {
+                append_prim(key, scene, q);
+            });
+            return;
+        }
+        case prim_sphere:
+            append(key, prim.sph);
+            break;
+        case prim_moving_sphere:
+            append(key, prim.msph);
+            break;
+        case prim_external:
+            append(key, static_cast<const void*>(scene.externals[prim.index]));
+            break;
+        default:
+            append(key, prim.rect);
+            break;
+    }
+    append_material(key, scene, prim.material);
+}
+
+}
+
+/* Appends to CHANGED the bounds of the top-level primitives of BEFORE
+   that AFTER no longer has, and of those AFTER adds. A moved object
+   gives both its old and new bounds, and an object with a new
+   material its bounds. */
+void scene_changes(const compiled_scene& before, const compiled_scene& after,
+                   std::vector<aabb>& changed) {
+    struct entry {
+        int balance = 0;
+        std::vector<aabb> boxes;
+    };
+    std::map<std::string, entry> prims;
+
+    auto add = [&](const compiled_scene& scene, int sign) {
+        scene_diff::for_each_leaf_prim(scene, scene.root, [&](uint32_t p) {
+            std::string key;
+            scene_diff::append_prim(key, scene, p);
+            entry& e = prims[key];
+            e.balance += sign;
+            e.boxes.push_back(scene_diff::prim_bounds(scene, p));
+        });
+    };
+    add(before, 1);
+    add(after, -1);
+
+    for (const auto& p : prims)
+        if (p.second.balance != 0)
+            changed.insert(changed.end(), p.second.boxes.begin(),
+                           p.second.boxes.end());
+}
+
+/*
+   A render kept up to date through edits. The image holds the sums
+   of the samples of each pixel, like any other render (see
+   framebuffer.h). Small tiles keep the footprints tight, since the
+   more paths a tile has the more of the scene they reach, at 4 KB of
+   footprint per tile.
+*/
+class incremental_renderer {
+public:
+    incremental_renderer(const camera& cam, const color& background,
+                         int width, int height, int samples_per_pixel,
+                         int max_depth, uint64_t seed = 0, int threads = 0);
+
+    /* Renders every tile of SCENE and records their footprints. */
+    void render(const compiled_scene& scene);
+
+    /* Brings the image up to date with SCENE, the scene last rendered
+       with the objects in CHANGED moved, added, removed or given new
+       materials (see scene_changes()). Returns the number of tiles
+       rendered again. */
+    int update(const compiled_scene& scene, const std::vector<aabb>& changed);
+
+    /* As above, finding the changes from BEFORE, the scene last
+       rendered, to AFTER. */
+    int update(const compiled_scene& before, const compiled_scene& after) {
+        std::vector<aabb> changed;
+        scene_changes(before, after, changed);
+        return update(after, changed);
+    }
+
+    int tile_count() const { return tiles_x * tiles_y; }
+
+public:
+    static const int tile_size = 16;
+
+    framebuffer image;
+
+private:
+    void render_tiles(const compiled_scene& scene,
+                      const std::vector<int>& tiles);
+
+    camera cam;
+    color background;
+    int samples_per_pixel, max_depth;
+    uint64_t seed;
+    int threads;
+    int tiles_x, tiles_y;
+    ray_grid grid;
+    std::vector<uint64_t> footprints;  /* ray_grid::words per tile. */
+};
+
+incremental_renderer::incremental_renderer(
+    const camera& _cam, const color& _background, int width, int height,
+    int _samples_per_pixel, int _max_depth, uint64_t _seed, int _threads)
+    : image(width, height), cam(_cam), background(_background),
+      samples_per_pixel(_samples_per_pixel), max_depth(_max_depth),
+      seed(_seed), threads(_threads) {
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    tiles_x = (width + tile_size - 1) / tile_size;
+    tiles_y = (height + tile_size - 1) / tile_size;
+    footprints.assign(static_cast<size_t>(tile_count()) * ray_grid::words, 0);
+}
+
+void incremental_renderer::render(const compiled_scene& scene) {
+    std::vector<aabb> boxes;
+    scene_diff::for_each_leaf_prim(scene, scene.root, [&](uint32_t p) {
+        boxes.push_back(scene_diff::prim_bounds(scene, p));
+    });
+    grid = ray_grid(boxes);
+
+    std::vector<int> tiles(tile_count());
+    for (int t = 0; t < tile_count(); t++)
+        tiles[t] = t;
+    render_tiles(scene, tiles);
+}
+
+/* The footprints only cover the grid, so an object moved out of it
+   could be hit by rays that were not followed there; the whole image
+   is rendered again over a grid around the new scene. */
+int incremental_renderer::update(const compiled_scene& scene,
+                                 const std::vector<aabb>& changed) {
+    for (const auto& box : changed) {
+        if (!grid.contains(box)) {
+            render(scene);
+            return tile_count();
+        }
+    }
+
+    std::vector<uint64_t> touched(ray_grid::words, 0);
+    for (const auto& box : changed)
+        grid.mark_box(touched.data(), box);
+
+    std::vector<int> tiles;
+    for (int t = 0; t < tile_count(); t++) {
+        const uint64_t* cells = &footprints[size_t(t) * ray_grid::words];
+        for (int w = 0; w < ray_grid::words; w++) {
+            if (cells[w] & touched[w]) {
+                tiles.push_back(t);
+                break;
+            }
+        }
+    }
+
+    render_tiles(scene, tiles);
+    return static_cast<int>(tiles.size());
+}
+
+/* Renders TILES afresh, the workers taking the next tile in turn.
+   Each tile has its own pixels and footprint, so they share nothing
+   else. */
+void incremental_renderer::render_tiles(const compiled_scene& scene,
+                                        const std::vector<int>& tiles) {
+    std::atomic<size_t> next(0);
+    int width = image.width, height = image.height;
+
+    auto work = [&]() {
+        for (size_t n; (n = next++) < tiles.size(); ) {
+            int t = tiles[n];
+            uint64_t* cells = &footprints[size_t(t) * ray_grid::words];
+            std::fill(cells, cells + ray_grid::words, 0);
+
+            int x0 = (t % tiles_x) * tile_size, y0 = (t / tiles_x) * tile_size;
+            int x1 = std::min(x0 + tile_size, width);
+            int y1 = std::min(y0 + tile_size, height);
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    int j = height-1-y;
+                    color sum(0, 0, 0);
+                    for (int s = 0; s < samples_per_pixel; s++) {
+                        ray r = sample_ray(cam, width, height, seed, x, j, s);
+                        sum += ray_color_marked(r, background, scene,
+                                                max_depth, grid, cells);
+                    }
+                    size_t index = static_cast<size_t>(y) * width + x;
+                    image.pixels[index] = sum;
+                    image.samples[index] = samples_per_pixel;
+                }
+            }
+        }
+    };
+
+    int count = std::min<int>(threads, static_cast<int>(tiles.size()));
+    std::vector<std::thread> workers;
+    for (int w = 1; w < count; w++)
+        workers.emplace_back(work);
+    work();
+    for (auto& w : workers)
+        w.join();
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "camera.h"
+#include "compiled-scene.h"
+#include "hittable.h"
+#include "material.h"
+#include "profile.h"
+#include "util.h"
+
+/* Given a ray R and a list of objects WORLD, determines the color
+   that would be observed at a particular location on the screen,
+   returning the color as a 3-vector encoding RGB values.
+
+   DEPTH determines the extent of recursion for a ray that reflects
+   off an object surface. */
+color ray_color(const ray& r, const color& background,
+                const hittable& world, int depth) {
+    hit_record rec;
+
+    /* If recursion limit reached, return black (no light). */
+    if (depth <= 0)
+        return color(0, 0, 0);
+
+    /* If the ray doesn't hit anything, return background color. Use
+       0.001 for T_MIN to remove shadow acne. */
+    if (!world.hit(r, 0.001, infinity, rec))
+        return background;
+    rec.finalize(r);
+
+    ray scattered;
+    color attenuation;
+    color emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
+
+    /* If no scattered ray, return just the emitted color. */
+    if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered))
+        return emitted;
+
+    return emitted + attenuation * ray_color(scattered, background,
+                                             world, depth-1);
+}
+
+/* As above, but traces the compiled form SCENE of the world, whose
+   primitives, materials and textures are dispatched by tag. */
+color ray_color(const ray& r, const color& background,
+                const compiled_scene& scene, int depth) {
+    flat_hit h;
+    hit_record rec;
+
+    if (depth <= 0) {
+        PROFILE_PATH_END(end_max_depth, depth);
+        return color(0, 0, 0);
+    }
+
+    if (!scene.hit(r, 0.001, infinity, h)) {
+        PROFILE_PATH_END(end_escaped, depth);
+        return background;
+    }
+    uint32_t mat = scene.get_surface(r, h, rec);
+
+    ray scattered;
+    color attenuation;
+    color emitted = scene.emitted(mat, rec);
+
+    if (!scene.scatter(mat, r, rec, attenuation, scattered)) {
+        PROFILE_PATH_END(emitted.length_squared() > 0 ? end_light
+                                                      : end_absorbed, depth);
+        return emitted;
+    }
+
+    return emitted + attenuation * ray_color(scattered, background,
+                                             scene, depth-1);
+}
+
+/* Returns the seed of sample S of pixel (I, J) in a render seeded
+   with SEED. */
+inline uint64_t sample_seed(uint64_t seed, int i, int j, int s) {
+    return mix_seed(mix_seed(mix_seed(seed, i), j), s);
+}
+
+/* Starts the random sequence of sample S of pixel (I, J) (see
+   trace_sample()) and returns the sample's camera ray. */
+ray sample_ray(const camera& cam, int width, int height, uint64_t seed,
+               int i, int j, int s) {
+    seed_random(sample_seed(seed, i, j, s));
+    auto u = (i + random_double()) / (width-1);
+    auto v = (j + random_double()) / (height-1);
+    return cam.get_ray(u, v, 1.0 / (width-1), 1.0 / (height-1));
+}
+
+/* Traces sample S inside pixel (I, J) of a WIDTH x HEIGHT image of
+   SCENE seen through CAM, counting J up from the bottom row. Each
+   sample has its own random sequence, seeded from SEED, so it is the
+   same whichever order or thread samples are taken in. */
+color trace_sample(const compiled_scene& scene, const camera& cam,
+                   const color& background, int width, int height,
+                   int max_depth, uint64_t seed, int i, int j, int s) {
+    ray r = sample_ray(cam, width, height, seed, i, j, s);
+    PROFILE_PATH_BEGIN(max_depth);
+    return ray_color(r, background, scene, max_depth);
+}
+
+#endif
@@ -0,0 +1,238 @@
+#include "util.h"
+#include "scenes.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bvh.h"
+#include "image-io.h"
+#include "incremental-render.h"
+#include "scene-pass.h"
+
+/* Applies a list of edits to a scene one at a time, re-rendering only
+   the tiles each edit affects (see incremental-render.h), and writes
+   the image after each edit to PREFIX-N.png. Each line of EDITS is
+   one edit of the scene's objects, numbered from 0 as listed at the
+   start:
+
+       move K dx,dy,dz     moves object K
+       color K r,g,b       gives object K a diffuse material
+       remove K            removes object K
+
+   with # starting a comment. With --verify, each edit is also
+   rendered in full and compared with the incremental image.
+
+   Usage: lookdev [--threads n] [--width n] [--spp n] [--verify]
+                  scene_index edits.txt prefix */
+
+namespace {
+
+/* Appends the objects of OBJECT to OUT, taking lists and BVHs apart
+   so that each object can be edited on its own. */
+void flatten(const shared_ptr<hittable>& object, hittable_list& out) {
+    const std::type_info& type = typeid(*object);
+    if (type == typeid(hittable_list)) {
+        for (const auto& child : static_cast<hittable_list&>(*object).objects)
+            flatten(child, out);
+    }
+    else if (type == typeid(bvh_node)) {
+        auto node = static_cast<bvh_node*>(object.get());
+        flatten(node->left, out);
+        if (node->right != node->left)
+            flatten(node->right, out);
+    }
+    else
+        out.add(object);
+}
+
+/* Returns a copy of OBJECT made of material MAT, or null if OBJECT is
+   not a sphere or rectangle. */
+shared_ptr<hittable> with_material(const shared_ptr<hittable>& object,
+                                   shared_ptr<material> mat) {
+    const std::type_info& type = typeid(*object);
+    if (type == typeid(sphere)) {
+        auto copy = make_shared<sphere>(static_cast<sphere&>(*object));
+        copy->mat_ptr = mat;
+        return copy;
+    }
+    if (type == typeid(moving_sphere)) {
+        auto copy = make_shared<moving_sphere>(
+            static_cast<moving_sphere&>(*object));
+        copy->mat_ptr = mat;
+        return copy;
+    }
+    if (type == typeid(xy_rect)) {
+        auto copy = make_shared<xy_rect>(static_cast<xy_rect&>(*object));
+        copy->mp = mat;
+        return copy;
+    }
+    if (type == typeid(xz_rect)) {
+        auto copy = make_shared<xz_rect>(static_cast<xz_rect&>(*object));
+        copy->mp = mat;
+        return copy;
+    }
+    if (type == typeid(yz_rect)) {
+        auto copy = make_shared<yz_rect>(static_cast<yz_rect&>(*object));
+        copy->mp = mat;
+        return copy;
+    }
+    return nullptr;
+}
+
+/* Applies the edit in LINE to WORLD. Objects are replaced rather than
+   modified, since the last rendered scene still refers to them. */
+bool apply_edit(const std::string& line, hittable_list& world,
+                std::string& error) {
+    std::istringstream words(line);
+    std::string verb, arg;
+    size_t k;
+    if (!(words >> verb >> k) || (verb != "remove" && !(words >> arg))) {
+        error = "expected: move|color K x,y,z or remove K";
+        return false;
+    }
+    if (k >= world.objects.size()) {
+        error = "no object " + std::to_string(k);
+        return false;
+    }
+
+    double x = 0, y = 0, z = 0;
+    char rest;
+    if (verb != "remove" &&
+        sscanf(arg.c_str(), "%lf,%lf,%lf%c", &x, &y, &z, &rest) != 3) {
+        error = "expected x,y,z: " + arg;
+        return false;
+    }
+
+    auto& object = world.objects[k];
+    if (verb == "move")
+        object = make_shared<translate>(object, vec3(x, y, z));
+    else if (verb == "color") {
+        auto mat = make_shared<lambertian>(color(x, y, z));
+        auto copy = with_material(object, mat);
+        if (!copy) {
+            error = "object " + std::to_string(k) + " has no one material";
+            return false;
+        }
+        object = copy;
+    }
+    else if (verb == "remove")
+        world.objects.erase(world.objects.begin() + k);
+    else {
+        error = "unknown edit " + verb;
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+    int threads = 0, width = 0, spp = 0;
+    bool verify = false;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; i++) {
+        if (strcmp(argv[i], "--verify") == 0)
+            verify = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+            width = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spp") == 0 && i + 1 < argc)
+            spp = atoi(argv[++i]);
+        else {
+            i = argc;
+            break;
+        }
+    }
+
+    if (argc - i != 3) {
+        std::cerr << "Usage: " << argv[0] << " [--threads n] [--width n] "
+                  << "[--spp n] [--verify] scene_index edits.txt prefix\n";
+        return 1;
+    }
+    std::string edits_path = argv[i+1], prefix = argv[i+2];
+
+    scene_arena arena;
+    scene_setup setup;
+    if (!select_scene(atoi(argv[i]), arena, setup)) {
+        std::cerr << "ERROR: No scene " << argv[i] << ".\n";
+        return 1;
+    }
+    collapse_transforms(setup.world);
+    hittable_list world;
+    for (const auto& object : setup.world.objects)
+        flatten(object, world);
+
+    std::ifstream edits(edits_path);
+    if (!edits) {
+        std::cerr << "ERROR: Could not open edits '" << edits_path << "'.\n";
+        return 1;
+    }
+
+    if (width <= 0)
+        width = setup.image_width;
+    if (spp <= 0)
+        spp = setup.samples_per_pixel;
+    int height = static_cast<int>(width / setup.aspect_ratio);
+    const int max_depth = 50;
+    camera cam = scene_camera(setup);
+
+    std::cerr << "Objects: " << world.objects.size() << "\n";
+    auto start = std::chrono::steady_clock::now();
+    auto scene = make_shared<compiled_scene>(world, 0.0, 1.0);
+    incremental_renderer renderer(cam, setup.background, width, height, spp,
+                                  max_depth, 0, threads);
+    renderer.render(*scene);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "Full render: " << renderer.tile_count() << " tiles in "
+              << elapsed.count() << " s\n";
+
+    std::string line;
+    int failures = 0;
+    for (int number = 1, edit = 0; std::getline(edits, line); number++) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        std::string error;
+        if (!apply_edit(line, world, error)) {
+            std::cerr << "ERROR: " << edits_path << ":" << number << ": "
+                      << error << ".\n";
+            return 1;
+        }
+
+        start = std::chrono::steady_clock::now();
+        auto edited = make_shared<compiled_scene>(world, 0.0, 1.0);
+        int tiles = renderer.update(*scene, *edited);
+        elapsed = std::chrono::steady_clock::now() - start;
+        scene = edited;
+
+        std::string output = prefix + "-" + std::to_string(++edit) + ".png";
+        std::cerr << output << ": " << tiles << " of " << renderer.tile_count()
+                  << " tiles in " << elapsed.count() << " s";
+        if (!write_image(renderer.image, output)) {
+            std::cerr << "\nERROR: Could not write image '" << output
+                      << "'.\n";
+            return 1;
+        }
+
+        if (verify) {
+            incremental_renderer full(cam, setup.background, width, height,
+                                      spp, max_depth, 0, threads);
+            full.render(*scene);
+            bool same = memcmp(full.image.pixels.data(),
+                               renderer.image.pixels.data(),
+                               full.image.pixels.size() * sizeof(color)) == 0;
+            failures += !same;
+            std::cerr << (same ? ", matches full render"
+                               : ", DIFFERS from full render");
+        }
+        std::cerr << "\n";
+    }
+    return failures ? 1 : 0;
+}
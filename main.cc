@@ -1,169 +1,368 @@
 #include "util.h"
 #include "scenes.h"
 #include <iostream>
+#include <chrono>
+#include <csignal>
 #include "camera.h"
+#include "checkpoint.h"
 #include "color.h"
+#include "framebuffer.h"
 #include "hittable-list.h"
+#include "image-stream.h"
+#include "image-writer.h"
+#include "integrator.h"
 #include "material.h"
+#include "mesh-io.h"
+#include "scene-io.h"
+#include "scene-pass.h"
+#include "texture-bake.h"
+#include "video-stream.h"
 
-/* Given a ray R and a list of objects WORLD, determines the color
-   that would be observed at a particular location on the screen,
-   returning the color as a 3-vector encoding RGB values.
-   
-   DEPTH determines the extent of recursion for a ray that reflects
-   off an object surface. */
-color ray_color(const ray& r, const color& background,
-                const hittable& world, int depth) {
-    hit_record rec;
-
-    /* If recursion limit reached, return black (no light). */
-    if (depth <= 0)
-        return color(0, 0, 0);
-
-    /* If the ray doesn't hit anything, return background color. Use
-       0.001 for T_MIN to remove shadow acne. */
-    if (!world.hit(r, 0.001, infinity, rec))
-        return background;
-
-    ray scattered;
-    color attenuation;
-    color emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
-
-    /* If no scattered ray, return just the emitted color. */
-    if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-        return emitted;
-
-    return emitted + attenuation * ray_color(scattered, background,
-                                             world, depth-1);
+/* Set by SIGINT and SIGTERM to stop the render at the next
+   checkpoint. */
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+    stop_requested = 1;
 }
 
-int main() {
+/* Usage: main [--scene file | --mesh file] [--bake] [--stream]
+               [--checkpoint file] [--resume file] [output]
+          main [--scene file | --mesh file] [--bake] --video y4m|rgb
+               [--frames n] [--fps n] [output]
+
+   Renders the selected scene, or the scene file given by --scene (see
+   scene-io.h and sceneconv.cc), or the OBJ or binary mesh given by
+   --mesh (see mesh-io.h and meshconv.cc) on a floor under a sky (see
+   mesh_scene()), to OUTPUT, in the format of its extension
+   (.ppm, .pfm, .png, or .rtacc for the accumulation buffer, which
+   tonemap can regrade; see image-io.h), or as a PPM to standard output
+   if no file is given. With --stream, the image is rendered in tiles
+   straight into a PPM file at OUTPUT (see image-stream.h), keeping
+   only the tile in progress in memory. --bake replaces noise
+   textures with cached lookup grids (see texture-bake.h), trading a
+   small, bounded error for skipping the noise math.
+
+   Otherwise the render is checkpointed (see checkpoint.h) every minute
+   and when it is interrupted, to the --checkpoint file or OUTPUT.ckpt
+   when writing to a file. --resume continues the render saved in a
+   checkpoint, with its settings, and gives the same image as an
+   uninterrupted render (a scene file or mesh must be given again, and
+   is refused if its contents changed). While later passes render, the
+   image so far is written to OUTPUT on the writer's thread (see
+   image-writer.h) after any pass that finds the writer idle.
+
+   With --video, N frames (24 by default) whose shutters divide the
+   scene's [0, 1] time span between them are streamed to OUTPUT or
+   standard output as uncompressed video (see video-stream.h), to be
+   encoded as they render. */
+int main(int argc, char** argv) {
+    bool stream = false, video = false, bake_textures = false, usage = false;
+    std::string output = "-", checkpoint_path, resume_path, scene_path;
+    std::string mesh_path;
+    video_format format = video_y4m;
+    int frame_count = 24, fps = 24;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--stream")
+            stream = true;
+        else if (arg == "--bake")
+            bake_textures = true;
+        else if (arg == "--scene" && a + 1 < argc)
+            scene_path = argv[++a];
+        else if (arg == "--mesh" && a + 1 < argc)
+            mesh_path = argv[++a];
+        else if (arg == "--checkpoint" && a + 1 < argc)
+            checkpoint_path = argv[++a];
+        else if (arg == "--resume" && a + 1 < argc)
+            resume_path = argv[++a];
+        else if (arg == "--video" && a + 1 < argc) {
+            video = true;
+            usage |= !parse_video_format(argv[++a], format);
+        }
+        else if (arg == "--frames" && a + 1 < argc)
+            frame_count = atoi(argv[++a]);
+        else if (arg == "--fps" && a + 1 < argc)
+            fps = atoi(argv[++a]);
+        else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-')
+            usage = true;
+        else
+            output = arg;
+    }
+    bool checkpointing = !checkpoint_path.empty() || !resume_path.empty();
+    if (usage || (!scene_path.empty() && !mesh_path.empty()) ||
+        (stream && (output == "-" || checkpointing || video)) ||
+        (video && (checkpointing || frame_count < 1 || fps < 1))) {
+        const char* scene = " [--scene file | --mesh file] [--bake] ";
+        std::cerr << "Usage: " << argv[0] << scene
+                  << "[--checkpoint file] [--resume file] [output]\n"
+                  << "       " << argv[0] << scene << "--stream output.ppm\n"
+                  << "       " << argv[0] << scene
+                  << "--video y4m|rgb [--frames n] [--fps n] [output]\n";
+        return 1;
+    }
 
-    /* Set screen size (debugging: 400, production: 1600). */
-    auto aspect_ratio = 16.0 / 9.0;
-    int image_width = 400;
+    render_settings settings;
+    memset(&settings, 0, sizeof(settings));
+    auto resumed = make_shared<framebuffer>();
+    if (!resume_path.empty()) {
+        if (!load_checkpoint(resume_path, settings, *resumed)) {
+            std::cerr << "ERROR: Could not load checkpoint '" << resume_path
+                      << "'.\n";
+            return 1;
+        }
+        if (checkpoint_path.empty())
+            checkpoint_path = resume_path;
+    }
+    bool resuming = resumed->width > 0;
+    if (checkpoint_path.empty() && output != "-" && !video)
+        checkpoint_path = output + ".ckpt";
 
-    /* Set samples per pixel (debugging: 10, production: 20). */
-    int samples_per_pixel = 10;
-    
     /* Sets the maximum recursion depth for ray bounces. */
     int max_depth = 50;
+    if (resuming)
+        max_depth = settings.max_depth;
 
-    /* Default world and camera parameters. */
-    hittable_list world;
-    point3 lookfrom;
-    point3 lookat;
-    auto vfov = 40.0;
-    auto aperture = 0.0;
-    color background(0, 0, 0);
-
-    /* Select scene to render and assign parameters. */
+    /* Select scene to render. The arena owns every object in the
+       world, so it is declared first to outlive it. A scene file is
+       loaded already compiled. A scene file or mesh is identified by a
+       hash of its bytes, so a render is only resumed with the scene it
+       was started with. */
     int scene_index = 4;
+    if (resuming)
+        scene_index = settings.scene_index;
+    uint64_t scene_hash = 0;
+    scene_arena arena;
+    scene_setup setup;
+    shared_ptr<compiled_scene> compiled;
+    if (!scene_path.empty()) {
+        compiled = load_scene(scene_path, setup);
+        if (!compiled)
+            return 1;
+        scene_index = -1;
+        scene_hash = fnv1a(compiled->file.data(), compiled->file.size());
+    }
+    if (!mesh_path.empty()) {
+        auto mesh = load_mesh_file(mesh_path);
+        if (!mesh)
+            return 1;
+        if (!mesh_scene(mesh, arena, setup)) {
+            std::cerr << "ERROR: Mesh file '" << mesh_path
+                      << "' has no triangles.\n";
+            return 1;
+        }
+        scene_index = -2;
+        scene_hash = fnv1a(mesh->positions.data(),
+                           mesh->positions.size() * sizeof(float));
+        scene_hash = fnv1a(mesh->indices.data(),
+                           mesh->indices.size() * sizeof(uint32_t), scene_hash);
+    }
+    if (resuming && (scene_index != settings.scene_index ||
+                     scene_hash != settings.scene_hash)) {
+        std::cerr << "ERROR: Checkpoint '" << resume_path
+                  << "' was rendered from a different scene.\n";
+        return 1;
+    }
+    if (!compiled && mesh_path.empty())
+        select_scene(scene_index, arena, setup);
 
-    switch(scene_index) {
-
-        /* Random scene with many assorted spheres. */
-        case 0:
-            world = random_scene();
-            background = color(0.7, 0.8, 1.0);
-            lookfrom = point3(13, 2, 3);
-            lookat = point3(0, 0, 0);
-            vfov = 20.0;
-            aperture = 0.1;
-            break;
-
-        /* Scene with two checkered spheres. */
-        case 1:
-            world = two_spheres();
-            background = color(0.7, 0.8, 1.0);
-            lookfrom = point3(13, 2, 3);
-            lookat = point3(0, 0, 0);
-            vfov = 20.0;
-            break;
-
-        /* Scene with two spheres with Perlin noise. */
-        case 2:
-            world = two_perlin_spheres();
-            background = color(0.7, 0.8, 1.0);
-            lookfrom = point3(13, 2, 3);
-            lookat = point3(0, 0, 0);
-            vfov = 20.0;
-            break;
-
-        /* Scene with Earth image texture on sphere. */
-        case 3:
-            world = earth();
-            background = color(0.7, 0.8, 1.0);
-            lookfrom = point3(13, 2, 3);
-            lookat = point3(0, 0, 0);
-            vfov = 20.0;
-            break;
-
-        /* Wheel of Fortune scene. */
-        case 4: 
-            world = wheel_of_fortune();
-            background = color(0.7, 0.8, 1.0);
-            lookfrom = point3(0, 0, 30);
-            lookat = point3(0, 3.5, 0);
-            vfov = 20.0;
-            break;
-
-        /* Scene with simple lights. */
-        case 5:
-            world = simple_light();
-            samples_per_pixel = 400;
-            background = color(0, 0, 0);
-            lookfrom = point3(26, 3, 6);
-            lookat = point3(0, 2, 0);
-            vfov = 20.0;
-            break;
-
-        /* Scene with a basic "Cornell box". */
-        case 6:
-            world = cornell_box();
-            aspect_ratio = 1.0;
-            image_width = 600;
-            samples_per_pixel = 20;
-            background = color(0, 0, 0);
-            lookfrom = point3(278, 278, -800);
-            lookat = point3(278, 278, 0);
-            vfov = 40.0;
-            break;
-
-        /* Provided scene index does not match any created scene. */
-        default:
-            background = color(0, 0, 0);
-            break;
+    int image_width = setup.image_width;
+    int samples_per_pixel = setup.samples_per_pixel;
+    if (resuming) {
+        image_width = settings.image_width;
+        samples_per_pixel = settings.samples_per_pixel;
     }
 
+    /* Fold chains of transforms so each costs one ray transform. */
+    collapse_transforms(setup.world);
+
+    /* Optionally bake noise textures into cached lookup grids, which
+       trades a small, bounded error for skipping the noise math. A
+       resumed render bakes if the interrupted one did. */
+    if (resuming)
+        bake_textures = (settings.flags & render_baked_textures) != 0;
+    if (bake_textures)
+        bake_noise_textures(setup.world);
+
+    /* Flatten the world for tag-dispatched rendering. */
+    if (!compiled)
+        compiled = make_shared<compiled_scene>(setup.world, 0.0, 1.0);
+    const compiled_scene& scene = *compiled;
+
     /* Make camera and screen. */
-    vec3 vup(0, 1, 0);
-    auto dist_to_focus = 10.0;
-    camera cam(lookfrom, lookat, vup,
-               vfov, aspect_ratio, aperture, dist_to_focus, 0.0, 1.0);
-    int image_height = static_cast<int>(image_width / aspect_ratio);
-
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-    /* Write pixels out in rows from left to right, starting at the
-       top row and ending at the bottom row. */
-    for (int j = image_height-1; j >= 0; --j) {
-        std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
-        for (int i = 0; i < image_width; ++i) {
-            color pixel_color(0, 0, 0);
-
-            /* Average SAMPLES_PER_PIXEL samples inside each pixel
-               to remove jaggies in the output image. */
-            for (int s = 0; s < samples_per_pixel; ++s) {
-                auto u = (i + random_double()) / (image_width-1);
-                auto v = (j + random_double()) / (image_height-1);
-                ray r = cam.get_ray(u, v);
-                pixel_color += ray_color(r, background, world, max_depth);
+    camera cam = scene_camera(setup);
+    int image_height = static_cast<int>(image_width / setup.aspect_ratio);
+    if (resuming)
+        image_height = settings.image_height;
+    color background = setup.background;
+
+    settings.scene_index = scene_index;
+    settings.image_width = image_width;
+    settings.image_height = image_height;
+    settings.samples_per_pixel = samples_per_pixel;
+    settings.max_depth = max_depth;
+    settings.flags = bake_textures ? render_baked_textures : 0;
+    settings.scene_hash = scene_hash;
+
+    /* Returns sample S inside pixel (I, J), counting J up from the
+       bottom row. */
+    uint64_t frame_seed = settings.seed;
+    auto sample_pixel = [&](int i, int j, int s) {
+        return trace_sample(scene, cam, background, image_width, image_height,
+                            max_depth, frame_seed, i, j, s);
+    };
+
+    /* Returns the sum of SAMPLES_PER_PIXEL samples inside pixel
+       (I, J), to remove jaggies in the output image. */
+    auto render_pixel = [&](int i, int j) {
+        color pixel_color(0, 0, 0);
+        for (int s = 0; s < samples_per_pixel; ++s)
+            pixel_color += sample_pixel(i, j, s);
+        return pixel_color;
+    };
+
+    if (stream) {
+        const int tile_size = 64;
+        int tiles_x = (image_width + tile_size - 1) / tile_size;
+        int tiles_y = (image_height + tile_size - 1) / tile_size;
+
+        streamed_image file;
+        if (!file.create(output, image_width, image_height,
+                         tiles_x * tiles_y)) {
+            std::cerr << "ERROR: Could not create image '" << output << "'.\n";
+            return 1;
+        }
+
+        /* Render tiles in rows from the top, releasing each row of
+           tiles from memory once it is written. */
+        framebuffer tile;
+        for (int ty = 0; ty < tiles_y; ty++) {
+            std::cerr << "\rTile rows remaining: " << tiles_y - ty << ' '
+                      << std::flush;
+            int y0 = ty * tile_size;
+            int y1 = std::min(y0 + tile_size, image_height);
+            for (int tx = 0; tx < tiles_x; tx++) {
+                int x0 = tx * tile_size;
+                int x1 = std::min(x0 + tile_size, image_width);
+                tile = framebuffer(x1 - x0, y1 - y0);
+                for (int y = y0; y < y1; y++)
+                    for (int x = x0; x < x1; x++)
+                        tile.add(x - x0, y - y0,
+                                 render_pixel(x, image_height-1-y),
+                                 samples_per_pixel);
+                file.write_tile(tile, x0, y0);
             }
+            file.release_rows(y0, y1);
+        }
+
+        if (!file.close()) {
+            std::cerr << "ERROR: Could not write image '" << output << "'.\n";
+            return 1;
+        }
+        PROFILE_REPORT(std::cerr);
+        std::cerr << "\nDone.\n";
+        return 0;
+    }
+
+    if (video) {
+        video_stream out;
+        if (!out.open(output, format, image_width, image_height, fps)) {
+            std::cerr << "ERROR: Could not open video '" << output << "'.\n";
+            return 1;
+        }
+        if (format == video_rgb)
+            std::cerr << "Raw video: rgb24, " << image_width << "x"
+                      << image_height << ", " << fps << " fps\n";
+
+        /* Render each frame into its own framebuffer and hand it to the
+           stream, which converts and writes it while the next renders. */
+        for (int frame = 0; frame < frame_count; frame++) {
+            cam = scene_camera(setup, double(frame) / frame_count,
+                               double(frame + 1) / frame_count);
+            frame_seed = mix_seed(settings.seed, frame);
+            auto image = make_shared<framebuffer>(image_width, image_height);
+            for (int j = image_height-1; j >= 0; --j) {
+                std::cerr << "\rFrame " << frame + 1 << " of " << frame_count
+                          << ", scanlines remaining: " << j << ' '
+                          << std::flush;
+                for (int i = 0; i < image_width; ++i)
+                    image->add(i, image_height-1-j, render_pixel(i, j),
+                               samples_per_pixel);
+            }
+            if (!out.submit(image))
+                break;
+        }
+
+        if (!out.close()) {
+            std::cerr << "\nERROR: Could not write video '" << output << "'.\n";
+            return 1;
+        }
+        PROFILE_REPORT(std::cerr);
+        std::cerr << "\nDone.\n";
+        return 0;
+    }
+
+    image_writer writer;
+    auto image = resuming ? resumed
+                          : make_shared<framebuffer>(image_width, image_height);
+
+    /* Render one sample in every pixel per pass, in rows from left to
+       right, starting at the top row and ending at the bottom row.
+       Pixels a resumed render already sampled in a pass are skipped. */
+    const std::chrono::seconds checkpoint_interval(60);
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    if (!checkpoint_path.empty()) {
+        std::signal(SIGINT, request_stop);
+        std::signal(SIGTERM, request_stop);
+    }
+
+    for (int pass = 0; pass < samples_per_pixel; pass++) {
+        for (int y = 0; y < image_height; y++) {
+            std::cerr << "\rPass " << pass + 1 << " of " << samples_per_pixel
+                      << ", scanlines remaining: " << image_height-1-y << ' '
+                      << std::flush;
+            for (int x = 0; x < image_width; x++)
+                if (image->sample_count(x, y) <= static_cast<uint32_t>(pass))
+                    image->add(x, y, sample_pixel(x, image_height-1-y, pass), 1);
 
-            write_color(std::cout, pixel_color, samples_per_pixel);
+            bool stopping = stop_requested != 0;
+            auto now = std::chrono::steady_clock::now();
+            if (checkpoint_path.empty() ||
+                (!stopping && now - last_checkpoint < checkpoint_interval))
+                continue;
+
+            if (!save_checkpoint(checkpoint_path, settings, *image))
+                std::cerr << "\nERROR: Could not write checkpoint '"
+                          << checkpoint_path << "'.\n";
+            last_checkpoint = now;
+            if (stopping) {
+                std::cerr << "\nStopped. Continue with: " << argv[0]
+                          << (scene_path.empty() ? "" : " --scene ")
+                          << scene_path
+                          << (mesh_path.empty() ? "" : " --mesh ")
+                          << mesh_path << " --resume " << checkpoint_path
+                          << ' ' << output << '\n';
+                return 1;
+            }
         }
+
+        /* Hand a copy of the image so far to the writer, to be encoded
+           while the next pass renders. A preview is skipped while the
+           last one is still being written. */
+        if (output != "-" && pass + 1 < samples_per_pixel &&
+            writer.pending() == 0)
+            writer.submit(make_shared<framebuffer>(*image), output);
     }
 
+    /* Encode and write the final image on the writer's thread. */
+    writer.submit(image, output);
+    if (!writer.wait())
+        return 1;
+
+    /* The render is complete, so its checkpoint is no longer needed. */
+    if (!checkpoint_path.empty())
+        remove(checkpoint_path.c_str());
+
+    PROFILE_REPORT(std::cerr);
     std::cerr << "\nDone.\n";
 }
@@ -0,0 +1,108 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+   A read-only view of COUNT contiguous elements of type T. The view
+   does not own the elements, which may live in a std::vector or in
+   a memory-mapped file.
+*/
+template <typename T>
+class array_view {
+public:
+    array_view() : ptr(nullptr), count(0) {}
+    array_view(const T* p, size_t n) : ptr(p), count(n) {}
+
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+
+private:
+    const T* ptr;
+    size_t count;
+};
+
+/*
+   A file mapped read-only into memory. The mapping is released when
+   the object is destroyed, so any views into it must not outlive it.
+*/
+class mapped_file {
+public:
+    mapped_file() : base(nullptr), length(0) {}
+    mapped_file(const std::string& path) : base(nullptr), length(0) {
+        open(path);
+    }
+    ~mapped_file() { close(); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    /* Maps the file at PATH, replacing any current mapping. Returns
+       false if the file cannot be opened or mapped. */
+    bool open(const std::string& path);
+    void close();
+
+    bool is_open() const { return base != nullptr; }
+    const unsigned char* data() const {
+        return static_cast<const unsigned char*>(base);
+    }
+    size_t size() const { return length; }
+
+    /* Returns a view of COUNT elements of type T starting OFFSET
+       bytes into the file, or an empty view if out of range. */
+    template <typename T>
+    array_view<T> view(size_t offset, size_t count) const {
+        if (offset > length || count > (length - offset) / sizeof(T))
+            return array_view<T>();
+        return array_view<T>(reinterpret_cast<const T*>(data() + offset),
+                             count);
+    }
+
+private:
+    void* base;
+    size_t length;
+};
+
+bool mapped_file::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    /* The mapping stays valid after the descriptor is closed. */
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    base = p;
+    length = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void mapped_file::close() {
+    if (base)
+        munmap(base, length);
+    base = nullptr;
+    length = 0;
+}
+
+#endif
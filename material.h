@@ -36,6 +36,15 @@ public:
 
     virtual bool scatter(const ray& r_in, const hit_record& rec,
                          color& attenuation, ray& scattered) const override {
+        scatter_ray(r_in, rec, scattered);
+        attenuation = albedo->filtered_value(rec.u, rec.v, rec.p,
+                                             rec.footprint);
+        return true;
+    }
+
+    /* Picks the diffusely scattered ray, independent of the albedo. */
+    static void scatter_ray(const ray& r_in, const hit_record& rec,
+                            ray& scattered) {
         auto scatter_direction = rec.normal + random_unit_vector();
 
         /* Handle degenerate scatter direction. */
@@ -43,8 +52,6 @@ public:
             scatter_direction = rec.normal;
 
         scattered = ray(rec.p, scatter_direction, r_in.time());
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
-        return true;
     }
 
 public:
@@ -60,13 +67,19 @@ public:
 
     virtual bool scatter(const ray&r_in, const hit_record& rec,
                          color& attenuation, ray& scattered) const override {
+        attenuation = albedo;
+        return scatter_ray(r_in, rec, fuzz, scattered);
+    }
+
+    /* Picks the reflected ray for fuzz FUZZ, returning false if it
+       points into the surface. */
+    static bool scatter_ray(const ray& r_in, const hit_record& rec,
+                            double fuzz, ray& scattered) {
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
 
         /* Add fuzzy reflection. */
         scattered = ray(rec.p, reflected + fuzz*random_in_unit_sphere(),
                         r_in.time());
-
-        attenuation = albedo;
         return (dot(scattered.direction(), rec.normal) > 0);
     }
 
@@ -84,10 +97,16 @@ public:
 
     virtual bool scatter(const ray& r_in, const hit_record& rec,
                          color& attenuation, ray& scattered) const override {
-        double refraction_ratio = rec.front_face ? (1.0/ir) : ir;
-
         /* Dielectric material does not absorb light. */
         attenuation = color(1.0, 1.0, 1.0);
+        scatter_ray(r_in, rec, ir, scattered);
+        return true;
+    }
+
+    /* Picks the reflected or refracted ray for index of refraction IR. */
+    static void scatter_ray(const ray& r_in, const hit_record& rec, double ir,
+                            ray& scattered) {
+        double refraction_ratio = rec.front_face ? (1.0/ir) : ir;
 
         /* Determine if refraction is possible. */
         vec3 unit_direction = unit_vector(r_in.direction());
@@ -104,7 +123,6 @@ public:
             direction = refract(unit_direction, rec.normal, refraction_ratio);
 
         scattered = ray(rec.p, direction, r_in.time());
-        return true;
     }
 
 public:
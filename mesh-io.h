@@ -0,0 +1,321 @@
+#ifndef MESH_IO_H
+#define MESH_IO_H
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "mapped-file.h"
+#include "triangle-mesh.h"
+
+/*
+   Loading and saving of triangle meshes. Wavefront OBJ files are
+   parsed in a single streaming pass, and the binary mesh format
+   stores the vertex, index and BVH buffers exactly as they are laid
+   out in memory, so a binary mesh is used straight from its mapping.
+
+   Binary mesh layout (little-endian):
+       mesh_file_header
+       float     positions[3 * vertex_count]     at positions_offset
+       uint32_t  indices[3 * triangle_count]     at indices_offset
+       flat_node nodes[node_count]               at nodes_offset
+*/
+
+const char mesh_file_magic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 0, 0 };
+const uint32_t mesh_file_version = 1;
+
+struct mesh_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t vertex_count;
+    uint64_t triangle_count;
+    uint64_t node_count;
+    uint64_t positions_offset;
+    uint64_t indices_offset;
+    uint64_t nodes_offset;
+};
+
+namespace mesh_io {
+
+/* Buffers in the binary file start on cache line boundaries. */
+const uint64_t alignment = 64;
+
+inline uint64_t align_up(uint64_t n) {
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skip_space(const char* s, const char* end) {
+    while (s < end && is_space(*s))
+        s++;
+    return s;
+}
+
+/* Parses the number at S, up to END or the next space, into X with
+   strtof(), which needs a terminated copy since S is not. Returns
+   false unless the whole token is a finite number. */
+inline bool parse_float(const char* s, const char* end, float& x) {
+    char token[64];
+    size_t n = 0;
+    while (s + n < end && !is_space(s[n]))
+        n++;
+    if (n == 0 || n >= sizeof(token))
+        return false;
+    memcpy(token, s, n);
+    token[n] = 0;
+
+    char* stop;
+    x = strtof(token, &stop);
+    return stop == token + n && std::isfinite(x);
+}
+
+/* Parses one OBJ line from BEGIN to END, appending vertices to
+   POSITIONS and fan-triangulated faces to INDICES, which are left
+   unchanged if the line is malformed. FACE is scratch space for the
+   triangles of a face. Returns nullptr, or why the line is
+   malformed. */
+const char* parse_obj_line(const char* s, const char* end,
+                           std::vector<float>& positions,
+                           std::vector<uint32_t>& indices,
+                           std::vector<uint32_t>& face) {
+    s = skip_space(s, end);
+    if (end - s < 2 || !is_space(s[1]))
+        return nullptr;
+
+    if (s[0] == 'v') {
+        s += 2;
+        float xyz[3];
+        for (int a = 0; a < 3; a++) {
+            s = skip_space(s, end);
+            if (!parse_float(s, end, xyz[a]))
+                return "bad vertex";
+            while (s < end && !is_space(*s))
+                s++;
+        }
+        positions.insert(positions.end(), xyz, xyz + 3);
+    }
+    else if (s[0] == 'f') {
+        s += 2;
+        long vertex_count = static_cast<long>(positions.size() / 3);
+        uint32_t first = 0, prev = 0;
+        int corner = 0;
+        face.clear();
+
+        while (true) {
+            s = skip_space(s, end);
+            if (s >= end)
+                break;
+
+            /* Only the position index of "v/vt/vn" is used. Negative
+               indices count back from the latest vertex. */
+            long index = 0;
+            auto result = std::from_chars(s, end, index);
+            if (result.ec != std::errc())
+                return "bad face";
+            s = result.ptr;
+            while (s < end && !is_space(*s))
+                s++;
+
+            index = index < 0 ? vertex_count + index : index - 1;
+            if (index < 0 || index >= vertex_count)
+                return "bad vertex index";
+
+            uint32_t v = static_cast<uint32_t>(index);
+            if (corner == 0)
+                first = v;
+            else if (corner >= 2)
+                face.insert(face.end(), { first, prev, v });
+            prev = v;
+            corner++;
+        }
+        indices.insert(indices.end(), face.begin(), face.end());
+    }
+    return nullptr;
+}
+
+} // namespace mesh_io
+
+/* Loads the Wavefront OBJ file at PATH, reading it in fixed-size
+   chunks so that only the vertex and index buffers grow with the
+   file. Polygons are fan-triangulated and all other statements are
+   ignored. Returns nullptr if the file cannot be read or has a
+   malformed vertex or face. */
+shared_ptr<mesh_data> load_obj(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        std::cerr << "ERROR: Could not load mesh file '" << path << "'.\n";
+        return nullptr;
+    }
+
+    std::vector<float> positions;
+    std::vector<uint32_t> indices, face;
+    std::vector<char> buffer(1 << 20);
+    size_t pending = 0;
+    long line_number = 0;
+    const char* error = nullptr;
+
+    while (!error) {
+        size_t n = fread(buffer.data() + pending, 1,
+                         buffer.size() - pending, f);
+        size_t filled = pending + n;
+        bool at_eof = n == 0;
+
+        /* Parse every complete line and keep the partial tail. */
+        const char* line = buffer.data();
+        const char* end = buffer.data() + filled;
+        while (!error) {
+            const char* nl = static_cast<const char*>(
+                memchr(line, '\n', end - line));
+            if (!nl) {
+                if (at_eof && line < end) {
+                    line_number++;
+                    error = mesh_io::parse_obj_line(line, end, positions,
+                                                    indices, face);
+                    line = end;
+                }
+                break;
+            }
+            line_number++;
+            error = mesh_io::parse_obj_line(line, nl, positions, indices,
+                                            face);
+            line = nl + 1;
+        }
+
+        pending = end - line;
+        if (at_eof)
+            break;
+        if (pending == buffer.size())
+            buffer.resize(2 * buffer.size());
+        memmove(buffer.data(), line, pending);
+    }
+
+    fclose(f);
+    if (error) {
+        std::cerr << "ERROR: Could not load mesh file '" << path << "' ("
+                  << error << " on line " << line_number << ").\n";
+        return nullptr;
+    }
+    return build_mesh(std::move(positions), std::move(indices));
+}
+
+/* Writes MESH to PATH in the binary mesh format. Returns false if
+   the file cannot be written. */
+bool save_mesh(const mesh_data& mesh, const std::string& path) {
+    mesh_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, mesh_file_magic, sizeof(h.magic));
+    h.version = mesh_file_version;
+    h.vertex_count = mesh.vertex_count();
+    h.triangle_count = mesh.triangle_count();
+    h.node_count = mesh.nodes.size();
+    h.positions_offset = mesh_io::align_up(sizeof(h));
+    h.indices_offset = mesh_io::align_up(
+        h.positions_offset + mesh.positions.size() * sizeof(float));
+    h.nodes_offset = mesh_io::align_up(
+        h.indices_offset + mesh.indices.size() * sizeof(uint32_t));
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+
+    const char zeros[mesh_io::alignment] = {};
+    auto write_at = [&](uint64_t offset, const void* data, size_t bytes) {
+        long pos = ftell(f);
+        if (pos < 0 || static_cast<uint64_t>(pos) > offset)
+            return false;
+        if (fwrite(zeros, 1, offset - pos, f) != offset - pos)
+            return false;
+        return bytes == 0 || fwrite(data, 1, bytes, f) == bytes;
+    };
+
+    bool ok = write_at(0, &h, sizeof(h))
+        && write_at(h.positions_offset, mesh.positions.data(),
+                    mesh.positions.size() * sizeof(float))
+        && write_at(h.indices_offset, mesh.indices.data(),
+                    mesh.indices.size() * sizeof(uint32_t))
+        && write_at(h.nodes_offset, mesh.nodes.data(),
+                    mesh.nodes.size() * sizeof(flat_node));
+
+    return fclose(f) == 0 && ok;
+}
+
+/* Maps the binary mesh file at PATH and returns a mesh whose buffers
+   point directly into the mapping. Nothing is copied or rebuilt, but
+   the indices and nodes are read once to check that no traversal can
+   leave the buffers. Returns nullptr if the file is missing or
+   malformed. */
+shared_ptr<mesh_data> load_mesh(const std::string& path) {
+    auto data = make_shared<mesh_data>();
+    mapped_file& file = data->file;
+
+    auto fail = [&](const char* reason) {
+        std::cerr << "ERROR: Could not load mesh file '" << path << "' ("
+                  << reason << ").\n";
+        return nullptr;
+    };
+
+    if (!file.open(path))
+        return fail("cannot map file");
+
+    auto header = file.view<mesh_file_header>(0, 1);
+    if (header.empty())
+        return fail("truncated header");
+
+    const mesh_file_header& h = header[0];
+    if (memcmp(h.magic, mesh_file_magic, sizeof(h.magic)) != 0)
+        return fail("bad magic");
+    if (h.version != mesh_file_version)
+        return fail("unsupported version");
+
+    /* Counts larger than the file cannot be multiplied safely, and
+       are truncated anyway. */
+    if (h.vertex_count > file.size() || h.triangle_count > file.size() ||
+        h.node_count > file.size())
+        return fail("truncated buffers");
+
+    data->positions = file.view<float>(h.positions_offset, 3*h.vertex_count);
+    data->indices = file.view<uint32_t>(h.indices_offset, 3*h.triangle_count);
+    data->nodes = file.view<flat_node>(h.nodes_offset, h.node_count);
+
+    if (data->positions.size() != 3*h.vertex_count ||
+        data->indices.size() != 3*h.triangle_count ||
+        data->nodes.size() != h.node_count)
+        return fail("truncated buffers");
+
+    for (uint32_t index : data->indices)
+        if (index >= h.vertex_count)
+            return fail("bad vertex index");
+
+    if (h.node_count > 0) {
+        auto heights = flat_bvh_heights(data->nodes.data(), h.node_count,
+                                        h.triangle_count);
+        if (heights.empty() || heights[0] > flat_bvh_build::max_depth)
+            return fail("bad BVH");
+    }
+
+    return data;
+}
+
+/* Loads a mesh from PATH, choosing the parser by file extension. */
+shared_ptr<mesh_data> load_mesh_file(const std::string& path) {
+    auto ends_with = [&](const char* suffix) {
+        size_t n = strlen(suffix);
+        return path.size() >= n &&
+               path.compare(path.size() - n, n, suffix) == 0;
+    };
+
+    if (ends_with(".obj") || ends_with(".OBJ"))
+        return load_obj(path);
+
+    return load_mesh(path);
+}
+
+#endif
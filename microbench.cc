@@ -0,0 +1,253 @@
+#include "util.h"
+#include "scenes.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "camera.h"
+#include "compiled-scene.h"
+#include "perlin.h"
+#include "scene-pass.h"
+#include "texture.h"
+
+/*
+   Times the kernels the renderer spends its time in, each on its own,
+   so an optimization of one can be measured without the noise of a
+   whole render:
+
+       sphere, moving_sphere, aabb, xy/xz/yz_rect and bvh_node hits,
+       compiled_scene::hit, the scatter of each material,
+       image_texture::value, perlin noise and turbulence, and
+       camera::get_ray.
+
+   Each kernel runs over a set of rays, hit records or points made
+   from a fixed seed before timing, so every run does the same work.
+   The set is swept repeatedly in batches of about BATCH_MS
+   milliseconds, and the report gives the mean time per operation over
+   the batches with a 95% confidence interval (Student's t), and the
+   operations per second.
+
+   Usage: microbench [--batches n] [--batch-ms n] [filter]
+
+   where FILTER runs only the kernels whose names contain it. Run it
+   from the top of the repository, where the texture images are.
+*/
+
+namespace {
+
+const int set_size = 4096;
+const uint64_t bench_seed = 1;
+
+/* Keeps the results of the kernels alive, so no work is optimized away. */
+volatile double sink;
+
+struct bench_options {
+    int batches = 20;
+    double batch_ms = 20;
+    std::string filter;
+};
+
+/* Two-sided 95% quantiles of Student's t for 1 to 30 degrees of
+   freedom; beyond that the normal quantile is close enough. */
+double t_quantile(int df) {
+    static const double t[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+        2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+        2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+        2.048, 2.045, 2.042
+    };
+    return df <= 30 ? t[df - 1] : 1.960;
+}
+
+/* Times KERNEL(I) for I over [0, set_size) and prints its line of the
+   report. The number of sweeps per batch is found from a trial run. */
+template <typename Kernel>
+void bench(const bench_options& options, const char* name, Kernel kernel) {
+    if (!options.filter.empty() &&
+        std::string(name).find(options.filter) == std::string::npos)
+        return;
+
+    using clock = std::chrono::steady_clock;
+    auto sweep = [&](long sweeps) {
+        double sum = 0;
+        auto start = clock::now();
+        for (long s = 0; s < sweeps; s++)
+            for (int i = 0; i < set_size; i++)
+                sum += kernel(i);
+        std::chrono::duration<double, std::nano> elapsed =
+            clock::now() - start;
+        sink = sink + sum;
+        return elapsed.count();
+    };
+
+    /* Warm up caches and find the sweeps per batch. */
+    seed_random(bench_seed);
+    long sweeps = 1;
+    double trial;
+    while ((trial = sweep(sweeps)) < options.batch_ms * 1e5 &&
+           sweeps < (1L << 30))
+        sweeps *= 2;
+    sweeps = std::max(1L, long(sweeps * options.batch_ms * 1e6 / trial));
+
+    std::vector<double> ns_per_op;
+    for (int b = 0; b < options.batches; b++)
+        ns_per_op.push_back(sweep(sweeps) / (double(sweeps) * set_size));
+
+    double mean = 0, var = 0;
+    for (double x : ns_per_op)
+        mean += x;
+    mean /= ns_per_op.size();
+    for (double x : ns_per_op)
+        var += (x - mean) * (x - mean);
+    int n = static_cast<int>(ns_per_op.size());
+    double ci = n > 1 ? t_quantile(n - 1) * sqrt(var / (n - 1) / n) : 0;
+
+    printf("%-28s %10.2f %9.2f %7.1f%% %12.2f\n", name, mean, ci,
+           100 * ci / mean, 1e3 / mean);
+    fflush(stdout);
+}
+
+/* Returns a ray from a random point in a shell around the origin to a
+   random point in [-2, 2]^3, so about half of them hit the unit-sized
+   objects placed there. */
+ray random_ray() {
+    point3 from = 6 * random_unit_vector();
+    point3 to(random_double(-2, 2), random_double(-2, 2),
+              random_double(-2, 2));
+    return ray(from, to - from, random_double());
+}
+
+}
+
+int main(int argc, char** argv) {
+    bench_options options;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--batches") == 0 && a + 1 < argc)
+            options.batches = std::max(1, atoi(argv[++a]));
+        else if (strcmp(argv[a], "--batch-ms") == 0 && a + 1 < argc)
+            options.batch_ms = std::max(1.0, atof(argv[++a]));
+        else if (argv[a][0] == '-') {
+            fprintf(stderr, "Usage: %s [--batches n] [--batch-ms n] "
+                    "[filter]\n", argv[0]);
+            return 1;
+        }
+        else
+            options.filter = argv[a];
+    }
+
+    /* Build the data sets from a fixed seed. */
+    seed_random(bench_seed);
+    std::vector<ray> rays;
+    for (int i = 0; i < set_size; i++)
+        rays.push_back(random_ray());
+
+    scene_arena arena;
+    scene_setup setup;
+    select_scene(0, arena, setup);
+    collapse_transforms(setup.world);
+    compiled_scene compiled(setup.world, 0.0, 1.0);
+    camera cam = scene_camera(setup);
+
+    std::vector<ray> camera_rays;
+    std::vector<std::pair<double, double>> screen;
+    for (int i = 0; i < set_size; i++) {
+        screen.push_back({ random_double(), random_double() });
+        camera_rays.push_back(cam.get_ray(screen.back().first,
+                                          screen.back().second));
+    }
+
+    auto lambertian_mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    auto metal_mat = make_shared<metal>(color(0.7, 0.6, 0.5), 0.3);
+    auto dielectric_mat = make_shared<dielectric>(1.5);
+    auto light_mat = make_shared<diffuse_light>(color(4, 4, 4));
+
+    sphere ball(point3(0, 0, 0), 1, lambertian_mat);
+    moving_sphere moving_ball(point3(0, -0.25, 0), point3(0, 0.25, 0), 0, 1,
+                              1, lambertian_mat);
+    aabb box(point3(-1, -1, -1), point3(1, 1, 1));
+    xy_rect xy(-1, 1, -1, 1, 0, lambertian_mat);
+    xz_rect xz(-1, 1, -1, 1, 0, lambertian_mat);
+    yz_rect yz(-1, 1, -1, 1, 0, lambertian_mat);
+
+    /* Hits on the sphere, for the materials. */
+    std::vector<ray> hit_rays;
+    std::vector<hit_record> hits;
+    for (int i = 0; hits.size() < size_t(set_size); i++) {
+        ray r = random_ray();
+        hit_record rec;
+        if (!ball.hit(r, 0.001, infinity, rec))
+            continue;
+        rec.finalize(r);
+        hit_rays.push_back(r);
+        hits.push_back(rec);
+    }
+
+    std::vector<point3> points;
+    std::vector<std::pair<double, double>> uvs;
+    for (int i = 0; i < set_size; i++) {
+        points.push_back(point3(random_double(-10, 10),
+                                random_double(-10, 10),
+                                random_double(-10, 10)));
+        uvs.push_back({ random_double(), random_double() });
+    }
+
+    perlin noise;
+    image_texture earth("images/earthmap.jpeg");
+
+    printf("%-28s %10s %9s %8s %12s\n", "kernel", "ns/op", "+/-95%",
+           "", "Mops/s");
+
+    auto hit_test = [&](const hittable& object) {
+        return [&](int i) {
+            hit_record rec;
+            return object.hit(rays[i], 0.001, infinity, rec) ? rec.t : 0.0;
+        };
+    };
+    bench(options, "sphere::hit", hit_test(ball));
+    bench(options, "moving_sphere::hit", hit_test(moving_ball));
+    bench(options, "aabb::hit", [&](int i) {
+        return box.hit(rays[i], 0.001, infinity) ? 1.0 : 0.0;
+    });
+    bench(options, "xy_rect::hit", hit_test(xy));
+    bench(options, "xz_rect::hit", hit_test(xz));
+    bench(options, "yz_rect::hit", hit_test(yz));
+
+    bench(options, "bvh_node::hit (scene 0)", [&](int i) {
+        hit_record rec;
+        return setup.world.hit(camera_rays[i], 0.001, infinity, rec) ? rec.t
+                                                                     : 0.0;
+    });
+    bench(options, "compiled_scene::hit (0)", [&](int i) {
+        flat_hit h;
+        return compiled.hit(camera_rays[i], 0.001, infinity, h) ? h.t : 0.0;
+    });
+
+    auto scatter = [&](const material& m) {
+        return [&](int i) {
+            color attenuation;
+            ray scattered;
+            bool ok = m.scatter(hit_rays[i], hits[i], attenuation, scattered);
+            return ok ? scattered.direction().x() : 0.0;
+        };
+    };
+    bench(options, "lambertian::scatter", scatter(*lambertian_mat));
+    bench(options, "metal::scatter", scatter(*metal_mat));
+    bench(options, "dielectric::scatter", scatter(*dielectric_mat));
+    bench(options, "diffuse_light::scatter", scatter(*light_mat));
+
+    bench(options, "image_texture::value", [&](int i) {
+        return earth.value(uvs[i].first, uvs[i].second, points[i]).x();
+    });
+    bench(options, "perlin::noise", [&](int i) {
+        return noise.noise(points[i]);
+    });
+    bench(options, "perlin::turb", [&](int i) {
+        return noise.turb(points[i]);
+    });
+    bench(options, "camera::get_ray", [&](int i) {
+        return cam.get_ray(screen[i].first, screen[i].second).direction().x();
+    });
+}
@@ -0,0 +1,229 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "color.h"
+#include "util.h"
+
+/* Returns a table mapping each 8-bit sRGB value to its linear value. */
+inline const float* srgb_decode_table() {
+    struct table {
+        float values[256];
+        table() {
+            for (int i = 0; i < 256; i++)
+                values[i] = static_cast<float>(srgb_to_linear(i / 255.0));
+        }
+    };
+    static const table decode;
+    return decode.values;
+}
+
+/*
+   One level of a MIP pyramid. Texels are stored in square tiles of
+   mip_tile_size x mip_tile_size, each filling one 64-byte cache line,
+   with the tiles of a level in row-major order. A bilinear lookup
+   then usually touches a single tile.
+*/
+struct mip_level {
+    uint32_t width, height;  /* Size in texels. */
+    uint32_t tiles_x;        /* Tiles per row of tiles. */
+    uint32_t reserved;
+    uint64_t offset;         /* Byte offset of the first tile. */
+};
+
+const int mip_tile_size = 4;
+const int mip_texel_bytes = 4;  /* sRGB R, G, B and a padding byte. */
+const int mip_tile_bytes = mip_tile_size * mip_tile_size * mip_texel_bytes;
+
+/*
+   An image as a MIP pyramid of successively halved levels, each made
+   by box-filtering the one above in linear space. Texels stay 8-bit
+   sRGB and are decoded through srgb_decode_table().
+
+   Lookups are trilinear: bilinear within the two levels closest to
+   the footprint of the lookup, blended between them. Rows run from
+   the top of the image, and addressing clamps at the edges.
+*/
+class mip_pyramid {
+public:
+    mip_pyramid() : texels(nullptr) {}
+
+    mip_pyramid(const mip_pyramid&) = delete;
+    mip_pyramid& operator=(const mip_pyramid&) = delete;
+
+    /* Builds the pyramid from WIDTH x HEIGHT 8-bit RGB texels, stored
+       row by row from the top. Without MIPMAPS, only the full
+       resolution level is kept. */
+    void build(const unsigned char* rgb, int width, int height,
+               bool mipmaps = true);
+
+    /* Uses LEVELS with texels at TEXELS, stored elsewhere (e.g. in a
+       mapped file), without copying them. */
+    void attach(const std::vector<mip_level>& _levels,
+                const unsigned char* _texels) {
+        storage.clear();
+        levels = _levels;
+        texels = _texels;
+    }
+
+    bool empty() const { return levels.empty(); }
+    int width() const { return empty() ? 0 : levels[0].width; }
+    int height() const { return empty() ? 0 : levels[0].height; }
+
+    /* Bytes taken by the texels of every level. */
+    size_t memory_size() const {
+        if (empty())
+            return 0;
+        const mip_level& last = levels.back();
+        return last.offset + level_bytes(last.width, last.height);
+    }
+
+    /* Returns texel (X, Y) of LEVEL as a linear color. */
+    color texel(int level, int x, int y) const {
+        const mip_level& l = levels[level];
+        auto tile = (y / mip_tile_size) * l.tiles_x + x / mip_tile_size;
+        auto within = (y % mip_tile_size) * mip_tile_size + x % mip_tile_size;
+        auto t = texels + l.offset + static_cast<size_t>(tile) * mip_tile_bytes
+                 + within * mip_texel_bytes;
+
+        const float* decode = srgb_decode_table();
+        return color(decode[t[0]], decode[t[1]], decode[t[2]]);
+    }
+
+    /* Bilinearly interpolates LEVEL at S, T in [0, 1]. */
+    color bilinear(int level, double s, double t) const;
+
+    /* Filters the image at S, T in [0, 1] over a footprint WIDTH
+       texels of the full-resolution level wide. */
+    color lookup(double s, double t, double width) const;
+
+    /* Bytes taken by one level of WIDTH x HEIGHT texels. */
+    static size_t level_bytes(uint32_t width, uint32_t height) {
+        size_t tiles_x = (width + mip_tile_size - 1) / mip_tile_size;
+        size_t tiles_y = (height + mip_tile_size - 1) / mip_tile_size;
+        return tiles_x * tiles_y * mip_tile_bytes;
+    }
+
+public:
+    std::vector<mip_level> levels;  /* Full resolution first. */
+    const unsigned char* texels;    /* Tiles of all levels. */
+
+private:
+    std::vector<unsigned char> storage;  /* Texels, unless attached. */
+};
+
+void mip_pyramid::build(const unsigned char* rgb, int width, int height,
+                        bool mipmaps) {
+    levels.clear();
+
+    /* Lay out the levels down to a single texel. */
+    uint32_t w = width, h = height;
+    uint64_t offset = 0;
+    while (true) {
+        mip_level l;
+        l.width = w;
+        l.height = h;
+        l.tiles_x = (w + mip_tile_size - 1) / mip_tile_size;
+        l.reserved = 0;
+        l.offset = offset;
+        levels.push_back(l);
+        offset += level_bytes(w, h);
+
+        if (!mipmaps || (w == 1 && h == 1))
+            break;
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+    }
+
+    storage.assign(offset, 0);
+    texels = storage.data();
+
+    auto store = [&](int level, uint32_t x, uint32_t y, const float* c) {
+        const mip_level& l = levels[level];
+        auto tile = (y / mip_tile_size) * l.tiles_x + x / mip_tile_size;
+        auto within = (y % mip_tile_size) * mip_tile_size + x % mip_tile_size;
+        auto t = storage.data() + l.offset
+                 + static_cast<size_t>(tile) * mip_tile_bytes
+                 + within * mip_texel_bytes;
+        for (int i = 0; i < 3; i++) {
+            auto encoded = linear_to_srgb(clamp(c[i], 0.0, 1.0));
+            t[i] = static_cast<unsigned char>(255.0 * encoded + 0.5);
+        }
+    };
+
+    /* The full-resolution level keeps the original values, and each
+       smaller level averages 2x2 texels of the one above (clamping at
+       odd edges) in linear space. */
+    const float* decode = srgb_decode_table();
+    std::vector<float> above(3 * static_cast<size_t>(width) * height);
+    for (size_t i = 0; i < above.size(); i++)
+        above[i] = decode[rgb[i]];
+
+    for (uint32_t y = 0; y < levels[0].height; y++)
+        for (uint32_t x = 0; x < levels[0].width; x++)
+            store(0, x, y, &above[3 * (static_cast<size_t>(y) * width + x)]);
+
+    for (size_t level = 1; level < levels.size(); level++) {
+        const mip_level& src = levels[level-1];
+        const mip_level& dst = levels[level];
+        std::vector<float> below(3 * static_cast<size_t>(dst.width) * dst.height);
+
+        for (uint32_t y = 0; y < dst.height; y++) {
+            for (uint32_t x = 0; x < dst.width; x++) {
+                uint32_t x0 = std::min(2*x, src.width-1);
+                uint32_t x1 = std::min(2*x+1, src.width-1);
+                uint32_t y0 = std::min(2*y, src.height-1);
+                uint32_t y1 = std::min(2*y+1, src.height-1);
+                float* c = &below[3 * (static_cast<size_t>(y) * dst.width + x)];
+                for (int i = 0; i < 3; i++) {
+                    c[i] = 0.25f * (above[3*(y0*src.width + x0) + i] +
+                                    above[3*(y0*src.width + x1) + i] +
+                                    above[3*(y1*src.width + x0) + i] +
+                                    above[3*(y1*src.width + x1) + i]);
+                }
+                store(level, x, y, c);
+            }
+        }
+        above.swap(below);
+    }
+}
+
+color mip_pyramid::bilinear(int level, double s, double t) const {
+    const mip_level& l = levels[level];
+    int w = l.width, h = l.height;
+
+    /* Texel centers sit at half-integer positions. */
+    auto x = s * w - 0.5;
+    auto y = t * h - 0.5;
+    auto fx0 = floor(x), fy0 = floor(y);
+    auto fx = x - fx0, fy = y - fy0;
+
+    int x0 = static_cast<int>(fx0), y0 = static_cast<int>(fy0);
+    int x1 = std::min(std::max(x0 + 1, 0), w-1);
+    int y1 = std::min(std::max(y0 + 1, 0), h-1);
+    x0 = std::min(std::max(x0, 0), w-1);
+    y0 = std::min(std::max(y0, 0), h-1);
+
+    return (1-fy) * ((1-fx) * texel(level, x0, y0) + fx * texel(level, x1, y0))
+         + fy * ((1-fx) * texel(level, x0, y1) + fx * texel(level, x1, y1));
+}
+
+color mip_pyramid::lookup(double s, double t, double width) const {
+    int last = static_cast<int>(levels.size()) - 1;
+    if (width <= 1.0 || last == 0)
+        return bilinear(0, s, t);
+
+    /* Pick the levels whose texels are closest to the footprint. */
+    auto lod = std::min(log2(width), static_cast<double>(last));
+    int level = std::min(static_cast<int>(lod), last-1);
+    auto f = lod - level;
+
+    if (f <= 0)
+        return bilinear(level, s, t);
+    return (1-f) * bilinear(level, s, t) + f * bilinear(level+1, s, t);
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "aabb.h"
 #include "hittable.h"
+#include "sphere.h"
 #include "util.h"
 
 /*
@@ -20,6 +21,7 @@ public:
                      hit_record& rec) const override;
     virtual bool bounding_box(double _time0, double _time1,
                               aabb& output_box) const override;
+    virtual void get_surface(const ray& r, hit_record& rec) const override;
                     
     point3 center(double time) const;
 
@@ -36,42 +38,29 @@ point3 moving_sphere::center(double time) const {
     return center0 + ((time - time0) / (time1 - time0))*(center1 - center0);
 }
 
-/* Solve for ray-sphere intersection using substitution of the ray
-   equation for ray R into the equation of a sphere and applying
-   the quadratic formula. T_MIN and T_MAX dictate the interval for
-   a valid hit, and properties of the intersection point (if any)
-   are stored in REC. 
+/* Solve for ray-sphere intersection with hit_sphere(). T_MIN and
+   T_MAX dictate the interval for a valid hit, and the distance to
+   the intersection point (if any) is stored in REC.
    
    Since this is a moving sphere, use center(time) with the ray time
    to get the correct intersection (if any). */
 bool moving_sphere::hit(const ray& r, double t_min, double t_max,
                         hit_record& rec) const {
-    vec3 oc = r.origin() - center(r.time());
-    auto a = r.direction().length_squared();
-    auto half_b = dot(oc, r.direction());
-    auto c = oc.length_squared() - radius*radius;
-    
-    auto discriminant = half_b*half_b - a*c;
-    if (discriminant < 0)
+    double root;
+    if (!hit_sphere(center(r.time()), radius, r, t_min, t_max, root))
         return false;
 
-    /* Find closest point of intersection in range T_MIN to T_MAX. */
-    auto sqrtd = sqrt(discriminant);
-    auto root = (-half_b - sqrtd) / a;
-    if (root < t_min || t_max < root) {
-        root = (-half_b + sqrtd) / a;
-        if (root < t_min || t_max < root)
-            return false;
-    }
+    rec.set_hit(root, this);
+    return true;
+}
 
-    /* Store information about point of intersection in REC. */
-    rec.t = root;
+/* Store information about the point of intersection of ray R in
+   REC, using the center of the sphere at the time of the ray. */
+void moving_sphere::get_surface(const ray& r, hit_record& rec) const {
     rec.p = r.at(rec.t);
     vec3 outward_normal = (rec.p - center(r.time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat_ptr;
-
-    return true;
+    rec.mat_ptr = mat_ptr.get();
 }
 
 /* Constructs a bounding box for the moving sphere and stores it in
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "render-server.h"
+
+/* Renders several views of a scene in one process, e.g. the frames of
+   a turntable, a stereo pair or thumbnails at several sizes. Each
+   line of VIEWS is one view, in the options of parse_render_request():
+
+       scene=4 lookfrom=13,2,3 output=left.png
+       scene=4 lookfrom=13.3,2,3 output=right.png
+       scene=4 width=160 spp=4 output=thumb.png
+
+   with --scene as the default scene, and # starting a comment. The
+   views share one copy of each scene, its textures and BVH, and their
+   rows are handed out to one pool of workers (see render-server.h),
+   so every core stays busy until the last view is done.
+
+   Usage: multiview [--threads n] [--scene name] views.txt */
+int main(int argc, char** argv) {
+    int threads = 0;
+    std::string default_scene;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-' && argv[i][1] == '-'; i += 2) {
+        if (strcmp(argv[i], "--threads") == 0)
+            threads = atoi(argv[i+1]);
+        else if (strcmp(argv[i], "--scene") == 0)
+            default_scene = argv[i+1];
+        else {
+            i = argc;
+            break;
+        }
+    }
+
+    if (argc - i != 1) {
+        std::cerr << "Usage: " << argv[0] << " [--threads n] [--scene name] "
+                  << "views.txt\n";
+        return 1;
+    }
+
+    std::ifstream file(argv[i]);
+    if (!file) {
+        std::cerr << "ERROR: Could not open views file '" << argv[i] << "'.\n";
+        return 1;
+    }
+
+    std::vector<render_request> views;
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        render_request request;
+        request.scene = default_scene;
+        std::string error;
+        if (!parse_render_request(line, request, error)) {
+            std::cerr << "ERROR: " << argv[i] << ":" << number << ": "
+                      << error << ".\n";
+            return 1;
+        }
+        views.push_back(request);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    render_server server(threads);
+
+    /* Queue every view before any is rendered, so their rows share the
+       workers from the start. Views are kept until waited for, since
+       many may finish before their turn comes. */
+    std::vector<uint64_t> ids;
+    for (const auto& view : views) {
+        std::string error;
+        auto id = server.submit(view, error, true);
+        if (!id) {
+            std::cerr << "ERROR: " << view.output << ": " << error << ".\n";
+            return 1;
+        }
+        ids.push_back(id);
+    }
+
+    int failures = 0;
+    for (size_t v = 0; v < ids.size(); v++) {
+        auto outcome = server.wait(ids[v]);
+        if (outcome.compare(0, 5, "done ") != 0)
+            failures++;
+        std::cerr << views[v].output << ": " << outcome << "\n";
+    }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << ids.size() << " views in " << elapsed.count() << " s\n";
+    return failures ? 1 : 0;
+}
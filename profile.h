@@ -0,0 +1,326 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/*
+   Profiling counters for the render loop, compiled in only when
+   RENDER_PROFILE is defined (e.g. g++ -DRENDER_PROFILE main.cc).
+   Otherwise every PROFILE_ macro expands to nothing.
+
+   Each thread counts into its own block of counters, with no atomics
+   or locks, and the blocks are merged when the report is printed.
+   Counted are:
+
+       the calls to, and cycles spent in, each stage of a path:
+       intersection (BVH traversal included), surface shading,
+       scatter, texture lookups (made within scatter, and for
+       lights), and image output;
+
+       the BVH nodes visited and primitives tested;
+
+       histograms of path length (rays traced per path) and of how
+       each path ended: escaped to the background, stopped at a light,
+       absorbed, or cut off at the maximum depth.
+
+   Reading the cycle counter costs about as much as a primitive test,
+   so the stages are only counted and timed on one path in
+   timing_period, and scaled up in the report; on the other paths a
+   stage costs one test of a pointer, cached when the path begins.
+   The rays, BVH counts and path histograms are exact, for the paths
+   begun with PROFILE_PATH_BEGIN().
+*/
+
+#ifdef RENDER_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+enum profile_stage {
+    stage_intersect,
+    stage_surface,
+    stage_scatter,
+    stage_texture,
+    stage_output,
+    stage_count
+};
+
+enum profile_count {
+    count_bvh_nodes,
+    count_prim_tests,
+    count_count
+};
+
+enum path_end {
+    end_escaped,    /* Missed everything and took the background. */
+    end_light,      /* Stopped at a surface that emits. */
+    end_absorbed,   /* Stopped at a surface that emits nothing. */
+    end_max_depth,  /* Cut off at the maximum depth. */
+    end_count
+};
+
+/* The counters of one thread. */
+struct profile_data {
+    static const int max_path_length = 64;
+    static const uint64_t timing_period = 16;
+
+    uint64_t timed_calls[stage_count] = {};
+    uint64_t cycles[stage_count] = {};
+    uint64_t counts[count_count] = {};
+    uint64_t path_lengths[max_path_length + 1] = {};
+    uint64_t path_ends[end_count] = {};
+
+    uint64_t paths = 0;
+    uint64_t timed_paths = 0;
+    uint64_t rays = 0;
+    int max_depth = 0;  /* Of the current path. */
+
+    void merge(const profile_data& other);
+};
+
+void profile_data::merge(const profile_data& other) {
+    for (int s = 0; s < stage_count; s++) {
+        timed_calls[s] += other.timed_calls[s];
+        cycles[s] += other.cycles[s];
+    }
+    for (int c = 0; c < count_count; c++)
+        counts[c] += other.counts[c];
+    for (int l = 0; l <= max_path_length; l++)
+        path_lengths[l] += other.path_lengths[l];
+    for (int e = 0; e < end_count; e++)
+        path_ends[e] += other.path_ends[e];
+    paths += other.paths;
+    timed_paths += other.timed_paths;
+    rays += other.rays;
+}
+
+/* The blocks of the running threads, and the merged counts of the
+   threads that have finished. */
+struct profile_registry {
+    std::mutex mutex;
+    std::vector<profile_data*> live;
+    profile_data finished;
+
+    static profile_registry& global() {
+        static profile_registry registry;
+        return registry;
+    }
+};
+
+/* Registers the block of a thread for its lifetime. */
+struct profile_thread {
+    profile_data data;
+
+    profile_thread() {
+        auto& registry = profile_registry::global();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(&data);
+    }
+
+    ~profile_thread() {
+        auto& registry = profile_registry::global();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.finished.merge(data);
+        registry.live.erase(std::find(registry.live.begin(),
+                                      registry.live.end(), &data));
+    }
+};
+
+/* Returns the block of the calling thread. The block is reached
+   through a plain pointer, since a thread_local object with a
+   constructor is checked for construction on every access. */
+inline profile_data& profile_local() {
+    static thread_local profile_data* data = nullptr;
+    if (__builtin_expect(data == nullptr, 0)) {
+        static thread_local profile_thread thread;
+        data = &thread.data;
+    }
+    return *data;
+}
+
+/* The block of the calling thread, cached by profile_path_begin() so
+   that the counters within a path are reached with one load, and the
+   same block while the current path is timed, or nullptr. Both are
+   nullptr on a thread that has not begun a path. */
+inline thread_local profile_data* profile_path_data = nullptr;
+inline thread_local profile_data* profile_timed_data = nullptr;
+
+inline uint64_t profile_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/* Counts and times a call to STAGE if the path is timed. Output is
+   rare enough to be timed always, and is counted apart from paths. */
+class profile_scope {
+public:
+    profile_scope(profile_stage s)
+        : data(s == stage_output ? &profile_local() : profile_timed_data),
+          stage(s) {
+        if (__builtin_expect(data != nullptr, 0))
+            start = profile_ticks();
+    }
+
+    ~profile_scope() {
+        if (__builtin_expect(data != nullptr, 0)) {
+            data->cycles[stage] += profile_ticks() - start;
+            data->timed_calls[stage]++;
+        }
+    }
+
+private:
+    profile_data* data;
+    profile_stage stage;
+    uint64_t start;
+};
+
+/* Counts kept in local variables while a loop runs, and added to the
+   block of the current path by commit(). It has no destructor, which
+   would keep the counts in memory wherever the loop may throw. */
+struct profile_tally {
+    uint64_t n[count_count] = {};
+
+    void commit() const {
+        if (profile_data* data = profile_path_data)
+            for (int c = 0; c < count_count; c++)
+                data->counts[c] += n[c];
+    }
+};
+
+/* Records the start of a path traced to at most MAX_DEPTH rays, and
+   picks whether it is timed. */
+inline void profile_path_begin(int max_depth) {
+    profile_data& data = profile_local();
+    data.max_depth = max_depth;
+    profile_path_data = &data;
+    profile_timed_data =
+        data.paths % profile_data::timing_period == 0 ? &data : nullptr;
+}
+
+/* Records the end of the current path at DEPTH (see ray_color()),
+   where its last ray was traced, or where the depth ran out. */
+inline void profile_path_end(path_end end, int depth) {
+    profile_data* data = profile_path_data;
+    if (!data)
+        return;
+    int rays = data->max_depth - depth + (depth > 0);
+    data->path_lengths[std::min(rays, profile_data::max_path_length)]++;
+    data->path_ends[end]++;
+    data->rays += rays;
+    data->timed_paths += profile_timed_data != nullptr;
+    data->paths++;
+    profile_timed_data = nullptr;
+}
+
+/* Merges the counters of every thread and prints them to OUT. The
+   threads should be idle. */
+void profile_report(std::ostream& out) {
+    auto& registry = profile_registry::global();
+    profile_data total;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        total.merge(registry.finished);
+        for (const auto* data : registry.live)
+            total.merge(*data);
+    }
+
+    static const char* stage_names[stage_count] = {
+        "intersect", "surface", "scatter", "texture", "output"
+    };
+    static const char* end_names[end_count] = {
+        "escaped", "light", "absorbed", "max depth"
+    };
+    char line[160];
+
+    /* The calls and cycles of the path stages are scaled up from the
+       timed paths; output is always timed. */
+    double scale = total.timed_paths
+        ? double(total.paths) / total.timed_paths : 0;
+    double calls[stage_count], estimated[stage_count], path_cycles = 0;
+    for (int s = 0; s < stage_count; s++) {
+        double k = s == stage_output ? 1 : scale;
+        calls[s] = k * total.timed_calls[s];
+        estimated[s] = k * total.cycles[s];
+        if (s != stage_texture && s != stage_output)
+            path_cycles += estimated[s];
+    }
+
+    out << "\nProfile (" << total.paths << " paths)\n";
+    snprintf(line, sizeof(line), "  %-10s %14s %14s %10s %7s\n", "stage",
+             "calls", "Mcycles", "cyc/call", "share");
+    out << line;
+    for (int s = 0; s < stage_count; s++) {
+        double per_call = calls[s] ? estimated[s] / calls[s] : 0;
+        snprintf(line, sizeof(line), "  %-10s %14.0f %14.1f %10.1f %6.1f%%\n",
+                 stage_names[s], calls[s], estimated[s] / 1e6, per_call,
+                 s == stage_output || path_cycles == 0
+                     ? 0.0 : 100 * estimated[s] / path_cycles);
+        out << line;
+    }
+    out << "  (texture is part of scatter; shares are of the path stages, "
+           "estimated from 1 path in " << profile_data::timing_period << ")\n";
+
+    double rays = double(total.rays);
+    if (rays > 0) {
+        snprintf(line, sizeof(line), "  Rays %.0f, %.2f per path\n", rays,
+                 rays / total.paths);
+        out << line;
+        snprintf(line, sizeof(line),
+                 "  BVH nodes per ray %.2f, primitive tests per ray %.2f\n",
+                 total.counts[count_bvh_nodes] / rays,
+                 total.counts[count_prim_tests] / rays);
+        out << line;
+    }
+
+    if (total.paths == 0)
+        return;
+    out << "  Path ends:";
+    for (int e = 0; e < end_count; e++) {
+        snprintf(line, sizeof(line), " %s %.1f%%", end_names[e],
+                 100.0 * total.path_ends[e] / total.paths);
+        out << line << (e + 1 < end_count ? "," : "\n");
+    }
+    out << "  Path lengths:\n";
+    for (int l = 0; l <= profile_data::max_path_length; l++) {
+        if (!total.path_lengths[l])
+            continue;
+        double share = 100.0 * total.path_lengths[l] / total.paths;
+        snprintf(line, sizeof(line), "    %3d%s %6.2f%% %s\n", l,
+                 l == profile_data::max_path_length ? "+" : " ", share,
+                 std::string(static_cast<int>(share / 2), '#').c_str());
+        out << line;
+    }
+}
+
+#define PROFILE_SCOPE(stage) profile_scope profile_scope_(stage)
+#define PROFILE_TALLY(name) profile_tally name
+#define PROFILE_ADD(name, counter, k) (name.n[counter] += (k))
+#define PROFILE_COMMIT(name) name.commit()
+#define PROFILE_PATH_BEGIN(max_depth) profile_path_begin(max_depth)
+#define PROFILE_PATH_END(end, depth) profile_path_end(end, depth)
+#define PROFILE_REPORT(out) profile_report(out)
+
+#else
+
+#define PROFILE_SCOPE(stage)
+#define PROFILE_TALLY(name)
+#define PROFILE_ADD(name, counter, k)
+#define PROFILE_COMMIT(name)
+#define PROFILE_PATH_BEGIN(max_depth)
+#define PROFILE_PATH_END(end, depth)
+#define PROFILE_REPORT(out)
+
+#endif
+
+#endif
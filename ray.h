@@ -6,6 +6,12 @@
 /*
    A ray class for computing the color seen along a particular ray.
    Rays are represented as an origin ORIG and a direction DIR.
+
+   Camera rays may also carry ray differentials: two offset rays
+   through the neighboring pixels in x and y. Where a ray hits a
+   surface, the offset rays give the footprint of one pixel on it,
+   which textures use to pick how much to filter. Rays without
+   differentials (e.g. scattered rays) have a point footprint.
 */
 class ray {
 public:
@@ -19,10 +25,32 @@ public:
     
     point3 at(double t) const { return orig + t*dir; }
 
+    /* Attaches the offset rays through the neighboring pixels. */
+    void set_differentials(const point3& _rx_origin, const vec3& _rx_direction,
+                           const point3& _ry_origin, const vec3& _ry_direction) {
+        has_differentials = true;
+        rx_origin = _rx_origin;
+        rx_direction = _rx_direction;
+        ry_origin = _ry_origin;
+        ry_direction = _ry_direction;
+    }
+
 public:
     point3 orig;  /* Ray origin. */
     vec3 dir;     /* Ray direction. */
     double tm;    /* Time at which the ray exists. */
+
+    bool has_differentials = false;  /* True if the offset rays are set. */
+    point3 rx_origin, ry_origin;     /* Origins of the offset rays. */
+    vec3 rx_direction, ry_direction; /* Directions of the offset rays. */
+};
+
+/* Derivatives of the texture coordinates U, V across one pixel in
+   screen x and y, i.e. the footprint of a pixel in texture space.
+   All zero means a point footprint. */
+struct texture_footprint {
+    double dudx = 0, dvdx = 0;
+    double dudy = 0, dvdy = 0;
 };
 
 #endif
@@ -0,0 +1,489 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "camera.h"
+#include "compiled-scene.h"
+#include "framebuffer.h"
+#include "image-io.h"
+#include "integrator.h"
+#include "scene-io.h"
+#include "scene-pass.h"
+#include "scenes.h"
+
+/*
+   A long-running renderer that keeps scenes warm between jobs (see
+   renderd.cc). Each scene is built, compiled and has its textures
+   decoded once, then shared by every job that renders it. Jobs run on
+   one pool of worker threads, which take short bands of rows from the
+   job with the least work left, so a small preview overtakes a long
+   render and finishes in milliseconds; the long render continues once
+   no smaller job waits. A job can be cancelled at any time; its
+   workers stop at the end of the row they are on.
+
+   Jobs render exactly as main does with the same settings and seed.
+*/
+
+/* What a job renders. Zero (or a negative aperture) keeps the value
+   the scene sets. */
+struct render_request {
+    std::string scene;          /* Scene index, or path of a scene file. */
+    std::string output;         /* Image path, in the format of its extension. */
+    int width = 0;
+    int height = 0;             /* 0 keeps the scene's aspect ratio. */
+    int samples_per_pixel = 0;
+    int max_depth = 50;
+    uint64_t seed = 0;
+    bool set_lookfrom = false, set_lookat = false;
+    point3 lookfrom, lookat;
+    double vfov = 0;
+    double aperture = -1;
+};
+
+/* Parses the KEY=VALUE words of LINE into REQUEST, e.g.
+       scene=4 width=200 spp=4 output=preview.png lookfrom=13,2,3
+   Other keys are depth, seed, height, lookat, vfov and aperture.
+   Returns false with a message in ERROR if a word is not understood. */
+bool parse_render_request(const std::string& line, render_request& request,
+                          std::string& error) {
+    std::istringstream words(line);
+    std::string word;
+    while (words >> word) {
+        auto equals = word.find('=');
+        if (equals == std::string::npos) {
+            error = "expected key=value: " + word;
+            return false;
+        }
+        std::string key = word.substr(0, equals);
+        std::string value = word.substr(equals + 1);
+        const char* v = value.c_str();
+
+        auto parse_point = [&](point3& p) {
+            double x, y, z;
+            char rest;
+            if (sscanf(v, "%lf,%lf,%lf%c", &x, &y, &z, &rest) != 3)
+                return false;
+            p = point3(x, y, z);
+            return true;
+        };
+
+        bool ok = true;
+        if (key == "scene")
+            request.scene = value;
+        else if (key == "output")
+            request.output = value;
+        else if (key == "width")
+            ok = (request.width = atoi(v)) > 0;
+        else if (key == "height")
+            ok = (request.height = atoi(v)) > 0;
+        else if (key == "spp")
+            ok = (request.samples_per_pixel = atoi(v)) > 0;
+        else if (key == "depth")
+            ok = (request.max_depth = atoi(v)) > 0;
+        else if (key == "seed")
+            request.seed = strtoull(v, nullptr, 10);
+        else if (key == "lookfrom")
+            ok = request.set_lookfrom = parse_point(request.lookfrom);
+        else if (key == "lookat")
+            ok = request.set_lookat = parse_point(request.lookat);
+        else if (key == "vfov")
+            ok = (request.vfov = atof(v)) > 0;
+        else if (key == "aperture")
+            ok = (request.aperture = atof(v)) >= 0;
+        else
+            ok = false;
+
+        if (!ok) {
+            error = "bad option: " + word;
+            return false;
+        }
+    }
+
+    if (request.scene.empty() || request.output.empty() ||
+        request.output == "-") {
+        error = "scene and output (a file) are required";
+        return false;
+    }
+    return true;
+}
+
+/* A scene held ready for rendering. */
+struct warm_scene {
+    scene_arena arena;                  /* Owns the objects of built scenes. */
+    scene_setup setup;
+    shared_ptr<compiled_scene> scene;
+};
+
+class render_server {
+public:
+    enum job_state { job_queued, job_running, job_done, job_cancelled,
+                     job_failed };
+
+    /* Starts THREADS workers (0 for one per hardware thread). */
+    render_server(int threads = 0);
+    ~render_server();
+
+    render_server(const render_server&) = delete;
+    render_server& operator=(const render_server&) = delete;
+
+    /* Returns the scene named NAME (an index for select_scene() or a
+       scene file path), building or loading it on first use. Returns
+       nullptr with a message in ERROR if there is no such scene. */
+    shared_ptr<const warm_scene> scene(const std::string& name,
+                                       std::string& error);
+
+    /* Queues a job for REQUEST and returns its ID, or 0 with a message
+       in ERROR if it names no scene. A KEPT job is remembered once
+       finished until wait() collects it, however many jobs finish
+       after it; other jobs are forgotten among the oldest finished. */
+    uint64_t submit(const render_request& request, std::string& error,
+                    bool kept = false);
+
+    /* Cancels job ID. Returns false if no such job is queued or
+       running. */
+    bool cancel(uint64_t id);
+
+    /* Waits until job ID is finished and returns a line describing
+       the outcome, e.g. "done 7 12.5 ms". A kept job is forgotten once
+       its outcome is returned. */
+    std::string wait(uint64_t id);
+
+    /* Returns one line per known job, e.g. "7 running 120/225 4". */
+    std::string status();
+
+    /* Returns the names of the warm scenes, one per line. */
+    std::string scenes();
+
+    /* Cancels every job and refuses new ones. Jobs being rendered stop
+       at the end of their current rows. */
+    void stop();
+
+private:
+    struct job {
+        job(const camera& c) : cam(c) {}
+
+        uint64_t id;
+        render_request request;
+        shared_ptr<const warm_scene> warm;
+        camera cam;
+        int width, height, samples_per_pixel;
+        bool kept;
+        shared_ptr<framebuffer> image;  /* Made when the first band starts. */
+        std::once_flag image_made;
+
+        job_state state;
+        int next_row;    /* First row not handed to a worker. */
+        int rows_done;
+        int workers;     /* Workers rendering or writing this job. */
+        std::atomic<bool> cancelled;
+        std::string message;  /* Outcome, once finished. */
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /* Samples a worker takes from a job at a time (at least a row),
+       which bounds how long a new job waits for a free worker. */
+    static const long band_samples = 1 << 16;
+
+    /* Finished jobs, other than kept ones, remembered for wait() and
+       status(). */
+    static const size_t finished_kept = 64;
+
+    void work();
+    void render_band(const job& j, int y0, int y1);
+    void finish(job& j, job_state state, const std::string& message);
+
+    std::mutex scene_mutex;  /* Held while a scene is built or loaded. */
+    std::map<std::string, shared_ptr<const warm_scene>> warm;
+
+    std::mutex mutex;
+    std::condition_variable work_ready;  /* Signals rows to render or stopping. */
+    std::condition_variable job_finished;
+    std::map<uint64_t, shared_ptr<job>> jobs;
+    std::vector<uint64_t> active;   /* Jobs with rows left to hand out. */
+    std::deque<uint64_t> finished;  /* Finished jobs not kept, oldest first. */
+    uint64_t next_id;
+    bool stopping;
+    std::vector<std::thread> workers;
+};
+
+render_server::render_server(int threads) : next_id(1), stopping(false) {
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back([this]() { work(); });
+}
+
+render_server::~render_server() {
+    stop();
+    for (auto& w : workers)
+        w.join();
+}
+
+void render_server::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        active.clear();
+        for (auto& entry : jobs) {
+            job& j = *entry.second;
+            if (j.state != job_queued && j.state != job_running)
+                continue;
+            j.cancelled = true;
+            if (j.workers == 0)
+                finish(j, job_cancelled, "cancelled " + std::to_string(j.id));
+        }
+    }
+    work_ready.notify_all();
+}
+
+shared_ptr<const warm_scene> render_server::scene(const std::string& name,
+                                                  std::string& error) {
+    std::lock_guard<std::mutex> lock(scene_mutex);
+    auto found = warm.find(name);
+    if (found != warm.end())
+        return found->second;
+
+    auto w = make_shared<warm_scene>();
+    bool is_index = !name.empty() &&
+        name.find_first_not_of("0123456789") == std::string::npos;
+    if (is_index) {
+        /* Scenes placing objects at random start from the sequence a
+           fresh process has, so they match main's. */
+        thread_random() = random_generator();
+        if (!select_scene(atoi(name.c_str()), w->arena, w->setup)) {
+            error = "no scene " + name;
+            return nullptr;
+        }
+        collapse_transforms(w->setup.world);
+        w->scene = make_shared<compiled_scene>(w->setup.world, 0.0, 1.0);
+    }
+    else if (!(w->scene = load_scene(name, w->setup))) {
+        error = "cannot load scene file " + name;
+        return nullptr;
+    }
+
+    /* Decode image textures now rather than in the first job. */
+    for (const auto& t : w->scene->textures)
+        if (t.kind == tex_image)
+            t.ptr->value(0, 0, point3());
+
+    warm[name] = w;
+    return w;
+}
+
+uint64_t render_server::submit(const render_request& request,
+                               std::string& error, bool kept) {
+    auto w = scene(request.scene, error);
+    if (!w)
+        return 0;
+
+    scene_setup setup;
+    setup.lookfrom = request.set_lookfrom ? request.lookfrom : w->setup.lookfrom;
+    setup.lookat = request.set_lookat ? request.lookat : w->setup.lookat;
+    setup.vfov = request.vfov > 0 ? request.vfov : w->setup.vfov;
+    setup.aperture = request.aperture >= 0 ? request.aperture
+                                           : w->setup.aperture;
+    int width = request.width ? request.width : w->setup.image_width;
+    int height = request.height
+        ? request.height
+        : static_cast<int>(width / w->setup.aspect_ratio);
+    setup.aspect_ratio = request.height
+        ? static_cast<double>(width) / height : w->setup.aspect_ratio;
+    if (width < 2 || height < 2) {
+        error = "image too small";
+        return 0;
+    }
+
+    auto j = make_shared<job>(scene_camera(setup));
+    j->request = request;
+    j->warm = w;
+    j->width = width;
+    j->height = height;
+    j->samples_per_pixel = request.samples_per_pixel
+        ? request.samples_per_pixel : w->setup.samples_per_pixel;
+    j->kept = kept;
+
+    j->state = job_queued;
+    j->next_row = j->rows_done = j->workers = 0;
+    j->cancelled = false;
+    j->start = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            error = "server stopping";
+            return 0;
+        }
+        j->id = next_id++;
+        jobs[j->id] = j;
+        active.push_back(j->id);
+    }
+    work_ready.notify_all();
+    return j->id;
+}
+
+bool render_server::cancel(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = jobs.find(id);
+    if (found == jobs.end())
+        return false;
+
+    job& j = *found->second;
+    if (j.state != job_queued && j.state != job_running)
+        return false;
+
+    j.cancelled = true;
+    active.erase(std::remove(active.begin(), active.end(), id), active.end());
+    if (j.workers == 0)
+        finish(j, job_cancelled, "cancelled " + std::to_string(id));
+    return true;
+}
+
+std::string render_server::wait(uint64_t id) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto found = jobs.find(id);
+    if (found == jobs.end())
+        return "error unknown job " + std::to_string(id);
+
+    auto j = found->second;
+    job_finished.wait(lock, [&]() {
+        return j->state != job_queued && j->state != job_running;
+    });
+    if (j->kept)
+        jobs.erase(id);
+    return j->message;
+}
+
+std::string render_server::status() {
+    static const char* names[] = { "queued", "running", "done", "cancelled",
+                                   "failed" };
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string lines;
+    for (const auto& entry : jobs) {
+        const job& j = *entry.second;
+        lines += std::to_string(j.id) + " " + names[j.state] + " "
+               + std::to_string(j.rows_done) + "/" + std::to_string(j.height)
+               + " " + j.request.scene + "\n";
+    }
+    return lines;
+}
+
+std::string render_server::scenes() {
+    std::lock_guard<std::mutex> lock(scene_mutex);
+    std::string lines;
+    for (const auto& entry : warm)
+        lines += entry.first + "\n";
+    return lines;
+}
+
+/* Takes bands of rows from the job with the least work left and
+   renders them, until the server stops. */
+void render_server::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [this]() { return stopping || !active.empty(); });
+        if (stopping)
+            return;
+
+        auto remaining = [this](uint64_t id) {
+            const job& j = *jobs[id];
+            return static_cast<long>(j.height - j.next_row) * j.width
+                   * j.samples_per_pixel;
+        };
+        auto next = std::min_element(active.begin(), active.end(),
+            [&](uint64_t a, uint64_t b) { return remaining(a) < remaining(b); });
+        auto j = jobs[*next];
+
+        long row_samples = static_cast<long>(j->width) * j->samples_per_pixel;
+        int rows = static_cast<int>(std::max(1L, band_samples / row_samples));
+        int y0 = j->next_row;
+        int y1 = std::min(y0 + rows, j->height);
+        j->next_row = y1;
+        if (y1 == j->height)
+            active.erase(next);
+        j->state = job_running;
+        j->workers++;
+
+        /* Queued jobs hold no image, so a long queue costs no memory
+           until its jobs are rendered. Other workers starting on the
+           job wait here until the image is made. */
+        lock.unlock();
+        std::call_once(j->image_made, [&]() {
+            j->image = make_shared<framebuffer>(j->width, j->height);
+        });
+        render_band(*j, y0, y1);
+        lock.lock();
+
+        j->workers--;
+        if (!j->cancelled)
+            j->rows_done += y1 - y0;
+
+        if (j->workers > 0 || j->state != job_running)
+            continue;
+        if (j->cancelled)
+            finish(*j, job_cancelled, "cancelled " + std::to_string(j->id));
+        else if (j->rows_done == j->height) {
+            /* Write the image without holding up the other workers. The
+               job counts as worked on, so it is not finished meanwhile. */
+            j->workers++;
+            lock.unlock();
+            bool ok = write_image(*j->image, j->request.output);
+            std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - j->start;
+            lock.lock();
+            j->workers--;
+            if (ok)
+                finish(*j, job_done, "done " + std::to_string(j->id) + " "
+                       + std::to_string(elapsed.count()) + " ms");
+            else
+                finish(*j, job_failed, "error " + std::to_string(j->id)
+                       + " cannot write " + j->request.output);
+        }
+    }
+}
+
+/* Renders rows [Y0, Y1) of job J, counting rows from the top, unless
+   it is cancelled. Bands never overlap, so no lock is needed. */
+void render_server::render_band(const job& j, int y0, int y1) {
+    const warm_scene& w = *j.warm;
+    for (int y = y0; y < y1; y++) {
+        if (j.cancelled)
+            return;
+        for (int x = 0; x < j.width; x++) {
+            color sum(0, 0, 0);
+            for (int s = 0; s < j.samples_per_pixel; s++)
+                sum += trace_sample(*w.scene, j.cam, w.setup.background,
+                                    j.width, j.height, j.request.max_depth,
+                                    j.request.seed, x, j.height-1-y, s);
+            j.image->add(x, y, sum, j.samples_per_pixel);
+        }
+    }
+}
+
+/* Records the outcome of job J and forgets the oldest finished jobs
+   that are not kept. Called with the lock held. */
+void render_server::finish(job& j, job_state state, const std::string& message) {
+    j.state = state;
+    j.message = message;
+    j.image.reset();
+    if (!j.kept)
+        finished.push_back(j.id);
+    while (finished.size() > finished_kept) {
+        jobs.erase(finished.front());
+        finished.pop_front();
+    }
+    job_finished.notify_all();
+}
+
+#endif
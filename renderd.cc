@@ -0,0 +1,255 @@
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include "render-server.h"
+
+/* A render daemon keeping scenes warm between jobs (see
+   render-server.h), taking commands over a Unix socket, one per line:
+
+       render KEY=VALUE...   queue a job (see parse_render_request());
+                             replies "queued ID"
+       wait ID               replies when job ID finishes, e.g.
+                             "done ID 12.5 ms" or "cancelled ID"
+       cancel ID             replies "ok"
+       status                one line per job, then "end"
+       scenes                one line per warm scene, then "end"
+       shutdown              cancels every job and exits
+
+   Errors reply "error MESSAGE". For example, with socat:
+
+       echo "render scene=4 width=200 spp=4 output=a.png" | socat - UNIX:sock
+
+   Usage: renderd [--threads n] [--preload scene,...] socket_path */
+
+/* SIGPIPE is ignored, so sends that lack MSG_NOSIGNAL (macOS) are
+   safe without it. */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+
+/* The open client connections, closed on shutdown. */
+struct connection_set {
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::set<int> fds;
+};
+
+bool send_line(int fd, const std::string& line) {
+    std::string text = line + "\n";
+    const char* p = text.data();
+    size_t left = text.size();
+    while (left > 0) {
+        auto sent = send(fd, p, left, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        p += sent;
+        left -= sent;
+    }
+    return true;
+}
+
+/* Runs COMMAND and returns its reply. Sets SHUTDOWN for "shutdown". */
+std::string run_command(render_server& server, const std::string& command,
+                        bool& shutdown) {
+    std::istringstream words(command);
+    std::string verb;
+    words >> verb;
+    std::string rest;
+    std::getline(words, rest);
+
+    if (verb == "render") {
+        render_request request;
+        std::string error;
+        if (!parse_render_request(rest, request, error))
+            return "error " + error;
+        auto id = server.submit(request, error);
+        return id ? "queued " + std::to_string(id) : "error " + error;
+    }
+    if (verb == "wait" || verb == "cancel") {
+        uint64_t id = strtoull(rest.c_str(), nullptr, 10);
+        if (verb == "wait")
+            return server.wait(id);
+        return server.cancel(id) ? "ok" : "error no active job " + rest;
+    }
+    if (verb == "status")
+        return server.status() + "end";
+    if (verb == "scenes")
+        return server.scenes() + "end";
+    if (verb == "shutdown") {
+        shutdown = true;
+        return "ok";
+    }
+    return "error unknown command " + verb;
+}
+
+/* Answers the commands sent on FD until the client closes it. A
+   "shutdown" writes to STOP_FD, the self-pipe that ends the accept
+   loop. */
+void serve(render_server& server, int fd, int stop_fd,
+           connection_set& connections) {
+    std::string buffer;
+    char chunk[4096];
+    bool open = true;
+    while (open) {
+        auto got = read(fd, chunk, sizeof(chunk));
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        buffer.append(chunk, got);
+
+        size_t newline;
+        while (open && (newline = buffer.find('\n')) != std::string::npos) {
+            std::string command = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (!command.empty() && command.back() == '\r')
+                command.pop_back();
+            if (command.empty())
+                continue;
+
+            bool shutdown = false;
+            open = send_line(fd, run_command(server, command, shutdown));
+            if (shutdown)
+                while (write(stop_fd, "x", 1) < 0 && errno == EINTR) {}
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(connections.mutex);
+    connections.fds.erase(fd);
+    close(fd);
+    connections.idle.notify_all();
+}
+
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    std::string preload;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-' && argv[i][1] == '-'; i += 2) {
+        if (strcmp(argv[i], "--threads") == 0)
+            threads = atoi(argv[i+1]);
+        else if (strcmp(argv[i], "--preload") == 0)
+            preload = argv[i+1];
+        else {
+            i = argc;
+            break;
+        }
+    }
+
+    if (argc - i != 1) {
+        std::cerr << "Usage: " << argv[0] << " [--threads n] "
+                  << "[--preload scene,...] socket_path\n";
+        return 1;
+    }
+    std::string path = argv[i];
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "ERROR: Socket path '" << path << "' is too long.\n";
+        return 1;
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    render_server server(threads);
+
+    /* Build the preloaded scenes before taking jobs. */
+    std::istringstream names(preload);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        std::string error;
+        auto start = std::chrono::steady_clock::now();
+        if (!server.scene(name, error)) {
+            std::cerr << "ERROR: " << error << ".\n";
+            return 1;
+        }
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cerr << "Scene " << name << " warm in " << elapsed.count()
+                  << " ms\n";
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (listener < 0 ||
+        bind(listener, reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) != 0 ||
+        listen(listener, 16) != 0) {
+        std::cerr << "ERROR: Could not listen on '" << path << "': "
+                  << strerror(errno) << ".\n";
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cerr << "Listening on " << path << "\n";
+
+    /* Accept connections until "shutdown" writes to the self-pipe.
+       Shutting down the listener itself would only wake accept() on
+       Linux. */
+    int stop_pipe[2];
+    if (pipe(stop_pipe) != 0) {
+        std::cerr << "ERROR: Could not create pipe: " << strerror(errno)
+                  << ".\n";
+        return 1;
+    }
+
+    connection_set connections;
+    while (true) {
+        pollfd waiting[2] = { { listener, POLLIN, 0 },
+                              { stop_pipe[0], POLLIN, 0 } };
+        if (poll(waiting, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (waiting[1].revents)
+            break;
+        if (!waiting[0].revents)
+            continue;
+
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0 && (errno == EINTR || errno == ECONNABORTED))
+            continue;
+        if (fd < 0)
+            break;
+
+        std::lock_guard<std::mutex> lock(connections.mutex);
+        connections.fds.insert(fd);
+        std::thread([&, fd]() {
+            serve(server, fd, stop_pipe[1], connections);
+        }).detach();
+    }
+
+    /* Shut down: cancel the jobs, which answers any waits, then close
+       the connections and wait for their threads. */
+    std::cerr << "Shutting down\n";
+    server.stop();
+    {
+        std::unique_lock<std::mutex> lock(connections.mutex);
+        for (int fd : connections.fds)
+            shutdown(fd, SHUT_RDWR);
+        connections.idle.wait(lock, [&]() { return connections.fds.empty(); });
+    }
+    close(listener);
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    unlink(path.c_str());
+    return 0;
+}
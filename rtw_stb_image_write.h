@@ -0,0 +1,26 @@
+#ifndef UTIL_STB_IMAGE_WRITE_H
+#define UTIL_STB_IMAGE_WRITE_H
+
+/* stb_image_write is used when external/stb_image_write.h (upstream
+   v1.16, http://nothings.org/stb) is present. Without it, image-io.h
+   writes PNGs uncompressed. */
+#if __has_include("external/stb_image_write.h")
+
+#define RTW_HAVE_STB_IMAGE_WRITE 1
+
+/* Disable pedantic warnings for the external library. */
+#ifdef _MSC_VER
+    #pragma warning (push, 0)
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "external/stb_image_write.h"
+
+/* Restore warning levels. */
+#ifdef _MSC_VER
+    #pragma warning (pop)
+#endif
+
+#endif
+
+#endif
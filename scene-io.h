@@ -0,0 +1,456 @@
+#ifndef SCENE_IO_H
+#define SCENE_IO_H
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "compiled-scene.h"
+#include "mapped-file.h"
+#include "scenes.h"
+
+/*
+   Saving and loading of compiled scenes with their camera, so scenes
+   need not be built by code on every run. The primitive, BVH node,
+   instance and material arrays are stored exactly as they are laid
+   out in memory, and a loaded scene renders straight from the mapped
+   file without allocating anything per object. Only the texture
+   program is rebuilt on load, since noise and image textures are
+   objects: noise textures use gradient tables mapped from the file,
+   and image textures refer to their image by path.
+
+   Scenes holding user-defined objects (external primitives,
+   materials or textures) or baked textures cannot be saved.
+
+   Binary scene layout (little-endian):
+       scene_file_header
+       flat_primitive      prims[prim_count]          at prims_offset
+       flat_node           nodes[node_count]          at nodes_offset
+       flat_instance       instances[instance_count]  at instances_offset
+       flat_material       materials[material_count]  at materials_offset
+       scene_file_texture  textures[texture_count]    at textures_offset
+       perlin::tables      noise[noise_count]         at noise_offset
+       char                strings[strings_size]      at strings_offset
+   Strings are image paths, each ending in a NUL.
+*/
+
+const char scene_file_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', 0 };
+const uint32_t scene_file_version = 1;
+
+/* The camera and image parameters of a scene_setup. */
+struct scene_file_camera {
+    double lookfrom[3], lookat[3];
+    double vfov, aperture, aspect_ratio;
+    double background[3];
+    int32_t image_width, samples_per_pixel;
+};
+
+struct scene_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t root;          /* Root node of the whole scene. */
+    uint32_t record_sizes[4];  /* Of prims, nodes, instances, materials. */
+    double time0, time1;    /* Time span the primitive bounds cover. */
+    scene_file_camera camera;
+    uint64_t prim_count, node_count, instance_count;
+    uint64_t material_count, texture_count, noise_count, strings_size;
+    uint64_t prims_offset, nodes_offset, instances_offset;
+    uint64_t materials_offset, textures_offset, noise_offset, strings_offset;
+};
+
+/* An instruction of the texture program (see flat_texture), with the
+   data to make its texture object in place of a pointer. */
+struct scene_file_texture {
+    uint32_t kind;       /* A texture_kind. */
+    uint32_t even, odd;  /* Branch targets of a checker. */
+    uint32_t resource;   /* Noise tables (noise) or path offset (image). */
+    double value[3];     /* Color of a solid texture. */
+    double scale;        /* Frequency scale of a noise texture. */
+    int32_t perlin_type; /* Variation of a noise texture. */
+    uint32_t reserved;
+};
+
+namespace scene_io {
+
+/* Record sizes, which change with the in-memory layout and are
+   checked on load. */
+const uint32_t record_sizes[4] = {
+    sizeof(flat_primitive), sizeof(flat_node), sizeof(flat_instance),
+    sizeof(flat_material)
+};
+
+/* Buffers in the binary file start on cache line boundaries. */
+const uint64_t alignment = 64;
+
+inline uint64_t align_up(uint64_t n) {
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+/* Returns true if no walk through the checkers of the texture program
+   of SCENE leaves the program or comes back to an instruction, so
+   compiled_scene::texture_value() always ends. */
+bool texture_program_valid(const compiled_scene& scene) {
+    enum { unvisited, on_path, finished };
+    auto count = scene.textures.size();
+    std::vector<unsigned char> state(count, unvisited);
+    std::vector<uint32_t> path;
+    for (uint32_t start = 0; start < count; start++) {
+        if (state[start] != unvisited)
+            continue;
+        state[start] = on_path;
+        path.assign(1, start);
+        while (!path.empty()) {
+            const flat_texture& t = scene.textures[path.back()];
+            if (t.kind == tex_checker) {
+                if (t.even >= count || t.odd >= count ||
+                    state[t.even] == on_path || state[t.odd] == on_path)
+                    return false;
+                uint32_t next = state[t.even] == unvisited ? t.even : t.odd;
+                if (state[next] == unvisited) {
+                    state[next] = on_path;
+                    path.push_back(next);
+                    continue;
+                }
+            }
+            state[path.back()] = finished;
+            path.pop_back();
+        }
+    }
+    return true;
+}
+
+/* Returns true if every index in SCENE is in range and the trees are
+   well formed, so a corrupt file cannot send a lookup outside the
+   arrays: children follow their parents, trees are at most
+   flat_bvh_build::max_depth high, instances nest less than
+   flat_hit::max_depth deep and the texture program has no loops. */
+bool indices_valid(const compiled_scene& scene) {
+    auto prim_count = scene.prims.size(), node_count = scene.nodes.size();
+
+    std::vector<int> heights;
+    if (node_count > 0) {
+        heights = flat_bvh_heights(scene.nodes.data(), node_count, prim_count);
+        if (heights.empty() || scene.root >= node_count ||
+            heights[scene.root] > flat_bvh_build::max_depth)
+            return false;
+    }
+
+    for (const auto& p : scene.prims) {
+        if (p.kind == prim_instance) {
+            if (p.index >= scene.instances.size())
+                return false;
+            uint32_t root = scene.instances[p.index].root;
+            if (root >= node_count || heights[root] > flat_bvh_build::max_depth)
+                return false;
+        }
+        else if (p.kind > prim_instance || p.material >= scene.materials.size())
+            return false;
+    }
+
+    /* Only diffuse materials look up their texture. */
+    for (const auto& m : scene.materials) {
+        if (m.kind >= mat_external)
+            return false;
+        if ((m.kind == mat_lambertian || m.kind == mat_diffuse_light) &&
+            m.texture >= scene.textures.size())
+            return false;
+    }
+
+    if (!texture_program_valid(scene))
+        return false;
+    if (node_count == 0)
+        return true;
+
+    /* Walk the nodes, entering instanced trees one level deeper.
+       Reaching a node again at a depth no greater than before cannot
+       find anything new, so each node is walked at most once per
+       depth even where subtrees are shared. */
+    std::vector<int> walked(node_count, -1);
+    std::vector<std::pair<uint32_t, int>> stack{{scene.root, 0}};
+    while (!stack.empty()) {
+        auto entry = stack.back();
+        stack.pop_back();
+        uint32_t i = entry.first;
+        int depth = entry.second;
+        if (walked[i] >= depth)
+            continue;
+        walked[i] = depth;
+
+        const flat_node& n = scene.nodes[i];
+        if (n.count == 0) {
+            stack.push_back({i + 1, depth});
+            stack.push_back({n.offset, depth});
+            continue;
+        }
+        for (uint32_t k = n.offset; k < n.offset + n.count; k++) {
+            const flat_primitive& p = scene.prims[k];
+            if (p.kind != prim_instance)
+                continue;
+            if (depth >= flat_hit::max_depth)
+                return false;
+            stack.push_back({scene.instances[p.index].root, depth + 1});
+        }
+    }
+    return true;
+}
+
+}
+
+/* Writes SCENE, with the camera and image parameters of SETUP, to PATH
+   in the binary scene format. Returns false if the scene holds
+   objects the format cannot store or the file cannot be written. */
+bool save_scene(const compiled_scene& scene, const scene_setup& setup,
+                const std::string& path) {
+    auto fail = [&](const char* reason) {
+        std::cerr << "ERROR: Could not save scene file '" << path << "' ("
+                  << reason << ").\n";
+        return false;
+    };
+
+    if (!scene.externals.empty())
+        return fail("user-defined primitives");
+
+    /* Materials are stored without their pointers. */
+    std::vector<flat_material> materials(scene.materials.begin(),
+                                         scene.materials.end());
+    for (auto& m : materials) {
+        if (m.kind == mat_external)
+            return fail("user-defined materials");
+        m.ptr = nullptr;
+    }
+
+    /* Noise textures sharing tables share them in the file too. */
+    std::vector<scene_file_texture> textures;
+    std::vector<const perlin::tables*> noise;
+    std::map<const perlin::tables*, uint32_t> noise_index;
+    std::string strings;
+    for (const auto& t : scene.textures) {
+        scene_file_texture ft;
+        memset(&ft, 0, sizeof(ft));
+        ft.kind = t.kind;
+        ft.even = t.even;
+        ft.odd = t.odd;
+        for (int i = 0; i < 3; i++)
+            ft.value[i] = t.value[i];
+
+        if (t.kind == tex_noise) {
+            auto n = static_cast<const noise_texture*>(t.ptr);
+            auto tables = n->noise.table.get();
+            auto found = noise_index.find(tables);
+            if (found == noise_index.end()) {
+                found = noise_index.emplace(
+                    tables, static_cast<uint32_t>(noise.size())).first;
+                noise.push_back(tables);
+            }
+            ft.resource = found->second;
+            ft.scale = n->scale;
+            ft.perlin_type = n->perlin_type;
+        }
+        else if (t.kind == tex_image) {
+            auto image = static_cast<const image_texture*>(t.ptr)->image;
+            if (!image)
+                return fail("image texture without an image");
+            ft.resource = static_cast<uint32_t>(strings.size());
+            strings += image->path;
+            strings += '\0';
+        }
+        else if (t.kind == tex_baked)
+            return fail("baked textures");
+        else if (t.kind == tex_external)
+            return fail("user-defined textures");
+        textures.push_back(ft);
+    }
+
+    scene_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, scene_file_magic, sizeof(h.magic));
+    h.version = scene_file_version;
+    h.root = scene.root;
+    memcpy(h.record_sizes, scene_io::record_sizes, sizeof(h.record_sizes));
+    h.time0 = scene.time0;
+    h.time1 = scene.time1;
+
+    scene_file_camera& cam = h.camera;
+    for (int i = 0; i < 3; i++) {
+        cam.lookfrom[i] = setup.lookfrom[i];
+        cam.lookat[i] = setup.lookat[i];
+        cam.background[i] = setup.background[i];
+    }
+    cam.vfov = setup.vfov;
+    cam.aperture = setup.aperture;
+    cam.aspect_ratio = setup.aspect_ratio;
+    cam.image_width = setup.image_width;
+    cam.samples_per_pixel = setup.samples_per_pixel;
+
+    h.prim_count = scene.prims.size();
+    h.node_count = scene.nodes.size();
+    h.instance_count = scene.instances.size();
+    h.material_count = materials.size();
+    h.texture_count = textures.size();
+    h.noise_count = noise.size();
+    h.strings_size = strings.size();
+
+    h.prims_offset = scene_io::align_up(sizeof(h));
+    h.nodes_offset = scene_io::align_up(
+        h.prims_offset + h.prim_count * sizeof(flat_primitive));
+    h.instances_offset = scene_io::align_up(
+        h.nodes_offset + h.node_count * sizeof(flat_node));
+    h.materials_offset = scene_io::align_up(
+        h.instances_offset + h.instance_count * sizeof(flat_instance));
+    h.textures_offset = scene_io::align_up(
+        h.materials_offset + h.material_count * sizeof(flat_material));
+    h.noise_offset = scene_io::align_up(
+        h.textures_offset + h.texture_count * sizeof(scene_file_texture));
+    h.strings_offset = scene_io::align_up(
+        h.noise_offset + h.noise_count * sizeof(perlin::tables));
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return fail("cannot create file");
+
+    const char zeros[scene_io::alignment] = {};
+    auto write_at = [&](uint64_t offset, const void* data, size_t bytes) {
+        long pos = ftell(f);
+        if (pos < 0 || static_cast<uint64_t>(pos) > offset)
+            return false;
+        if (fwrite(zeros, 1, offset - pos, f) != offset - pos)
+            return false;
+        return bytes == 0 || fwrite(data, 1, bytes, f) == bytes;
+    };
+
+    bool ok = write_at(0, &h, sizeof(h))
+        && write_at(h.prims_offset, scene.prims.data(),
+                    h.prim_count * sizeof(flat_primitive))
+        && write_at(h.nodes_offset, scene.nodes.data(),
+                    h.node_count * sizeof(flat_node))
+        && write_at(h.instances_offset, scene.instances.data(),
+                    h.instance_count * sizeof(flat_instance))
+        && write_at(h.materials_offset, materials.data(),
+                    h.material_count * sizeof(flat_material))
+        && write_at(h.textures_offset, textures.data(),
+                    h.texture_count * sizeof(scene_file_texture));
+    for (size_t i = 0; ok && i < noise.size(); i++)
+        ok = write_at(h.noise_offset + i * sizeof(perlin::tables), noise[i],
+                      sizeof(perlin::tables));
+    ok = ok && write_at(h.strings_offset, strings.data(), strings.size());
+
+    if (fclose(f) != 0 || !ok)
+        return fail("write failed");
+    return true;
+}
+
+/* Maps the binary scene file at PATH and returns a scene whose arrays
+   point directly into the mapping, storing its camera and image
+   parameters in SETUP (whose world is left empty). Returns nullptr if
+   the file is missing or malformed. */
+shared_ptr<compiled_scene> load_scene(const std::string& path,
+                                      scene_setup& setup) {
+    auto scene = make_shared<compiled_scene>();
+    mapped_file& file = scene->file;
+
+    auto fail = [&](const char* reason) {
+        std::cerr << "ERROR: Could not load scene file '" << path << "' ("
+                  << reason << ").\n";
+        return nullptr;
+    };
+
+    if (!file.open(path))
+        return fail("cannot map file");
+
+    auto header = file.view<scene_file_header>(0, 1);
+    if (header.empty())
+        return fail("truncated header");
+
+    const scene_file_header& h = header[0];
+    if (memcmp(h.magic, scene_file_magic, sizeof(h.magic)) != 0)
+        return fail("bad magic");
+    if (h.version != scene_file_version ||
+        memcmp(h.record_sizes, scene_io::record_sizes,
+               sizeof(h.record_sizes)) != 0)
+        return fail("unsupported version");
+
+    scene->prims = file.view<flat_primitive>(h.prims_offset, h.prim_count);
+    scene->nodes = file.view<flat_node>(h.nodes_offset, h.node_count);
+    scene->instances = file.view<flat_instance>(h.instances_offset,
+                                                h.instance_count);
+    scene->materials = file.view<flat_material>(h.materials_offset,
+                                                h.material_count);
+    auto textures = file.view<scene_file_texture>(h.textures_offset,
+                                                  h.texture_count);
+    auto noise = file.view<perlin::tables>(h.noise_offset, h.noise_count);
+    auto strings = file.view<char>(h.strings_offset, h.strings_size);
+
+    if (scene->prims.size() != h.prim_count ||
+        scene->nodes.size() != h.node_count ||
+        scene->instances.size() != h.instance_count ||
+        scene->materials.size() != h.material_count ||
+        textures.size() != h.texture_count ||
+        noise.size() != h.noise_count ||
+        strings.size() != h.strings_size)
+        return fail("truncated buffers");
+
+    /* Rebuild the texture program, making the objects behind noise and
+       image textures. */
+    auto& program = scene->owned_textures;
+    program.reserve(textures.size());
+    for (const auto& t : textures) {
+        flat_texture ft;
+        ft.kind = t.kind;
+        ft.even = t.even;
+        ft.odd = t.odd;
+        ft.value = color(t.value[0], t.value[1], t.value[2]);
+        ft.ptr = nullptr;
+
+        if (t.kind == tex_checker) {
+            if (t.even >= textures.size() || t.odd >= textures.size())
+                return fail("bad texture index");
+        }
+        else if (t.kind == tex_noise) {
+            if (t.resource >= noise.size())
+                return fail("bad noise tables");
+
+            /* The tables stay in the mapping, which the scene owns. */
+            shared_ptr<const perlin::tables> tables(
+                shared_ptr<const perlin::tables>(), &noise[t.resource]);
+            auto n = make_shared<noise_texture>(perlin(tables), t.scale);
+            n->perlin_type = t.perlin_type;
+            ft.ptr = n.get();
+            scene->owned_texture_objects.push_back(n);
+        }
+        else if (t.kind == tex_image) {
+            if (t.resource >= strings.size() ||
+                !memchr(&strings[t.resource], 0, strings.size() - t.resource))
+                return fail("bad image path");
+            auto image = make_shared<image_texture>(&strings[t.resource]);
+            ft.ptr = image.get();
+            scene->owned_texture_objects.push_back(image);
+        }
+        else if (t.kind != tex_solid)
+            return fail("unsupported texture");
+        program.push_back(ft);
+    }
+    scene->textures = array_view<flat_texture>(program.data(), program.size());
+
+    scene->root = h.root;
+    scene->time0 = h.time0;
+    scene->time1 = h.time1;
+    if (!scene_io::indices_valid(*scene))
+        return fail("bad index");
+
+    const scene_file_camera& cam = h.camera;
+    setup.world.clear();
+    setup.lookfrom = point3(cam.lookfrom[0], cam.lookfrom[1], cam.lookfrom[2]);
+    setup.lookat = point3(cam.lookat[0], cam.lookat[1], cam.lookat[2]);
+    setup.background = color(cam.background[0], cam.background[1],
+                             cam.background[2]);
+    setup.vfov = cam.vfov;
+    setup.aperture = cam.aperture;
+    setup.aspect_ratio = cam.aspect_ratio;
+    setup.image_width = cam.image_width;
+    setup.samples_per_pixel = cam.samples_per_pixel;
+    return scene;
+}
+
+#endif
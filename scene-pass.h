@@ -0,0 +1,61 @@
+#ifndef SCENE_PASS_H
+#define SCENE_PASS_H
+
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable-list.h"
+#include "util.h"
+
+/*
+   Passes that rewrite a scene after it has been built and before it
+   is rendered.
+*/
+
+/* Folds every chain of directly nested transforms below OBJECT (e.g.
+   translate(rotate_y(box))) into a single transformed object, so each
+   ray pays for one transform however many were stacked. Lists and BVH
+   nodes are rewritten in place. Returns the object to use in place
+   of OBJECT. */
+shared_ptr<hittable> collapse_transforms(shared_ptr<hittable> object) {
+    if (auto list = std::dynamic_pointer_cast<hittable_list>(object)) {
+        for (auto& child : list->objects)
+            child = collapse_transforms(child);
+        return list;
+    }
+
+    if (auto node = std::dynamic_pointer_cast<bvh_node>(object)) {
+        bool shared_child = node->left == node->right;
+        node->left = collapse_transforms(node->left);
+        node->right = shared_child ? node->left
+                                   : collapse_transforms(node->right);
+        return node;
+    }
+
+    auto outer = std::dynamic_pointer_cast<transformed>(object);
+    if (!outer)
+        return object;
+
+    /* Compose the chain from the outside in. */
+    affine m = outer->object_to_world;
+    auto inner = outer->ptr;
+    int depth = 1;
+    while (auto t = std::dynamic_pointer_cast<transformed>(inner)) {
+        m = m * t->object_to_world;
+        inner = t->ptr;
+        depth++;
+    }
+
+    inner = collapse_transforms(inner);
+    if (depth == 1 && inner == outer->ptr)
+        return outer;
+
+    return make_shared<transformed>(inner, m);
+}
+
+/* Applies collapse_transforms() to every object in the list WORLD. */
+void collapse_transforms(hittable_list& world) {
+    for (auto& object : world.objects)
+        object = collapse_transforms(object);
+}
+
+#endif
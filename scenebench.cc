@@ -0,0 +1,280 @@
+#include "util.h"
+#include "scenes.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "camera.h"
+#include "compiled-scene.h"
+#include "integrator.h"
+#include "scene-pass.h"
+
+/*
+   Renders each scene of select_scene() at a fixed resolution, sample
+   count and seed, and reports as JSON, per scene:
+
+       build_s          time to build and compile the scene
+       render_s         time to render it (the best of --repeat runs)
+       render_cpu_s     CPU time of the render (the best of the runs)
+       rays             rays traced, and RAYS_PER_DEPTH split by
+                        bounce (camera rays first)
+       mrays_per_s      millions of rays traced per second
+       peak_rss_kb      peak resident memory of the render
+
+   Each scene is rendered in a process of its own, so its peak memory
+   is its own. The renders are single-threaded, like main, and the
+   same seed traces the same rays on every run, so runs differ only in
+   time. Compare two runs with benchcmp.
+
+   Usage: scenebench [--width n] [--spp n] [--seed n] [--repeat n]
+                     [--scenes i,j,...] [output.json]
+
+   Run it from the top of the repository, where the texture images
+   are. The JSON goes to standard output if no file is given.
+*/
+
+namespace {
+
+const int max_depth = 50;
+
+struct bench_settings {
+    int width = 200;
+    int samples_per_pixel = 8;
+    uint64_t seed = 0;
+    int repeat = 3;
+};
+
+/* As ray_color() for compiled scenes, counting the rays traced at
+   each depth in RAYS, from camera rays at RAYS[0]. */
+color ray_color_counted(const ray& r, const color& background,
+                        const compiled_scene& scene, int depth,
+                        uint64_t* rays) {
+    flat_hit h;
+    hit_record rec;
+
+    if (depth <= 0)
+        return color(0, 0, 0);
+
+    rays[0]++;
+    if (!scene.hit(r, 0.001, infinity, h))
+        return background;
+    uint32_t mat = scene.get_surface(r, h, rec);
+
+    ray scattered;
+    color attenuation;
+    color emitted = scene.emitted(mat, rec);
+
+    if (!scene.scatter(mat, r, rec, attenuation, scattered))
+        return emitted;
+
+    return emitted + attenuation * ray_color_counted(scattered, background,
+                                                     scene, depth-1, rays+1);
+}
+
+/* Returns the CPU time used by the process, in seconds. Unlike wall
+   time, it does not count time other processes had the CPU. */
+double process_cpu_time() {
+    timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/* Builds and renders scene INDEX, and returns its JSON object. */
+std::string bench_scene(int index, const bench_settings& settings) {
+    using clock = std::chrono::steady_clock;
+
+    /* Start from the random sequence of a fresh process, so random
+       scenes are the ones main renders. */
+    thread_random() = random_generator();
+    auto start = clock::now();
+    scene_arena arena;
+    scene_setup setup;
+    select_scene(index, arena, setup);
+    collapse_transforms(setup.world);
+    compiled_scene scene(setup.world, 0.0, 1.0);
+    std::chrono::duration<double> build_time = clock::now() - start;
+
+    camera cam = scene_camera(setup);
+    int width = settings.width;
+    int height = static_cast<int>(width / setup.aspect_ratio);
+    int spp = settings.samples_per_pixel;
+
+    std::vector<uint64_t> rays(max_depth, 0);
+    double render_time = infinity, cpu_time = infinity;
+    double checksum = 0;
+    for (int rep = 0; rep < settings.repeat; rep++) {
+        std::fill(rays.begin(), rays.end(), 0);
+        checksum = 0;
+        double cpu_start = process_cpu_time();
+        start = clock::now();
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                for (int s = 0; s < spp; s++) {
+                    ray r = sample_ray(cam, width, height, settings.seed,
+                                       i, j, s);
+                    color c = ray_color_counted(r, setup.background, scene,
+                                                max_depth, rays.data());
+                    checksum += c.x() + c.y() + c.z();
+                }
+            }
+        }
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        render_time = fmin(render_time, elapsed.count());
+        cpu_time = fmin(cpu_time, process_cpu_time() - cpu_start);
+    }
+
+    uint64_t total = 0;
+    int depths = 0;
+    for (int d = 0; d < max_depth; d++) {
+        total += rays[d];
+        if (rays[d])
+            depths = d + 1;
+    }
+
+    /* ru_maxrss is in kilobytes on Linux, but in bytes on macOS. */
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peak_rss_kb = usage.ru_maxrss;
+#ifdef __APPLE__
+    peak_rss_kb /= 1024;
+#endif
+
+    std::ostringstream json;
+    json.precision(9);
+    json << "    {\"index\": " << index
+         << ", \"name\": \"" << scene_names[index] << "\""
+         << ", \"width\": " << width << ", \"height\": " << height
+         << ",\n     \"build_s\": " << build_time.count()
+         << ", \"render_s\": " << render_time
+         << ", \"render_cpu_s\": " << cpu_time
+         << ", \"rays\": " << total
+         << ", \"mrays_per_s\": " << total / render_time / 1e6
+         << ",\n     \"peak_rss_kb\": " << peak_rss_kb
+         << ", \"checksum\": " << checksum
+         << ",\n     \"rays_per_depth\": [";
+    for (int d = 0; d < depths; d++)
+        json << (d ? ", " : "") << rays[d];
+    json << "]}";
+    return json.str();
+}
+
+/* Runs bench_scene() in a child process and returns its JSON object,
+   or an empty string if the child failed. */
+std::string bench_in_child(int index, const bench_settings& settings) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return "";
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return "";
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        std::string json = bench_scene(index, settings);
+        const char* p = json.data();
+        size_t left = json.size();
+        while (left > 0) {
+            auto written = write(fds[1], p, left);
+            if (written <= 0)
+                _exit(1);
+            p += written;
+            left -= written;
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    std::string json;
+    char chunk[4096];
+    ssize_t got;
+    while ((got = read(fds[0], chunk, sizeof(chunk))) > 0)
+        json.append(chunk, got);
+    close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+        return "";
+    return json;
+}
+
+}
+
+int main(int argc, char** argv) {
+    bench_settings settings;
+    std::vector<int> scenes;
+    std::string output = "-";
+    bool usage = false;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--width" && a + 1 < argc)
+            usage |= (settings.width = atoi(argv[++a])) < 2;
+        else if (arg == "--spp" && a + 1 < argc)
+            usage |= (settings.samples_per_pixel = atoi(argv[++a])) < 1;
+        else if (arg == "--seed" && a + 1 < argc)
+            settings.seed = strtoull(argv[++a], nullptr, 10);
+        else if (arg == "--repeat" && a + 1 < argc)
+            usage |= (settings.repeat = atoi(argv[++a])) < 1;
+        else if (arg == "--scenes" && a + 1 < argc) {
+            std::istringstream list(argv[++a]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                int index = atoi(item.c_str());
+                usage |= index < 0 || index >= scene_count;
+                scenes.push_back(index);
+            }
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+            usage = true;
+        else
+            output = arg;
+    }
+    if (usage) {
+        std::cerr << "Usage: " << argv[0] << " [--width n] [--spp n] "
+                  << "[--seed n] [--repeat n] [--scenes i,j,...] "
+                  << "[output.json]\n";
+        return 1;
+    }
+    if (scenes.empty())
+        for (int index = 0; index < scene_count; index++)
+            scenes.push_back(index);
+
+    std::ostringstream json;
+    json << "{\"width\": " << settings.width
+         << ", \"samples_per_pixel\": " << settings.samples_per_pixel
+         << ", \"seed\": " << settings.seed
+         << ", \"max_depth\": " << max_depth
+         << ", \"repeat\": " << settings.repeat
+         << ",\n \"compiler\": \"" << __VERSION__ << "\""
+         << ",\n \"scenes\": [\n";
+
+    for (size_t n = 0; n < scenes.size(); n++) {
+        std::cerr << "Scene " << scenes[n] << " (" << scene_names[scenes[n]]
+                  << ")" << std::flush;
+        std::string scene = bench_in_child(scenes[n], settings);
+        if (scene.empty()) {
+            std::cerr << "\nERROR: Scene " << scenes[n] << " failed.\n";
+            return 1;
+        }
+        std::cerr << "\n";
+        json << scene << (n + 1 < scenes.size() ? ",\n" : "\n");
+    }
+    json << "]}\n";
+
+    FILE* f = output == "-" ? stdout : fopen(output.c_str(), "w");
+    if (!f || fputs(json.str().c_str(), f) < 0 ||
+        (f != stdout ? fclose(f) : fflush(f)) != 0) {
+        std::cerr << "ERROR: Could not write '" << output << "'.\n";
+        return 1;
+    }
+}
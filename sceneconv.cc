@@ -0,0 +1,55 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include "compiled-scene.h"
+#include "scene-io.h"
+#include "scene-pass.h"
+#include "scenes.h"
+
+/* Exports one of the scenes built by select_scene() into the binary
+   scene format, which the renderer maps and renders without building
+   the scene (main --scene file.rtscene), and compares building the
+   scene with loading the file.
+
+   Usage: sceneconv scene_index output.rtscene */
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " scene_index output.rtscene\n";
+        return 1;
+    }
+
+    int scene_index = atoi(argv[1]);
+    std::string output = argv[2];
+
+    auto start = std::chrono::steady_clock::now();
+    scene_arena arena;
+    scene_setup setup;
+    if (!select_scene(scene_index, arena, setup)) {
+        std::cerr << "ERROR: No scene " << scene_index << ".\n";
+        return 1;
+    }
+    collapse_transforms(setup.world);
+    compiled_scene scene(setup.world, 0.0, 1.0);
+    auto built = std::chrono::steady_clock::now();
+
+    if (!save_scene(scene, setup, output))
+        return 1;
+
+    auto loaded_start = std::chrono::steady_clock::now();
+    scene_setup loaded_setup;
+    auto loaded = load_scene(output, loaded_setup);
+    if (!loaded)
+        return 1;
+    auto loaded_end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double> build_time = built - start;
+    std::chrono::duration<double> load_time = loaded_end - loaded_start;
+    std::cerr << "Primitives: " << scene.prims.size()
+              << "\nBVH nodes: " << scene.nodes.size()
+              << "\nInstances: " << scene.instances.size()
+              << "\nMaterials: " << scene.materials.size()
+              << "\nTexture instructions: " << scene.textures.size()
+              << "\nFile size: " << loaded->file.size() << " bytes"
+              << "\nBuild time: " << build_time.count() << " s"
+              << "\nLoad time: " << load_time.count() << " s\n";
+}
@@ -2,22 +2,30 @@
 #define SCENES_H
 
 #include "aarect.h"
+#include "arena.h"
 #include "box.h"
 #include "bvh.h"
+#include "camera.h"
 #include "hittable-list.h"
 #include "material.h"
 #include "moving-sphere.h"
 #include "sphere.h"
+#include "triangle-mesh.h"
+
+/*
+   Scene construction functions. Every object, material and texture
+   is allocated from ARENA, which must outlive the returned world.
+*/
 
 /* Scene with lots of random spheres (case 0). */
-hittable_list random_scene() {
+hittable_list random_scene(scene_arena& arena) {
     hittable_list world;
 
     /* Sphere that acts as the ground with checkerboard texture. */
-    auto checker = make_shared<checker_texture>(color(0, 0, 0),
-                                                color(0.9, 0.9, 0.9));
-    world.add(make_shared<sphere>(point3(0, -1000, 0),
-                                  1000, make_shared<lambertian>(checker)));
+    auto checker = arena.make<checker_texture>(color(0, 0, 0),
+                                               color(0.9, 0.9, 0.9));
+    world.add(arena.make<sphere>(point3(0, -1000, 0),
+                                 1000, arena.make<lambertian>(checker)));
 
     /* Small spheres of assorted types. */
     for (int a = -11; a < 11; a++) {
@@ -32,402 +40,546 @@ hittable_list random_scene() {
 
                     /* Diffuse material that moves. */
                     auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
+                    sphere_material = arena.make<lambertian>(albedo);
                     auto center2 = center + vec3(0, random_double(0, 0.5), 0);
-                    world.add(make_shared<moving_sphere>(center, center2, 
-                                                         0.0, 1.0, 0.2,
-                                                         sphere_material));
+                    world.add(arena.make<moving_sphere>(center, center2, 
+                                                        0.0, 1.0, 0.2,
+                                                        sphere_material));
                 }
                 else if (choose_mat < 0.95) {
 
                     /* Metal material. */
                     auto albedo = color::random(0.5, 1);
                     auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2,
-                                                  sphere_material));
+                    sphere_material = arena.make<metal>(albedo, fuzz);
+                    world.add(arena.make<sphere>(center, 0.2,
+                                                 sphere_material));
                 }
                 else {
 
                     /* Dielectric material. */
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2,
-                                                  sphere_material));
+                    sphere_material = arena.make<dielectric>(1.5);
+                    world.add(arena.make<sphere>(center, 0.2,
+                                                 sphere_material));
                 }
             }
         }
     }
 
     /* Three large spheres (dielectric, diffuse, and metal). */
-    auto material1 = make_shared<dielectric>(1.5);
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    auto material1 = arena.make<dielectric>(1.5);
+    auto material2 = arena.make<lambertian>(color(0.4, 0.2, 0.1));
+    auto material3 = arena.make<metal>(color(0.7, 0.6, 0.5), 0.0);
     
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
-    world.add(make_shared<sphere>(point3(-4, -1, 0), 1.0, material2));
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    world.add(arena.make<sphere>(point3(0, 1, 0), 1.0, material1));
+    world.add(arena.make<sphere>(point3(-4, -1, 0), 1.0, material2));
+    world.add(arena.make<sphere>(point3(4, 1, 0), 1.0, material3));
     
     /* Build BVH of scene. */
-    return hittable_list(make_shared<bvh_node>(world, 0.0, 1.0));
+    return hittable_list(arena.make<bvh_node>(world, 0.0, 1.0, &arena));
 }
 
 /* Scene with two checkered spheres (case 1). */
-hittable_list two_spheres() {
+hittable_list two_spheres(scene_arena& arena) {
     hittable_list objects;
 
-    auto checker = make_shared<checker_texture>(color(0.2, 0.3, 0.1),
-                                                color(0.9, 0.9, 0.9));                                    
-    objects.add(make_shared<sphere>(point3(0, -10, 0), 10,
-                                    make_shared<lambertian>(checker)));
-    objects.add(make_shared<sphere>(point3(0, 10, 0), 10,
-                                    make_shared<lambertian>(checker)));
+    auto checker = arena.make<checker_texture>(color(0.2, 0.3, 0.1),
+                                               color(0.9, 0.9, 0.9));                                    
+    objects.add(arena.make<sphere>(point3(0, -10, 0), 10,
+                                   arena.make<lambertian>(checker)));
+    objects.add(arena.make<sphere>(point3(0, 10, 0), 10,
+                                   arena.make<lambertian>(checker)));
 
     return objects;
 }
 
 /* Scene with two spheres with Perlin noise (case 2). */
-hittable_list two_perlin_spheres() {
+hittable_list two_perlin_spheres(scene_arena& arena) {
     hittable_list objects;
 
-    auto pertext = make_shared<noise_texture>(4);
-    objects.add(make_shared<sphere>(point3(0, -1000, 0),
-                                    1000, make_shared<lambertian>(pertext)));
-    objects.add(make_shared<sphere>(point3(0, 2, 0),
-                                    2, make_shared<lambertian>(pertext)));
+    auto pertext = arena.make<noise_texture>(4);
+    objects.add(arena.make<sphere>(point3(0, -1000, 0),
+                                   1000, arena.make<lambertian>(pertext)));
+    objects.add(arena.make<sphere>(point3(0, 2, 0),
+                                   2, arena.make<lambertian>(pertext)));
 
     return objects;
 }
 
 /* Scene with one sphere with Earth map image texture (case 3). */
-hittable_list earth() {
-    auto earth_texture = make_shared<image_texture>("images/earthmap.jpeg");
-    auto earth_surface = make_shared<lambertian>(earth_texture);
-    auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
+hittable_list earth(scene_arena& arena) {
+    auto earth_texture = arena.make<image_texture>("images/earthmap.jpeg");
+    auto earth_surface = arena.make<lambertian>(earth_texture);
+    auto globe = arena.make<sphere>(point3(0, 0, 0), 2, earth_surface);
 
     return hittable_list(globe);
 }
 
 /* Wheel of Fortune scene (case 4). */
-hittable_list wheel_of_fortune() {
+hittable_list wheel_of_fortune(scene_arena& arena) {
     hittable_list objects;
 
     /* Marble ground (using Perlin noise). */
-    auto marble = make_shared<noise_texture>(4);
-    objects.add(make_shared<sphere>(point3(0, -1000, 0),
-                                    1000, make_shared<lambertian>(marble)));
+    auto marble = arena.make<noise_texture>(4);
+    objects.add(arena.make<sphere>(point3(0, -1000, 0),
+                                   1000, arena.make<lambertian>(marble)));
 
     /* CS 248 sphere with two metal spheres on left/right. */
-    // auto cs248_texture = make_shared<image_texture>("images/cs248.png");
-    // auto cs248 = make_shared<lambertian>(cs248_texture);
-    // auto cs248_lr = make_shared<metal>(color(0.8, 0.2, 0.0), 0.3);
+    // auto cs248_texture = arena.make<image_texture>("images/cs248.png");
+    // auto cs248 = arena.make<lambertian>(cs248_texture);
+    // auto cs248_lr = arena.make<metal>(color(0.8, 0.2, 0.0), 0.3);
 
-    // objects.add(make_shared<sphere>(point3(-6.5, 7, 0), 0.8, cs248));
-    // objects.add(make_shared<sphere>(point3(-8.1, 7, 0), 0.8, cs248_lr));
-    // objects.add(make_shared<sphere>(point3(-4.9, 7, 0), 0.8, cs248_lr));
+    // objects.add(arena.make<sphere>(point3(-6.5, 7, 0), 0.8, cs248));
+    // objects.add(arena.make<sphere>(point3(-8.1, 7, 0), 0.8, cs248_lr));
+    // objects.add(arena.make<sphere>(point3(-4.9, 7, 0), 0.8, cs248_lr));
 
     /* Final Project sphere with two dielectrics on left/right. */
-    // auto fp_texture = make_shared<image_texture>("images/final-project.png");
-    // auto fp = make_shared<lambertian>(fp_texture);
-    // auto fp_lr = make_shared<dielectric>(1.5);
+    // auto fp_texture = arena.make<image_texture>("images/final-project.png");
+    // auto fp = arena.make<lambertian>(fp_texture);
+    // auto fp_lr = arena.make<dielectric>(1.5);
 
-    // objects.add(make_shared<sphere>(point3(6.5, 5.5, 0), 0.8, fp));
-    // objects.add(make_shared<sphere>(point3(4.9, 5.5, 0), 0.8, fp_lr));
-    // objects.add(make_shared<sphere>(point3(8.1, 5.5, 0), 0.8, fp_lr));
+    // objects.add(arena.make<sphere>(point3(6.5, 5.5, 0), 0.8, fp));
+    // objects.add(arena.make<sphere>(point3(4.9, 5.5, 0), 0.8, fp_lr));
+    // objects.add(arena.make<sphere>(point3(8.1, 5.5, 0), 0.8, fp_lr));
 
     /* Wheel of Fortune sphere. */
-    auto wof_texture = make_shared<image_texture>("images/wof.png");
-    auto wof = make_shared<lambertian>(wof_texture);
+    auto wof_texture = arena.make<image_texture>("images/wof.png");
+    auto wof = arena.make<lambertian>(wof_texture);
     
-    objects.add(make_shared<sphere>(point3(0, 5.6, 0), 2.8, wof));
+    objects.add(arena.make<sphere>(point3(0, 5.6, 0), 2.8, wof));
 
     /* Letter, number, and punctuation images. */
-    auto let_A = make_shared<image_texture>("images/let_A.png");
-    auto let_B = make_shared<image_texture>("images/let_B.png");
-    auto let_C = make_shared<image_texture>("images/let_C.png");
-    auto let_D = make_shared<image_texture>("images/let_D.png");
-    auto let_E = make_shared<image_texture>("images/let_E.png");
-    auto let_F = make_shared<image_texture>("images/let_F.png");
-    auto let_G = make_shared<image_texture>("images/let_G.png");
-    auto let_H = make_shared<image_texture>("images/let_H.png");
-    auto let_I = make_shared<image_texture>("images/let_I.png");
-    auto let_J = make_shared<image_texture>("images/let_J.png");
-    auto let_K = make_shared<image_texture>("images/let_K.png");
-    auto let_L = make_shared<image_texture>("images/let_L.png");
-    auto let_M = make_shared<image_texture>("images/let_M.png");
-    auto let_N = make_shared<image_texture>("images/let_N.png");
-    auto let_O = make_shared<image_texture>("images/let_O.png");
-    auto let_P = make_shared<image_texture>("images/let_P.png");
-    auto let_Q = make_shared<image_texture>("images/let_Q.png");
-    auto let_R = make_shared<image_texture>("images/let_R.png");
-    auto let_S = make_shared<image_texture>("images/let_S.png");
-    auto let_T = make_shared<image_texture>("images/let_T.png");
-    auto let_U = make_shared<image_texture>("images/let_U.png");
-    auto let_V = make_shared<image_texture>("images/let_V.png");
-    auto let_W = make_shared<image_texture>("images/let_W.png");
-    auto let_X = make_shared<image_texture>("images/let_X.png");
-    auto let_Y = make_shared<image_texture>("images/let_Y.png");
-    auto let_Z = make_shared<image_texture>("images/let_Z.png");
-
-    auto num_2 = make_shared<image_texture>("images/num_2.png");
+    auto let_A = arena.make<image_texture>("images/let_A.png");
+    auto let_B = arena.make<image_texture>("images/let_B.png");
+    auto let_C = arena.make<image_texture>("images/let_C.png");
+    auto let_D = arena.make<image_texture>("images/let_D.png");
+    auto let_E = arena.make<image_texture>("images/let_E.png");
+    auto let_F = arena.make<image_texture>("images/let_F.png");
+    auto let_G = arena.make<image_texture>("images/let_G.png");
+    auto let_H = arena.make<image_texture>("images/let_H.png");
+    auto let_I = arena.make<image_texture>("images/let_I.png");
+    auto let_J = arena.make<image_texture>("images/let_J.png");
+    auto let_K = arena.make<image_texture>("images/let_K.png");
+    auto let_L = arena.make<image_texture>("images/let_L.png");
+    auto let_M = arena.make<image_texture>("images/let_M.png");
+    auto let_N = arena.make<image_texture>("images/let_N.png");
+    auto let_O = arena.make<image_texture>("images/let_O.png");
+    auto let_P = arena.make<image_texture>("images/let_P.png");
+    auto let_Q = arena.make<image_texture>("images/let_Q.png");
+    auto let_R = arena.make<image_texture>("images/let_R.png");
+    auto let_S = arena.make<image_texture>("images/let_S.png");
+    auto let_T = arena.make<image_texture>("images/let_T.png");
+    auto let_U = arena.make<image_texture>("images/let_U.png");
+    auto let_V = arena.make<image_texture>("images/let_V.png");
+    auto let_W = arena.make<image_texture>("images/let_W.png");
+    auto let_X = arena.make<image_texture>("images/let_X.png");
+    auto let_Y = arena.make<image_texture>("images/let_Y.png");
+    auto let_Z = arena.make<image_texture>("images/let_Z.png");
+
+    auto num_2 = arena.make<image_texture>("images/num_2.png");
 
     auto apostrophe = 
-        make_shared<image_texture>("images/punc_apostrophe.png");
+        arena.make<image_texture>("images/punc_apostrophe.png");
     auto exclamation = 
-        make_shared<image_texture>("images/punc_exclamation.png");
+        arena.make<image_texture>("images/punc_exclamation.png");
 
     /* Blank texture. */
-    auto blank = make_shared<lambertian>(color(1.0, 1.0, 1.0));
+    auto blank = arena.make<lambertian>(color(1.0, 1.0, 1.0));
 
     /* Letter, number, and punctuation textures. */
-    auto text_A = make_shared<lambertian>(let_A);
-    auto text_B = make_shared<lambertian>(let_B);
-    auto text_C = make_shared<lambertian>(let_C);
-    auto text_D = make_shared<lambertian>(let_D);
-    auto text_E = make_shared<lambertian>(let_E);
-    auto text_F = make_shared<lambertian>(let_F);
-    auto text_G = make_shared<lambertian>(let_G);
-    auto text_H = make_shared<lambertian>(let_H);
-    auto text_I = make_shared<lambertian>(let_I);
-    auto text_J = make_shared<lambertian>(let_J);
-    auto text_K = make_shared<lambertian>(let_K);
-    auto text_L = make_shared<lambertian>(let_L);
-    auto text_M = make_shared<lambertian>(let_M);
-    auto text_N = make_shared<lambertian>(let_N);
-    auto text_O = make_shared<lambertian>(let_O);
-    auto text_P = make_shared<lambertian>(let_P);
-    auto text_Q = make_shared<lambertian>(let_Q);
-    auto text_R = make_shared<lambertian>(let_R);
-    auto text_S = make_shared<lambertian>(let_S);
-    auto text_T = make_shared<lambertian>(let_T);
-    auto text_U = make_shared<lambertian>(let_U);
-    auto text_V = make_shared<lambertian>(let_V);
-    auto text_W = make_shared<lambertian>(let_W);
-    auto text_X = make_shared<lambertian>(let_X);
-    auto text_Y = make_shared<lambertian>(let_Y);
-    auto text_Z = make_shared<lambertian>(let_Z);
-
-    auto text_2 = make_shared<lambertian>(num_2);
-
-    auto text_apos = make_shared<lambertian>(apostrophe);
-    auto text_excl = make_shared<lambertian>(exclamation);
+    auto text_A = arena.make<lambertian>(let_A);
+    auto text_B = arena.make<lambertian>(let_B);
+    auto text_C = arena.make<lambertian>(let_C);
+    auto text_D = arena.make<lambertian>(let_D);
+    auto text_E = arena.make<lambertian>(let_E);
+    auto text_F = arena.make<lambertian>(let_F);
+    auto text_G = arena.make<lambertian>(let_G);
+    auto text_H = arena.make<lambertian>(let_H);
+    auto text_I = arena.make<lambertian>(let_I);
+    auto text_J = arena.make<lambertian>(let_J);
+    auto text_K = arena.make<lambertian>(let_K);
+    auto text_L = arena.make<lambertian>(let_L);
+    auto text_M = arena.make<lambertian>(let_M);
+    auto text_N = arena.make<lambertian>(let_N);
+    auto text_O = arena.make<lambertian>(let_O);
+    auto text_P = arena.make<lambertian>(let_P);
+    auto text_Q = arena.make<lambertian>(let_Q);
+    auto text_R = arena.make<lambertian>(let_R);
+    auto text_S = arena.make<lambertian>(let_S);
+    auto text_T = arena.make<lambertian>(let_T);
+    auto text_U = arena.make<lambertian>(let_U);
+    auto text_V = arena.make<lambertian>(let_V);
+    auto text_W = arena.make<lambertian>(let_W);
+    auto text_X = arena.make<lambertian>(let_X);
+    auto text_Y = arena.make<lambertian>(let_Y);
+    auto text_Z = arena.make<lambertian>(let_Z);
+
+    auto text_2 = arena.make<lambertian>(num_2);
+
+    auto text_apos = arena.make<lambertian>(apostrophe);
+    auto text_excl = arena.make<lambertian>(exclamation);
 
     /* Spheres representing guesses remaining. */
-    auto rainbow_r = make_shared<metal>(color(1.0, 0, 0), 0.3);
-    auto rainbow_o = make_shared<metal>(color(1.0, 0.5, 0), 0.3);
-    auto rainbow_y = make_shared<metal>(color(1.0, 1.0, 0), 0.3);
-    auto rainbow_g = make_shared<metal>(color(0, 1.0, 0), 0.3);
-    auto rainbow_b = make_shared<metal>(color(0, 0, 1.0), 0.3);
-    auto rainbow_i = make_shared<metal>(color(0.3, 0, 0.5), 0.3);
-    auto rainbow_v = make_shared<metal>(color(0.6, 0, 0.8), 0.3);
-
-    objects.add(make_shared<sphere>(point3(-8.0, 5.0, 0), 0.5, rainbow_r));
-    objects.add(make_shared<sphere>(point3(-6.0 - sqrt(3), 6.0, 0), 0.5, rainbow_o));
-    objects.add(make_shared<sphere>(point3(-7.0, 5.0 + sqrt(3), 0), 0.5, rainbow_y));
-    objects.add(make_shared<sphere>(point3(-6.0, 7.0, 0), 0.5, rainbow_g));
-    objects.add(make_shared<sphere>(point3(-5.0, 5.0 + sqrt(3), 0), 0.5, rainbow_b));
-    objects.add(make_shared<sphere>(point3(-6.0 + sqrt(3), 6.0, 0), 0.5, rainbow_i));
-    objects.add(make_shared<sphere>(point3(-4.0, 5.0, 0), 0.5, rainbow_v));
+    auto rainbow_r = arena.make<metal>(color(1.0, 0, 0), 0.3);
+    auto rainbow_o = arena.make<metal>(color(1.0, 0.5, 0), 0.3);
+    auto rainbow_y = arena.make<metal>(color(1.0, 1.0, 0), 0.3);
+    auto rainbow_g = arena.make<metal>(color(0, 1.0, 0), 0.3);
+    auto rainbow_b = arena.make<metal>(color(0, 0, 1.0), 0.3);
+    auto rainbow_i = arena.make<metal>(color(0.3, 0, 0.5), 0.3);
+    auto rainbow_v = arena.make<metal>(color(0.6, 0, 0.8), 0.3);
+
+    objects.add(arena.make<sphere>(point3(-8.0, 5.0, 0), 0.5, rainbow_r));
+    objects.add(arena.make<sphere>(point3(-6.0 - sqrt(3), 6.0, 0), 0.5, rainbow_o));
+    objects.add(arena.make<sphere>(point3(-7.0, 5.0 + sqrt(3), 0), 0.5, rainbow_y));
+    objects.add(arena.make<sphere>(point3(-6.0, 7.0, 0), 0.5, rainbow_g));
+    objects.add(arena.make<sphere>(point3(-5.0, 5.0 + sqrt(3), 0), 0.5, rainbow_b));
+    objects.add(arena.make<sphere>(point3(-6.0 + sqrt(3), 6.0, 0), 0.5, rainbow_i));
+    objects.add(arena.make<sphere>(point3(-4.0, 5.0, 0), 0.5, rainbow_v));
 
     /* Spheres representing provided letters for final puzzle. */
-    // objects.add(make_shared<sphere>(point3(4.0, 5.0, 0), 0.5, text_R));
-    // objects.add(make_shared<sphere>(point3(5.0, 5.0, 0), 0.5, text_S));
-    // objects.add(make_shared<sphere>(point3(6.0, 5.0, 0), 0.5, text_T));
-    // objects.add(make_shared<sphere>(point3(7.0, 5.0, 0), 0.5, text_L));
-    // objects.add(make_shared<sphere>(point3(8.0, 5.0, 0), 0.5, text_N));
-    // objects.add(make_shared<sphere>(point3(9.0, 5.0, 0), 0.5, text_E));
+    // objects.add(arena.make<sphere>(point3(4.0, 5.0, 0), 0.5, text_R));
+    // objects.add(arena.make<sphere>(point3(5.0, 5.0, 0), 0.5, text_S));
+    // objects.add(arena.make<sphere>(point3(6.0, 5.0, 0), 0.5, text_T));
+    // objects.add(arena.make<sphere>(point3(7.0, 5.0, 0), 0.5, text_L));
+    // objects.add(arena.make<sphere>(point3(8.0, 5.0, 0), 0.5, text_N));
+    // objects.add(arena.make<sphere>(point3(9.0, 5.0, 0), 0.5, text_E));
 
     /* "HAPPY 22!" message. */
-    objects.add(make_shared<sphere>(point3(4.0, 8.0, 0), 0.5, text_H));
-    objects.add(make_shared<sphere>(point3(5.0, 8.0, 0), 0.5, text_A));
-    objects.add(make_shared<sphere>(point3(6.0, 8.0, 0), 0.5, text_P));
-    objects.add(make_shared<sphere>(point3(7.0, 8.0, 0), 0.5, text_P));
-    objects.add(make_shared<sphere>(point3(8.0, 8.0, 0), 0.5, text_Y));
+    objects.add(arena.make<sphere>(point3(4.0, 8.0, 0), 0.5, text_H));
+    objects.add(arena.make<sphere>(point3(5.0, 8.0, 0), 0.5, text_A));
+    objects.add(arena.make<sphere>(point3(6.0, 8.0, 0), 0.5, text_P));
+    objects.add(arena.make<sphere>(point3(7.0, 8.0, 0), 0.5, text_P));
+    objects.add(arena.make<sphere>(point3(8.0, 8.0, 0), 0.5, text_Y));
 
-    objects.add(make_shared<sphere>(point3(5.0, 7.0, 0), 0.5, text_2));
-    objects.add(make_shared<sphere>(point3(6.0, 7.0, 0), 0.5, text_2));
-    objects.add(make_shared<sphere>(point3(7.0, 7.0, 0), 0.5, text_excl));
+    objects.add(arena.make<sphere>(point3(5.0, 7.0, 0), 0.5, text_2));
+    objects.add(arena.make<sphere>(point3(6.0, 7.0, 0), 0.5, text_2));
+    objects.add(arena.make<sphere>(point3(7.0, 7.0, 0), 0.5, text_excl));
 
 
     /* "COMPUTER GRAPHICS IS COOL STUFF" text. */
-    // objects.add(make_shared<sphere>(point3(-8.0, 1.5, 0), 0.5, text_C));
-    // objects.add(make_shared<sphere>(point3(-7.0, 1.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(-6.0, 1.5, 0), 0.5, text_M));
-    // objects.add(make_shared<sphere>(point3(-5.0, 1.5, 0), 0.5, text_P));
-    // objects.add(make_shared<sphere>(point3(-4.0, 1.5, 0), 0.5, text_U));
-    // objects.add(make_shared<sphere>(point3(-3.0, 1.5, 0), 0.5, text_T));
-    // objects.add(make_shared<sphere>(point3(-2.0, 1.5, 0), 0.5, text_E));
-    // objects.add(make_shared<sphere>(point3(-1.0, 1.5, 0), 0.5, text_R));
-
-    // objects.add(make_shared<sphere>(point3(1.0, 1.5, 0), 0.5, text_G));
-    // objects.add(make_shared<sphere>(point3(2.0, 1.5, 0), 0.5, text_R));
-    // objects.add(make_shared<sphere>(point3(3.0, 1.5, 0), 0.5, text_A));
-    // objects.add(make_shared<sphere>(point3(4.0, 1.5, 0), 0.5, text_P));
-    // objects.add(make_shared<sphere>(point3(5.0, 1.5, 0), 0.5, text_H));
-    // objects.add(make_shared<sphere>(point3(6.0, 1.5, 0), 0.5, text_I));
-    // objects.add(make_shared<sphere>(point3(7.0, 1.5, 0), 0.5, text_C));
-    // objects.add(make_shared<sphere>(point3(8.0, 1.5, 0), 0.5, text_S));
-
-    // objects.add(make_shared<sphere>(point3(-6.0, 0.5, 0), 0.5, text_I));
-    // objects.add(make_shared<sphere>(point3(-5.0, 0.5, 0), 0.5, text_S));
-
-    // objects.add(make_shared<sphere>(point3(-3.0, 0.5, 0), 0.5, text_C));
-    // objects.add(make_shared<sphere>(point3(-2.0, 0.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(-1.0, 0.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(-0.0, 0.5, 0), 0.5, text_L));
-
-    // objects.add(make_shared<sphere>(point3(2.0, 0.5, 0), 0.5, text_S));
-    // objects.add(make_shared<sphere>(point3(3.0, 0.5, 0), 0.5, text_T));
-    // objects.add(make_shared<sphere>(point3(4.0, 0.5, 0), 0.5, text_U));
-    // objects.add(make_shared<sphere>(point3(5.0, 0.5, 0), 0.5, text_F));
-    // objects.add(make_shared<sphere>(point3(6.0, 0.5, 0), 0.5, text_F));
+    // objects.add(arena.make<sphere>(point3(-8.0, 1.5, 0), 0.5, text_C));
+    // objects.add(arena.make<sphere>(point3(-7.0, 1.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(-6.0, 1.5, 0), 0.5, text_M));
+    // objects.add(arena.make<sphere>(point3(-5.0, 1.5, 0), 0.5, text_P));
+    // objects.add(arena.make<sphere>(point3(-4.0, 1.5, 0), 0.5, text_U));
+    // objects.add(arena.make<sphere>(point3(-3.0, 1.5, 0), 0.5, text_T));
+    // objects.add(arena.make<sphere>(point3(-2.0, 1.5, 0), 0.5, text_E));
+    // objects.add(arena.make<sphere>(point3(-1.0, 1.5, 0), 0.5, text_R));
+
+    // objects.add(arena.make<sphere>(point3(1.0, 1.5, 0), 0.5, text_G));
+    // objects.add(arena.make<sphere>(point3(2.0, 1.5, 0), 0.5, text_R));
+    // objects.add(arena.make<sphere>(point3(3.0, 1.5, 0), 0.5, text_A));
+    // objects.add(arena.make<sphere>(point3(4.0, 1.5, 0), 0.5, text_P));
+    // objects.add(arena.make<sphere>(point3(5.0, 1.5, 0), 0.5, text_H));
+    // objects.add(arena.make<sphere>(point3(6.0, 1.5, 0), 0.5, text_I));
+    // objects.add(arena.make<sphere>(point3(7.0, 1.5, 0), 0.5, text_C));
+    // objects.add(arena.make<sphere>(point3(8.0, 1.5, 0), 0.5, text_S));
+
+    // objects.add(arena.make<sphere>(point3(-6.0, 0.5, 0), 0.5, text_I));
+    // objects.add(arena.make<sphere>(point3(-5.0, 0.5, 0), 0.5, text_S));
+
+    // objects.add(arena.make<sphere>(point3(-3.0, 0.5, 0), 0.5, text_C));
+    // objects.add(arena.make<sphere>(point3(-2.0, 0.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(-1.0, 0.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(-0.0, 0.5, 0), 0.5, text_L));
+
+    // objects.add(arena.make<sphere>(point3(2.0, 0.5, 0), 0.5, text_S));
+    // objects.add(arena.make<sphere>(point3(3.0, 0.5, 0), 0.5, text_T));
+    // objects.add(arena.make<sphere>(point3(4.0, 0.5, 0), 0.5, text_U));
+    // objects.add(arena.make<sphere>(point3(5.0, 0.5, 0), 0.5, text_F));
+    // objects.add(arena.make<sphere>(point3(6.0, 0.5, 0), 0.5, text_F));
 
     /* "WORKING CODE ISN'T ENOUGH" text. */
-    // objects.add(make_shared<sphere>(point3(-5.5, 1.5, 0), 0.5, text_W));
-    // objects.add(make_shared<sphere>(point3(-4.5, 1.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(-3.5, 1.5, 0), 0.5, text_R));
-    // objects.add(make_shared<sphere>(point3(-2.5, 1.5, 0), 0.5, text_K));
-    // objects.add(make_shared<sphere>(point3(-1.5, 1.5, 0), 0.5, text_I));
-    // objects.add(make_shared<sphere>(point3(-0.5, 1.5, 0), 0.5, text_N));
-    // objects.add(make_shared<sphere>(point3(0.5, 1.5, 0), 0.5, text_G));
-
-    // objects.add(make_shared<sphere>(point3(2.5, 1.5, 0), 0.5, text_C));
-    // objects.add(make_shared<sphere>(point3(3.5, 1.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(4.5, 1.5, 0), 0.5, text_D));
-    // objects.add(make_shared<sphere>(point3(5.5, 1.5, 0), 0.5, text_E));
-
-    // objects.add(make_shared<sphere>(point3(-5.5, 0.5, 0), 0.5, text_I));
-    // objects.add(make_shared<sphere>(point3(-4.5, 0.5, 0), 0.5, text_S));
-    // objects.add(make_shared<sphere>(point3(-3.5, 0.5, 0), 0.5, text_N));
-    // objects.add(make_shared<sphere>(point3(-2.5, 0.5, 0), 0.5, text_apos));
-    // objects.add(make_shared<sphere>(point3(-1.5, 0.5, 0), 0.5, text_T));
-
-    // objects.add(make_shared<sphere>(point3(0.5, 0.5, 0), 0.5, text_E));
-    // objects.add(make_shared<sphere>(point3(1.5, 0.5, 0), 0.5, text_N));
-    // objects.add(make_shared<sphere>(point3(2.5, 0.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(3.5, 0.5, 0), 0.5, text_U));
-    // objects.add(make_shared<sphere>(point3(4.5, 0.5, 0), 0.5, text_G));
-    // objects.add(make_shared<sphere>(point3(5.5, 0.5, 0), 0.5, text_H));
+    // objects.add(arena.make<sphere>(point3(-5.5, 1.5, 0), 0.5, text_W));
+    // objects.add(arena.make<sphere>(point3(-4.5, 1.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(-3.5, 1.5, 0), 0.5, text_R));
+    // objects.add(arena.make<sphere>(point3(-2.5, 1.5, 0), 0.5, text_K));
+    // objects.add(arena.make<sphere>(point3(-1.5, 1.5, 0), 0.5, text_I));
+    // objects.add(arena.make<sphere>(point3(-0.5, 1.5, 0), 0.5, text_N));
+    // objects.add(arena.make<sphere>(point3(0.5, 1.5, 0), 0.5, text_G));
+
+    // objects.add(arena.make<sphere>(point3(2.5, 1.5, 0), 0.5, text_C));
+    // objects.add(arena.make<sphere>(point3(3.5, 1.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(4.5, 1.5, 0), 0.5, text_D));
+    // objects.add(arena.make<sphere>(point3(5.5, 1.5, 0), 0.5, text_E));
+
+    // objects.add(arena.make<sphere>(point3(-5.5, 0.5, 0), 0.5, text_I));
+    // objects.add(arena.make<sphere>(point3(-4.5, 0.5, 0), 0.5, text_S));
+    // objects.add(arena.make<sphere>(point3(-3.5, 0.5, 0), 0.5, text_N));
+    // objects.add(arena.make<sphere>(point3(-2.5, 0.5, 0), 0.5, text_apos));
+    // objects.add(arena.make<sphere>(point3(-1.5, 0.5, 0), 0.5, text_T));
+
+    // objects.add(arena.make<sphere>(point3(0.5, 0.5, 0), 0.5, text_E));
+    // objects.add(arena.make<sphere>(point3(1.5, 0.5, 0), 0.5, text_N));
+    // objects.add(arena.make<sphere>(point3(2.5, 0.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(3.5, 0.5, 0), 0.5, text_U));
+    // objects.add(arena.make<sphere>(point3(4.5, 0.5, 0), 0.5, text_G));
+    // objects.add(arena.make<sphere>(point3(5.5, 0.5, 0), 0.5, text_H));
 
     /* "RUN LIKE YOU STOLE SOMETHING" text. */
-    // objects.add(make_shared<sphere>(point3(-5.5, 1.5, 0), 0.5, text_R));
-    // objects.add(make_shared<sphere>(point3(-4.5, 1.5, 0), 0.5, text_U));
-    // objects.add(make_shared<sphere>(point3(-3.5, 1.5, 0), 0.5, text_N));
-
-    // objects.add(make_shared<sphere>(point3(-1.5, 1.5, 0), 0.5, text_L));
-    // objects.add(make_shared<sphere>(point3(-0.5, 1.5, 0), 0.5, text_I));
-    // objects.add(make_shared<sphere>(point3(0.5, 1.5, 0), 0.5, text_K));
-    // objects.add(make_shared<sphere>(point3(1.5, 1.5, 0), 0.5, text_E));
-
-    // objects.add(make_shared<sphere>(point3(3.5, 1.5, 0), 0.5, text_Y));
-    // objects.add(make_shared<sphere>(point3(4.5, 1.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(5.5, 1.5, 0), 0.5, text_U));
-
-    // objects.add(make_shared<sphere>(point3(-7.0, 0.5, 0), 0.5, text_S));
-    // objects.add(make_shared<sphere>(point3(-6.0, 0.5, 0), 0.5, text_T));
-    // objects.add(make_shared<sphere>(point3(-5.0, 0.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(-4.0, 0.5, 0), 0.5, text_L));
-    // objects.add(make_shared<sphere>(point3(-3.0, 0.5, 0), 0.5, text_E));
-
-    // objects.add(make_shared<sphere>(point3(-1.0, 0.5, 0), 0.5, text_S));
-    // objects.add(make_shared<sphere>(point3(0.0, 0.5, 0), 0.5, text_O));
-    // objects.add(make_shared<sphere>(point3(1.0, 0.5, 0), 0.5, text_M));
-    // objects.add(make_shared<sphere>(point3(2.0, 0.5, 0), 0.5, text_E));
-    // objects.add(make_shared<sphere>(point3(3.0, 0.5, 0), 0.5, text_T));
-    // objects.add(make_shared<sphere>(point3(4.0, 0.5, 0), 0.5, text_H));
-    // objects.add(make_shared<sphere>(point3(5.0, 0.5, 0), 0.5, text_I));
-    // objects.add(make_shared<sphere>(point3(6.0, 0.5, 0), 0.5, text_N));
-    // objects.add(make_shared<sphere>(point3(7.0, 0.5, 0), 0.5, text_G));
+    // objects.add(arena.make<sphere>(point3(-5.5, 1.5, 0), 0.5, text_R));
+    // objects.add(arena.make<sphere>(point3(-4.5, 1.5, 0), 0.5, text_U));
+    // objects.add(arena.make<sphere>(point3(-3.5, 1.5, 0), 0.5, text_N));
+
+    // objects.add(arena.make<sphere>(point3(-1.5, 1.5, 0), 0.5, text_L));
+    // objects.add(arena.make<sphere>(point3(-0.5, 1.5, 0), 0.5, text_I));
+    // objects.add(arena.make<sphere>(point3(0.5, 1.5, 0), 0.5, text_K));
+    // objects.add(arena.make<sphere>(point3(1.5, 1.5, 0), 0.5, text_E));
+
+    // objects.add(arena.make<sphere>(point3(3.5, 1.5, 0), 0.5, text_Y));
+    // objects.add(arena.make<sphere>(point3(4.5, 1.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(5.5, 1.5, 0), 0.5, text_U));
+
+    // objects.add(arena.make<sphere>(point3(-7.0, 0.5, 0), 0.5, text_S));
+    // objects.add(arena.make<sphere>(point3(-6.0, 0.5, 0), 0.5, text_T));
+    // objects.add(arena.make<sphere>(point3(-5.0, 0.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(-4.0, 0.5, 0), 0.5, text_L));
+    // objects.add(arena.make<sphere>(point3(-3.0, 0.5, 0), 0.5, text_E));
+
+    // objects.add(arena.make<sphere>(point3(-1.0, 0.5, 0), 0.5, text_S));
+    // objects.add(arena.make<sphere>(point3(0.0, 0.5, 0), 0.5, text_O));
+    // objects.add(arena.make<sphere>(point3(1.0, 0.5, 0), 0.5, text_M));
+    // objects.add(arena.make<sphere>(point3(2.0, 0.5, 0), 0.5, text_E));
+    // objects.add(arena.make<sphere>(point3(3.0, 0.5, 0), 0.5, text_T));
+    // objects.add(arena.make<sphere>(point3(4.0, 0.5, 0), 0.5, text_H));
+    // objects.add(arena.make<sphere>(point3(5.0, 0.5, 0), 0.5, text_I));
+    // objects.add(arena.make<sphere>(point3(6.0, 0.5, 0), 0.5, text_N));
+    // objects.add(arena.make<sphere>(point3(7.0, 0.5, 0), 0.5, text_G));
 
     /* "HAPPINESS IS HAVING HOTPOT WITH YOU" text. */
-    objects.add(make_shared<sphere>(point3(-9.0, 1.5, 0), 0.5, text_H));
-    objects.add(make_shared<sphere>(point3(-8.0, 1.5, 0), 0.5, text_A));
-    objects.add(make_shared<sphere>(point3(-7.0, 1.5, 0), 0.5, text_P));
-    objects.add(make_shared<sphere>(point3(-6.0, 1.5, 0), 0.5, text_P));
-    objects.add(make_shared<sphere>(point3(-5.0, 1.5, 0), 0.5, text_I));
-    objects.add(make_shared<sphere>(point3(-4.0, 1.5, 0), 0.5, text_N));
-    objects.add(make_shared<sphere>(point3(-3.0, 1.5, 0), 0.5, text_E));
-    objects.add(make_shared<sphere>(point3(-2.0, 1.5, 0), 0.5, text_S));
-    objects.add(make_shared<sphere>(point3(-1.0, 1.5, 0), 0.5, text_S));
-
-    objects.add(make_shared<sphere>(point3(1.0, 1.5, 0), 0.5, text_I));
-    objects.add(make_shared<sphere>(point3(2.0, 1.5, 0), 0.5, text_S));
-
-    objects.add(make_shared<sphere>(point3(4.0, 1.5, 0), 0.5, text_H));
-    objects.add(make_shared<sphere>(point3(5.0, 1.5, 0), 0.5, text_A));
-    objects.add(make_shared<sphere>(point3(6.0, 1.5, 0), 0.5, text_V));
-    objects.add(make_shared<sphere>(point3(7.0, 1.5, 0), 0.5, text_I));
-    objects.add(make_shared<sphere>(point3(8.0, 1.5, 0), 0.5, text_N));
-    objects.add(make_shared<sphere>(point3(9.0, 1.5, 0), 0.5, text_G));
-
-    objects.add(make_shared<sphere>(point3(-7.0, 0.5, 0), 0.5, text_H));
-    objects.add(make_shared<sphere>(point3(-6.0, 0.5, 0), 0.5, text_O));
-    objects.add(make_shared<sphere>(point3(-5.0, 0.5, 0), 0.5, text_T));
-    objects.add(make_shared<sphere>(point3(-4.0, 0.5, 0), 0.5, text_P));
-    objects.add(make_shared<sphere>(point3(-3.0, 0.5, 0), 0.5, text_O));
-    objects.add(make_shared<sphere>(point3(-2.0, 0.5, 0), 0.5, text_T));
-
-    objects.add(make_shared<sphere>(point3(0.0, 0.5, 0), 0.5, text_W));
-    objects.add(make_shared<sphere>(point3(1.0, 0.5, 0), 0.5, text_I));
-    objects.add(make_shared<sphere>(point3(2.0, 0.5, 0), 0.5, text_T));
-    objects.add(make_shared<sphere>(point3(3.0, 0.5, 0), 0.5, text_H));
-
-    objects.add(make_shared<sphere>(point3(5.0, 0.5, 0), 0.5, text_Y));
-    objects.add(make_shared<sphere>(point3(6.0, 0.5, 0), 0.5, text_O));
-    objects.add(make_shared<sphere>(point3(7.0, 0.5, 0), 0.5, text_U));
+    objects.add(arena.make<sphere>(point3(-9.0, 1.5, 0), 0.5, text_H));
+    objects.add(arena.make<sphere>(point3(-8.0, 1.5, 0), 0.5, text_A));
+    objects.add(arena.make<sphere>(point3(-7.0, 1.5, 0), 0.5, text_P));
+    objects.add(arena.make<sphere>(point3(-6.0, 1.5, 0), 0.5, text_P));
+    objects.add(arena.make<sphere>(point3(-5.0, 1.5, 0), 0.5, text_I));
+    objects.add(arena.make<sphere>(point3(-4.0, 1.5, 0), 0.5, text_N));
+    objects.add(arena.make<sphere>(point3(-3.0, 1.5, 0), 0.5, text_E));
+    objects.add(arena.make<sphere>(point3(-2.0, 1.5, 0), 0.5, text_S));
+    objects.add(arena.make<sphere>(point3(-1.0, 1.5, 0), 0.5, text_S));
+
+    objects.add(arena.make<sphere>(point3(1.0, 1.5, 0), 0.5, text_I));
+    objects.add(arena.make<sphere>(point3(2.0, 1.5, 0), 0.5, text_S));
+
+    objects.add(arena.make<sphere>(point3(4.0, 1.5, 0), 0.5, text_H));
+    objects.add(arena.make<sphere>(point3(5.0, 1.5, 0), 0.5, text_A));
+    objects.add(arena.make<sphere>(point3(6.0, 1.5, 0), 0.5, text_V));
+    objects.add(arena.make<sphere>(point3(7.0, 1.5, 0), 0.5, text_I));
+    objects.add(arena.make<sphere>(point3(8.0, 1.5, 0), 0.5, text_N));
+    objects.add(arena.make<sphere>(point3(9.0, 1.5, 0), 0.5, text_G));
+
+    objects.add(arena.make<sphere>(point3(-7.0, 0.5, 0), 0.5, text_H));
+    objects.add(arena.make<sphere>(point3(-6.0, 0.5, 0), 0.5, text_O));
+    objects.add(arena.make<sphere>(point3(-5.0, 0.5, 0), 0.5, text_T));
+    objects.add(arena.make<sphere>(point3(-4.0, 0.5, 0), 0.5, text_P));
+    objects.add(arena.make<sphere>(point3(-3.0, 0.5, 0), 0.5, text_O));
+    objects.add(arena.make<sphere>(point3(-2.0, 0.5, 0), 0.5, text_T));
+
+    objects.add(arena.make<sphere>(point3(0.0, 0.5, 0), 0.5, text_W));
+    objects.add(arena.make<sphere>(point3(1.0, 0.5, 0), 0.5, text_I));
+    objects.add(arena.make<sphere>(point3(2.0, 0.5, 0), 0.5, text_T));
+    objects.add(arena.make<sphere>(point3(3.0, 0.5, 0), 0.5, text_H));
+
+    objects.add(arena.make<sphere>(point3(5.0, 0.5, 0), 0.5, text_Y));
+    objects.add(arena.make<sphere>(point3(6.0, 0.5, 0), 0.5, text_O));
+    objects.add(arena.make<sphere>(point3(7.0, 0.5, 0), 0.5, text_U));
 
     /* Build BVH of scene. */
-    return hittable_list(make_shared<bvh_node>(objects, 0.0, 1.0));
+    return hittable_list(arena.make<bvh_node>(objects, 0.0, 1.0, &arena));
 }
 
 /* Scene with object(s) as simple light(s) (case 5). */
-hittable_list simple_light() {
+hittable_list simple_light(scene_arena& arena) {
     hittable_list objects;
 
-    auto pertext = make_shared<noise_texture>(4);
-    objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000,
-                                    make_shared<lambertian>(pertext)));
-    objects.add(make_shared<sphere>(point3(0, 2, 0), 2,
-                                    make_shared<lambertian>(pertext)));
+    auto pertext = arena.make<noise_texture>(4);
+    objects.add(arena.make<sphere>(point3(0, -1000, 0), 1000,
+                                   arena.make<lambertian>(pertext)));
+    objects.add(arena.make<sphere>(point3(0, 2, 0), 2,
+                                   arena.make<lambertian>(pertext)));
 
-    auto difflight = make_shared<diffuse_light>(color(4, 4, 4));
-    auto difflight_dim = make_shared<diffuse_light>(color(1, 1, 1));
-    objects.add(make_shared<xy_rect>(3, 5, 1, 3, -2, difflight));
-    objects.add(make_shared<sphere>(point3(0, 6, 0), 1.5, difflight_dim));
+    auto difflight = arena.make<diffuse_light>(color(4, 4, 4));
+    auto difflight_dim = arena.make<diffuse_light>(color(1, 1, 1));
+    objects.add(arena.make<xy_rect>(3, 5, 1, 3, -2, difflight));
+    objects.add(arena.make<sphere>(point3(0, 6, 0), 1.5, difflight_dim));
 
     return objects;
 }
 
 /* Scene showing a basic "Cornell Box" (case 6). */
-hittable_list cornell_box() {
+hittable_list cornell_box(scene_arena& arena) {
     hittable_list objects;
 
-    auto red = make_shared<lambertian>(color(0.65, 0.05, 0.05));
-    auto white = make_shared<lambertian>(color(0.73, 0.73, 0.73));
-    auto green = make_shared<lambertian>(color(0.12, 0.45, 0.15));
-    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+    auto red = arena.make<lambertian>(color(0.65, 0.05, 0.05));
+    auto white = arena.make<lambertian>(color(0.73, 0.73, 0.73));
+    auto green = arena.make<lambertian>(color(0.12, 0.45, 0.15));
+    auto light = arena.make<diffuse_light>(color(15, 15, 15));
 
     /* Objects making up the room and ceiling light. */
-    objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
-    objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<xz_rect>(213, 343, 227, 332, 554, light));
-    objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
-    objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
-    objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+    objects.add(arena.make<yz_rect>(0, 555, 0, 555, 555, green));
+    objects.add(arena.make<yz_rect>(0, 555, 0, 555, 0, red));
+    objects.add(arena.make<xz_rect>(213, 343, 227, 332, 554, light));
+    objects.add(arena.make<xz_rect>(0, 555, 0, 555, 0, white));
+    objects.add(arena.make<xz_rect>(0, 555, 0, 555, 555, white));
+    objects.add(arena.make<xy_rect>(0, 555, 0, 555, 555, white));
 
     /* Two boxes in the room, rotated about Y. */
-    shared_ptr<hittable> box1 = make_shared<box>(point3(0, 0, 0),
-                                                 point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    shared_ptr<hittable> box1 = arena.make<box>(point3(0, 0, 0),
+                                                point3(165, 330, 165), white);
+    box1 = arena.make<rotate_y>(box1, 15);
+    box1 = arena.make<translate>(box1, vec3(265, 0, 295));
     objects.add(box1);
 
-    shared_ptr<hittable> box2 = make_shared<box>(point3(0, 0, 0),
-                                                 point3(165, 165, 165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+    shared_ptr<hittable> box2 = arena.make<box>(point3(0, 0, 0),
+                                                point3(165, 165, 165), white);
+    box2 = arena.make<rotate_y>(box2, -18);
+    box2 = arena.make<translate>(box2, vec3(130, 0, 65));
     objects.add(box2);
 
     return objects;
 }
 
+/* The world of a scene together with its view and render settings. */
+struct scene_setup {
+    hittable_list world;
+    color background = color(0, 0, 0);
+    point3 lookfrom;
+    point3 lookat;
+    double vfov = 40.0;
+    double aperture = 0.0;
+    double aspect_ratio = 16.0 / 9.0;
+    int image_width = 400;      /* Debugging: 400, production: 1600. */
+    int samples_per_pixel = 10; /* Debugging: 10, production: 20. */
+};
+
+/* Number of scenes that select_scene() knows about. */
+const int scene_count = 7;
+
+/* Names of the scenes, by index, after the functions building them. */
+const char* const scene_names[scene_count] = {
+    "random_scene", "two_spheres", "two_perlin_spheres", "earth",
+    "wheel_of_fortune", "simple_light", "cornell_box"
+};
+
+/* Builds scene number INDEX from ARENA and stores it with its
+   parameters in SETUP. Returns false if INDEX matches no scene. */
+bool select_scene(int index, scene_arena& arena, scene_setup& setup) {
+    switch(index) {
+
+        /* Random scene with many assorted spheres. */
+        case 0:
+            setup.world = random_scene(arena);
+            setup.background = color(0.7, 0.8, 1.0);
+            setup.lookfrom = point3(13, 2, 3);
+            setup.lookat = point3(0, 0, 0);
+            setup.vfov = 20.0;
+            setup.aperture = 0.1;
+            return true;
+
+        /* Scene with two checkered spheres. */
+        case 1:
+            setup.world = two_spheres(arena);
+            setup.background = color(0.7, 0.8, 1.0);
+            setup.lookfrom = point3(13, 2, 3);
+            setup.lookat = point3(0, 0, 0);
+            setup.vfov = 20.0;
+            return true;
+
+        /* Scene with two spheres with Perlin noise. */
+        case 2:
+            setup.world = two_perlin_spheres(arena);
+            setup.background = color(0.7, 0.8, 1.0);
+            setup.lookfrom = point3(13, 2, 3);
+            setup.lookat = point3(0, 0, 0);
+            setup.vfov = 20.0;
+            return true;
+
+        /* Scene with Earth image texture on sphere. */
+        case 3:
+            setup.world = earth(arena);
+            setup.background = color(0.7, 0.8, 1.0);
+            setup.lookfrom = point3(13, 2, 3);
+            setup.lookat = point3(0, 0, 0);
+            setup.vfov = 20.0;
+            return true;
+
+        /* Wheel of Fortune scene. */
+        case 4:
+            setup.world = wheel_of_fortune(arena);
+            setup.background = color(0.7, 0.8, 1.0);
+            setup.lookfrom = point3(0, 0, 30);
+            setup.lookat = point3(0, 3.5, 0);
+            setup.vfov = 20.0;
+            return true;
+
+        /* Scene with simple lights. */
+        case 5:
+            setup.world = simple_light(arena);
+            setup.samples_per_pixel = 400;
+            setup.background = color(0, 0, 0);
+            setup.lookfrom = point3(26, 3, 6);
+            setup.lookat = point3(0, 2, 0);
+            setup.vfov = 20.0;
+            return true;
+
+        /* Scene with a basic "Cornell box". */
+        case 6:
+            setup.world = cornell_box(arena);
+            setup.aspect_ratio = 1.0;
+            setup.image_width = 600;
+            setup.samples_per_pixel = 20;
+            setup.background = color(0, 0, 0);
+            setup.lookfrom = point3(278, 278, -800);
+            setup.lookat = point3(278, 278, 0);
+            setup.vfov = 40.0;
+            return true;
+
+        /* Provided scene index does not match any created scene. */
+        default:
+            return false;
+    }
+}
+
+/* Builds a scene showing MESH, in matte white on a gray floor under
+   a sky, with the camera framing the mesh's bounds from above and in
+   front (main --mesh). Returns false if the mesh has no triangles. */
+bool mesh_scene(shared_ptr<const mesh_data> mesh, scene_arena& arena,
+                scene_setup& setup) {
+    auto object = arena.make<triangle_mesh>(
+        mesh, arena.make<lambertian>(color(0.73, 0.73, 0.73)));
+    aabb bounds;
+    if (!object->bounding_box(0, 1, bounds))
+        return false;
+
+    point3 center = 0.5 * (bounds.min() + bounds.max());
+    double radius = fmax(0.5 * (bounds.max() - bounds.min()).length(), 1e-3);
+
+    /* The floor touches the bottom of the mesh and reaches well past
+       the edges of the view. */
+    double reach = 20 * radius;
+    setup.world.add(object);
+    setup.world.add(arena.make<xz_rect>(
+        center.x() - reach, center.x() + reach,
+        center.z() - reach, center.z() + reach, bounds.min().y(),
+        arena.make<lambertian>(color(0.5, 0.5, 0.5))));
+
+    /* At a vertical field of view of 30 degrees, a distance of four
+       radii fits the bounding sphere in the frame. */
+    setup.background = color(0.7, 0.8, 1.0);
+    setup.lookat = center;
+    setup.lookfrom = center + 4 * radius * unit_vector(vec3(1, 0.6, 2));
+    setup.vfov = 30.0;
+    return true;
+}
+
+/* Makes the camera viewing SETUP, with the shutter open over
+   [TIME0, TIME1]. */
+camera scene_camera(const scene_setup& setup, double time0 = 0.0,
+                    double time1 = 1.0) {
+    vec3 vup(0, 1, 0);
+    auto dist_to_focus = 10.0;
+    return camera(setup.lookfrom, setup.lookat, vup, setup.vfov,
+                  setup.aspect_ratio, setup.aperture, dist_to_focus,
+                  time0, time1);
+}
+
 #endif
@@ -18,14 +18,13 @@ public:
                      hit_record& rec) const override;
     virtual bool bounding_box(double time0, double time1,
                               aabb& output_box) const override;
-    
+    virtual void get_surface(const ray& r, hit_record& rec) const override;
+
 public:
     point3 center;                 /* Sphere center. */
     double radius;                 /* Sphere radius. */
     shared_ptr<material> mat_ptr;  /* Reference to sphere material. */
 
-private:
-
     /* Computes the U, V coordinates of a point P on a unit radius
        sphere with center at the origin, used for texture lookups. */
     static void get_sphere_uv(const point3& p, double& u, double& v) {
@@ -38,15 +37,31 @@ private:
         u = phi / (2*pi);
         v = theta / pi;
     }
+
+    /* Computes the derivatives DPDU and DPDV of the point with unit
+       normal N on a sphere of radius R with respect to the texture
+       coordinates of get_sphere_uv(). Returns false at the poles,
+       where DPDV is undefined. */
+    static bool get_sphere_tangents(const vec3& n, double r,
+                                    vec3& dpdu, vec3& dpdv) {
+        auto sin_theta = sqrt(n.x()*n.x() + n.z()*n.z());
+        if (sin_theta < 1e-9)
+            return false;
+
+        dpdu = 2*pi*r * vec3(n.z(), 0, -n.x());
+        dpdv = pi*r * vec3(-n.x()*n.y() / sin_theta, sin_theta,
+                           -n.y()*n.z() / sin_theta);
+        return true;
+    }
 };
 
-/* Solve for ray-sphere intersection using substitution of the ray
-   equation for ray R into the equation of a sphere and applying
-   the quadratic formula. T_MIN and T_MAX dictate the interval for
-   a valid hit, and properties of the intersection point (if any)
-   are stored in REC. */
-bool sphere::hit(const ray& r, double t_min, double t_max,
-                 hit_record& rec) const {
+/* Solve for the intersection of ray R with the sphere at CENTER with
+   radius RADIUS by substituting the ray equation into the equation
+   of the sphere and applying the quadratic formula. T_MIN and T_MAX
+   dictate the interval for a valid hit, and the distance to the
+   closest intersection point (if any) is stored in T. */
+inline bool hit_sphere(const point3& center, double radius, const ray& r,
+                       double t_min, double t_max, double& t) {
     vec3 oc = r.origin() - center;
     auto a = r.direction().length_squared();
     auto half_b = dot(oc, r.direction());
@@ -65,15 +80,36 @@ bool sphere::hit(const ray& r, double t_min, double t_max,
             return false;
     }
 
-    /* Store information about point of intersection in REC. */
-    rec.t = root;
+    t = root;
+    return true;
+}
+
+/* Solve for ray-sphere intersection with hit_sphere(). T_MIN and
+   T_MAX dictate the interval for a valid hit, and the distance to
+   the intersection point (if any) is stored in REC. */
+bool sphere::hit(const ray& r, double t_min, double t_max,
+                 hit_record& rec) const {
+    double root;
+    if (!hit_sphere(center, radius, r, t_min, t_max, root))
+        return false;
+
+    rec.set_hit(root, this);
+    return true;
+}
+
+/* Store information about the point of intersection of ray R in
+   REC, including the texture coordinates of the hit point. */
+void sphere::get_surface(const ray& r, hit_record& rec) const {
     rec.p = r.at(rec.t);
     auto outward_normal = (rec.p - center) / radius;
     rec.set_face_normal(r, outward_normal);
     get_sphere_uv(outward_normal, rec.u, rec.v);
-    rec.mat_ptr = mat_ptr;
+    rec.mat_ptr = mat_ptr.get();
 
-    return true;
+    vec3 dpdu, dpdv;
+    if (r.has_differentials &&
+        get_sphere_tangents(outward_normal, radius, dpdu, dpdv))
+        rec.set_footprint(r, dpdu, dpdv);
 }
 
 /* Constructs a bounding box for the sphere and stores it in
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "mipmap.h"
+#include "rtw_stb_image.h"
+#include "texture-io.h"
+
+/* Decodes images into the texture container format, which the
+   renderer maps and samples without decoding. Each container is
+   written next to its image (images/wof.png -> images/wof.rttex),
+   where image textures pick it up automatically.
+
+   Usage: texconv [--no-mipmaps] image... */
+int main(int argc, char** argv) {
+    bool mipmaps = true;
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "--no-mipmaps") == 0) {
+        mipmaps = false;
+        first = 2;
+    }
+
+    if (first >= argc) {
+        std::cerr << "Usage: " << argv[0] << " [--no-mipmaps] image...\n";
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = first; i < argc; i++) {
+        std::string input = argv[i];
+        std::string output = texture_container_path(input);
+
+        auto start = std::chrono::steady_clock::now();
+        int width, height;
+        int components_per_pixel = 3;
+        auto data = stbi_load(input.c_str(), &width, &height,
+                              &components_per_pixel, components_per_pixel);
+        if (!data) {
+            std::cerr << "ERROR: Could not load texture image file '"
+                      << input << "'.\n";
+            failures++;
+            continue;
+        }
+
+        mip_pyramid image;
+        image.build(data, width, height, mipmaps);
+        stbi_image_free(data);
+        std::chrono::duration<double> decode_time =
+            std::chrono::steady_clock::now() - start;
+
+        if (!save_texture(image, output)) {
+            std::cerr << "ERROR: Could not write texture file '"
+                      << output << "'.\n";
+            failures++;
+            continue;
+        }
+
+        std::cerr << output << ": " << width << "x" << height << ", "
+                  << image.levels.size() << " levels, "
+                  << image.memory_size() << " bytes, decoded in "
+                  << decode_time.count() << " s\n";
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,639 @@
+#ifndef TEXTURE_BAKE_H
+#define TEXTURE_BAKE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <sys/stat.h>
+#include "aarect.h"
+#include "box.h"
+#include "bvh.h"
+#include "hittable-list.h"
+#include "material.h"
+#include "moving-sphere.h"
+#include "sphere.h"
+#include "texture.h"
+#include "triangle-mesh.h"
+#include "util.h"
+
+/*
+   Baking of noise textures into grids of gray levels (baked_texture),
+   so that renders interpolate the grid instead of evaluating several
+   octaves of Perlin noise at every hit.
+
+   Each object whose lambertian material uses a noise texture gets its
+   own bake covering only that object: spheres and rectangles over
+   their texture coordinates, anything else over the volume of its
+   bounding box. The resolution is the coarsest at which the estimated
+   error stays within a tolerance; objects that would need more memory
+   than allowed (e.g. a huge ground sphere) keep the procedural noise.
+
+   Bakes are stored in a cache directory and mapped back in by later
+   renders of the same object and texture, which then skip the noise
+   entirely.
+*/
+
+struct bake_options {
+    double tolerance = 0.01;            /* RMS error allowed in the gray level. */
+    size_t max_bytes = size_t(64) << 20; /* Largest grid for one object. */
+    int threads = 0;                    /* Baking threads; 0 for one per core. */
+    std::string cache_dir = "bake-cache"; /* Empty to disable the cache. */
+};
+
+/*
+   The region of space a bake covers, as a map from grid coordinates
+   S, T, R in [0, 1] to points in the scene. Surface domains ignore R.
+*/
+class bake_domain {
+public:
+    enum shape_kind { sphere_surface, rect_surface, box_volume };
+
+    /* Returns the scene point at grid coordinates S, T, R. */
+    point3 point(double s, double t, double r) const {
+        point3 p;
+        switch (shape) {
+            case sphere_surface: {
+                auto phi = 2*pi*s;
+                auto theta = pi*t;
+                p = center + radius * vec3(-cos(phi) * sin(theta), -cos(theta),
+                                           sin(phi) * sin(theta));
+                break;
+            }
+
+            case rect_surface:
+                p[a_axis] = a0 + s * (a1-a0);
+                p[b_axis] = b0 + t * (b1-b0);
+                p[k_axis] = k;
+                break;
+
+            case box_volume:
+                return box.min() + vec3(s, t, r) * (box.max() - box.min());
+        }
+        return object_to_world.point(p);
+    }
+
+    int dimensions() const { return shape == box_volume ? 3 : 2; }
+
+    /* Returns the length in the scene of the line through the middle
+       of the domain along grid AXIS, which sets the sample spacing. */
+    double extent(int axis) const {
+        const int segments = 64;
+        double length = 0;
+        point3 last;
+        for (int i = 0; i <= segments; i++) {
+            double c[3] = { 0.5, 0.5, 0.5 };
+            c[axis] = static_cast<double>(i) / segments;
+            auto p = point(c[0], c[1], c[2]);
+            if (i > 0)
+                length += (p - last).length();
+            last = p;
+        }
+        return length;
+    }
+
+public:
+    shape_kind shape;
+    affine object_to_world;  /* Surface shapes are in object space. */
+
+    point3 center;           /* Sphere. */
+    double radius;
+
+    int a_axis, b_axis, k_axis;  /* Rectangle, as in hit_axis_rect(). */
+    double a0, a1, b0, b1, k;
+
+    aabb box;                /* Volume, in scene space. */
+};
+
+/*
+   Cached bake file layout (little-endian):
+       bake_file_header
+       float values[nx * ny * nz]   at values_offset
+
+   KEY identifies the texture, domain and options the bake was made
+   for (see bake_key()).
+*/
+
+const char bake_file_magic[8] = { 'R', 'T', 'B', 'A', 'K', 'E', 0, 0 };
+const uint32_t bake_file_version = 1;
+
+struct bake_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t mapping;
+    uint64_t key;
+    uint32_t size[3];
+    uint32_t reserved;
+    double bounds_min[3], bounds_max[3];
+    uint64_t values_offset;
+};
+
+/* Returns a 64-bit FNV-1a hash of SIZE bytes at DATA, continuing from
+   hash H. */
+inline uint64_t fnv1a(const void* data, size_t size,
+                      uint64_t h = 14695981039346656037ull) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* Identifies a bake of TEX over DOMAIN by hashing the scene points
+   and gray levels on a lattice across the domain, along with the
+   options that pick the resolution. Any change to the noise, its
+   scale or the object's placement changes the key. */
+uint64_t bake_key(const noise_texture& tex, const bake_domain& domain,
+                  const bake_options& options) {
+    const int probes = 5;
+    std::vector<point3> points;
+    for (int i = 0; i < probes; i++)
+        for (int j = 0; j < probes; j++)
+            for (int l = 0; l < (domain.dimensions() == 3 ? probes : 1); l++)
+                points.push_back(domain.point((i + 0.37) / probes,
+                                              (j + 0.61) / probes,
+                                              (l + 0.29) / probes));
+
+    std::vector<double> gray(points.size());
+    tex.intensity(points.data(), gray.data(), static_cast<int>(points.size()));
+
+    uint64_t h = fnv1a(&bake_file_version, sizeof(bake_file_version));
+    int shape = domain.shape;
+    h = fnv1a(&shape, sizeof(shape), h);
+    h = fnv1a(points.data(), points.size() * sizeof(point3), h);
+    h = fnv1a(gray.data(), gray.size() * sizeof(double), h);
+    h = fnv1a(&options.tolerance, sizeof(options.tolerance), h);
+    h = fnv1a(&options.max_bytes, sizeof(options.max_bytes), h);
+    return h;
+}
+
+/* Returns the cache file for KEY in OPTIONS.cache_dir. */
+inline std::string bake_cache_path(uint64_t key, const bake_options& options) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.rtbake",
+             static_cast<unsigned long long>(key));
+    return options.cache_dir + "/" + name;
+}
+
+/* Writes BAKED to PATH, through a temporary file that is renamed into
+   place so concurrent renders never read a partial bake. Returns
+   false if the file could not be written. */
+bool save_bake(const baked_texture& baked, uint64_t key,
+               const std::string& path) {
+    bake_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, bake_file_magic, sizeof(h.magic));
+    h.version = bake_file_version;
+    h.mapping = baked.mapping;
+    h.key = key;
+    h.size[0] = baked.nx;
+    h.size[1] = baked.ny;
+    h.size[2] = baked.nz;
+    for (int a = 0; a < 3; a++) {
+        h.bounds_min[a] = baked.bounds.min()[a];
+        h.bounds_max[a] = baked.bounds.max()[a];
+    }
+    h.values_offset = sizeof(h);
+
+    auto temporary = path + ".tmp";
+    FILE* f = fopen(temporary.c_str(), "wb");
+    if (!f)
+        return false;
+
+    size_t count = static_cast<size_t>(baked.nx) * baked.ny * baked.nz;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(baked.values, sizeof(float), count, f) == count;
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* Maps the bake at PATH into BAKED if it exists and was made for KEY.
+   Returns false otherwise. */
+bool load_bake(const std::string& path, uint64_t key, baked_texture& baked) {
+    if (!baked.file.open(path))
+        return false;
+
+    auto header = baked.file.view<bake_file_header>(0, 1);
+    if (header.empty()) {
+        baked.file.close();
+        return false;
+    }
+
+    /* The grid must fit the file, so its size is found without
+       overflow, and a surface bake has a single slice. */
+    const bake_file_header& h = header[0];
+    size_t count = 1;
+    bool sizes_valid = h.mapping <= baked_texture::volume &&
+        (h.mapping == baked_texture::volume || h.size[2] == 1);
+    for (int a = 0; a < 3 && sizes_valid; a++) {
+        sizes_valid = h.size[a] > 0 && h.size[a] <= INT32_MAX &&
+                      count <= baked.file.size() / h.size[a];
+        count *= h.size[a];
+    }
+
+    auto values = sizes_valid ? baked.file.view<float>(h.values_offset, count)
+                              : array_view<float>();
+    if (memcmp(h.magic, bake_file_magic, sizeof(h.magic)) != 0 ||
+        h.version != bake_file_version || h.key != key || !sizes_valid ||
+        values.size() != count) {
+        baked.file.close();
+        return false;
+    }
+
+    baked.mapping = static_cast<baked_texture::mapping_kind>(h.mapping);
+    baked.nx = h.size[0];
+    baked.ny = h.size[1];
+    baked.nz = h.size[2];
+    baked.bounds = aabb(point3(h.bounds_min[0], h.bounds_min[1], h.bounds_min[2]),
+                        point3(h.bounds_max[0], h.bounds_max[1], h.bounds_max[2]));
+    baked.values = values.data();
+    return true;
+}
+
+/* Returns the number of samples along each grid axis of DOMAIN when
+   samples are SPACING apart in the scene. */
+inline void bake_grid_size(const bake_domain& domain, double spacing,
+                           int size[3]) {
+    for (int a = 0; a < 3; a++) {
+        if (a >= domain.dimensions())
+            size[a] = 1;
+        else
+            size[a] = std::max(2, static_cast<int>(ceil(domain.extent(a) / spacing)) + 1);
+    }
+}
+
+/* Estimates the RMS error of interpolating TEX over DOMAIN from a grid
+   of SIZE samples, at random points. Each point is compared against
+   the interpolation of the exact samples at the corners of its cell,
+   so no grid has to be baked to measure it. */
+double bake_error(const noise_texture& tex, const bake_domain& domain,
+                  const int size[3]) {
+    const int trials = 1024;
+    const int corners = domain.dimensions() == 3 ? 8 : 4;
+
+    /* A fixed seed keeps the choice repeatable, and leaves the
+       renderer's own random sequence untouched. */
+    std::mt19937_64 rng(12345);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    std::vector<point3> points;
+    std::vector<double> weights;
+    for (int trial = 0; trial < trials; trial++) {
+        double cell[3], frac[3];
+        for (int a = 0; a < 3; a++) {
+            auto x = uniform(rng) * (size[a]-1);
+            cell[a] = std::min(floor(x), static_cast<double>(std::max(size[a]-2, 0)));
+            frac[a] = x - cell[a];
+        }
+
+        auto coordinate = [&](int a, int offset) {
+            return size[a] > 1 ? (cell[a] + offset) / (size[a]-1) : 0.5;
+        };
+        points.push_back(domain.point(coordinate(0, 0) + frac[0] / std::max(size[0]-1, 1),
+                                      coordinate(1, 0) + frac[1] / std::max(size[1]-1, 1),
+                                      coordinate(2, 0) + frac[2] / std::max(size[2]-1, 1)));
+        for (int c = 0; c < corners; c++) {
+            int di = c & 1, dj = (c >> 1) & 1, dk = (c >> 2) & 1;
+            points.push_back(domain.point(coordinate(0, di), coordinate(1, dj),
+                                          coordinate(2, dk)));
+            weights.push_back((di ? frac[0] : 1-frac[0])
+                            * (dj ? frac[1] : 1-frac[1])
+                            * (corners == 8 ? (dk ? frac[2] : 1-frac[2]) : 1));
+        }
+    }
+
+    std::vector<double> gray(points.size());
+    tex.intensity(points.data(), gray.data(), static_cast<int>(points.size()));
+
+    double sum = 0;
+    for (int trial = 0; trial < trials; trial++) {
+        const double* g = &gray[trial * (corners+1)];
+        double interpolated = 0;
+        for (int c = 0; c < corners; c++)
+            interpolated += weights[trial * corners + c] * g[1+c];
+        sum += (interpolated - g[0]) * (interpolated - g[0]);
+    }
+    return sqrt(sum / trials);
+}
+
+/* Fills BAKED with TEX sampled on its grid over DOMAIN, one row of
+   samples at a time from a shared counter across THREADS threads. */
+void bake_samples(const noise_texture& tex, const bake_domain& domain,
+                  baked_texture& baked, int threads) {
+    int nx = baked.nx, ny = baked.ny, nz = baked.nz;
+    baked.storage.resize(static_cast<size_t>(nx) * ny * nz);
+    std::atomic<int> next_row(0);
+
+    auto worker = [&]() {
+        std::vector<point3> points(nx);
+        std::vector<double> gray(nx);
+        for (int row = next_row++; row < ny * nz; row = next_row++) {
+            int j = row % ny, k = row / ny;
+            for (int i = 0; i < nx; i++)
+                points[i] = domain.point(static_cast<double>(i) / (nx-1),
+                                         ny > 1 ? static_cast<double>(j) / (ny-1) : 0,
+                                         nz > 1 ? static_cast<double>(k) / (nz-1) : 0);
+            tex.intensity(points.data(), gray.data(), nx);
+
+            float* out = &baked.storage[static_cast<size_t>(row) * nx];
+            for (int i = 0; i < nx; i++)
+                out[i] = static_cast<float>(gray[i]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& thread : pool)
+        thread.join();
+
+    baked.values = baked.storage.data();
+}
+
+/* Bakes TEX over DOMAIN at the coarsest resolution meeting
+   OPTIONS.tolerance, or maps a cached bake of it. Returns null if no
+   resolution within OPTIONS.max_bytes is accurate enough. */
+shared_ptr<baked_texture> bake_noise_texture(const noise_texture& tex,
+                                             const bake_domain& domain,
+                                             const bake_options& options) {
+    auto baked = make_shared<baked_texture>();
+    baked->mapping = domain.dimensions() == 3 ? baked_texture::volume
+                                              : baked_texture::surface;
+    if (domain.shape == bake_domain::box_volume)
+        baked->bounds = domain.box;
+
+    uint64_t key = bake_key(tex, domain, options);
+    auto path = options.cache_dir.empty() ? std::string()
+                                          : bake_cache_path(key, options);
+    if (!path.empty() && load_bake(path, key, *baked))
+        return baked;
+
+    /* Refine the spacing in steps of sqrt(2) from an eighth of the
+       domain, until the error is small enough or the grid too big. */
+    double largest = 0;
+    for (int a = 0; a < domain.dimensions(); a++)
+        largest = std::max(largest, domain.extent(a));
+
+    int size[3];
+    bool found = false;
+    for (double spacing = largest / 8; ; spacing /= sqrt(2.0)) {
+        bake_grid_size(domain, spacing, size);
+        size_t bytes = static_cast<size_t>(size[0]) * size[1] * size[2]
+                       * sizeof(float);
+        if (bytes > options.max_bytes || spacing <= 0)
+            break;
+        if (bake_error(tex, domain, size) <= options.tolerance) {
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+        return nullptr;
+
+    baked->nx = size[0];
+    baked->ny = size[1];
+    baked->nz = size[2];
+
+    int threads = options.threads > 0 ? options.threads
+                : std::max(1u, std::thread::hardware_concurrency());
+    bake_samples(tex, domain, *baked, threads);
+
+    if (!path.empty()) {
+        mkdir(options.cache_dir.c_str(), 0755);
+        if (!save_bake(*baked, key, path))
+            std::cerr << "WARNING: Could not write texture bake '" << path
+                      << "'.\n";
+    }
+    return baked;
+}
+
+/*
+   The scene pass that replaces noise textures with bakes.
+*/
+class noise_baker {
+public:
+    noise_baker(const bake_options& _options) : options(_options) {}
+
+    /* Records each placement of OBJECT and the objects in it, when
+       OBJECT is placed in the scene by TO_WORLD. */
+    void place(const shared_ptr<hittable>& object, const affine& to_world);
+
+    /* Visits OBJECT, placed in the scene by TO_WORLD, baking the
+       objects in it that place() found in one placement only. */
+    void visit(const shared_ptr<hittable>& object, const affine& to_world);
+
+public:
+    int baked = 0;            /* Objects given a bake. */
+    int skipped = 0;          /* Objects left procedural. */
+    size_t memory_size = 0;   /* Bytes of samples baked or mapped. */
+
+private:
+    /* Returns the noise texture of M if it is a lambertian material
+       with one, else null. */
+    static const noise_texture* noise_of(const material* m) {
+        if (!m || typeid(*m) != typeid(lambertian))
+            return nullptr;
+        auto albedo = static_cast<const lambertian*>(m)->albedo.get();
+        if (!albedo || typeid(*albedo) != typeid(noise_texture))
+            return nullptr;
+        return static_cast<const noise_texture*>(albedo);
+    }
+
+    /* Calls FN(child, child_to_world) for each object directly inside
+       OBJECT, placed in the scene by TO_WORLD, and returns true. Returns
+       false if OBJECT holds no other objects. */
+    template <typename Fn>
+    static bool for_each_child(const shared_ptr<hittable>& object,
+                               const affine& to_world, Fn&& fn);
+
+    /* Bakes the noise of material MAT of OBJECT over DOMAIN and points
+       MAT at a new material using the bake. The material is shared by
+       every placement of OBJECT, so one placed several times keeps its
+       noise. */
+    void bake(const hittable* object, shared_ptr<material>& mat,
+              const bake_domain& domain);
+
+    bake_options options;
+    std::unordered_set<const hittable*> visited;
+
+    /* The distinct transforms each object is placed in the scene by. */
+    std::unordered_map<const hittable*, std::vector<affine>> placements;
+};
+
+template <typename Fn>
+bool noise_baker::for_each_child(const shared_ptr<hittable>& object,
+                                 const affine& to_world, Fn&& fn) {
+    if (auto list = std::dynamic_pointer_cast<hittable_list>(object)) {
+        for (auto& child : list->objects)
+            fn(child, to_world);
+        return true;
+    }
+    if (auto node = std::dynamic_pointer_cast<bvh_node>(object)) {
+        fn(node->left, to_world);
+        fn(node->right, to_world);
+        return true;
+    }
+    if (auto b = std::dynamic_pointer_cast<box>(object)) {
+        for (auto& side : b->sides.objects)
+            fn(side, to_world);
+        return true;
+    }
+    if (auto t = std::dynamic_pointer_cast<transformed>(object)) {
+        fn(t->ptr, to_world * t->object_to_world);
+        return true;
+    }
+    return false;
+}
+
+void noise_baker::place(const shared_ptr<hittable>& object,
+                        const affine& to_world) {
+    if (!object)
+        return;
+
+    /* An object reached again by the same transform adds nothing. */
+    auto& seen = placements[object.get()];
+    for (const auto& m : seen)
+        if (memcmp(m.m, to_world.m, sizeof(m.m)) == 0)
+            return;
+    seen.push_back(to_world);
+
+    for_each_child(object, to_world, [&](const shared_ptr<hittable>& child,
+                                         const affine& child_to_world) {
+        place(child, child_to_world);
+    });
+}
+
+void noise_baker::visit(const shared_ptr<hittable>& object,
+                        const affine& to_world) {
+    if (!object || !visited.insert(object.get()).second)
+        return;
+
+    if (for_each_child(object, to_world, [&](const shared_ptr<hittable>& child,
+                                             const affine& child_to_world) {
+            visit(child, child_to_world);
+        }))
+        return;
+
+    bake_domain domain;
+    domain.object_to_world = to_world;
+
+    if (auto s = std::dynamic_pointer_cast<sphere>(object)) {
+        if (!noise_of(s->mat_ptr.get()))
+            return;
+        domain.shape = bake_domain::sphere_surface;
+        domain.center = s->center;
+        domain.radius = s->radius;
+        bake(object.get(), s->mat_ptr, domain);
+        return;
+    }
+
+    domain.shape = bake_domain::rect_surface;
+    if (auto r = std::dynamic_pointer_cast<xy_rect>(object)) {
+        if (!noise_of(r->mp.get()))
+            return;
+        domain.a_axis = 0; domain.b_axis = 1; domain.k_axis = 2;
+        domain.a0 = r->x0; domain.a1 = r->x1;
+        domain.b0 = r->y0; domain.b1 = r->y1; domain.k = r->k;
+        bake(object.get(), r->mp, domain);
+        return;
+    }
+    if (auto r = std::dynamic_pointer_cast<xz_rect>(object)) {
+        if (!noise_of(r->mp.get()))
+            return;
+        domain.a_axis = 0; domain.b_axis = 2; domain.k_axis = 1;
+        domain.a0 = r->x0; domain.a1 = r->x1;
+        domain.b0 = r->z0; domain.b1 = r->z1; domain.k = r->k;
+        bake(object.get(), r->mp, domain);
+        return;
+    }
+    if (auto r = std::dynamic_pointer_cast<yz_rect>(object)) {
+        if (!noise_of(r->mp.get()))
+            return;
+        domain.a_axis = 1; domain.b_axis = 2; domain.k_axis = 0;
+        domain.a0 = r->y0; domain.a1 = r->y1;
+        domain.b0 = r->z0; domain.b1 = r->z1; domain.k = r->k;
+        bake(object.get(), r->mp, domain);
+        return;
+    }
+
+    /* Anything else is baked over the volume of its bounds. */
+    shared_ptr<material>* mat = nullptr;
+    if (auto m = std::dynamic_pointer_cast<moving_sphere>(object))
+        mat = &m->mat_ptr;
+    else if (auto m = std::dynamic_pointer_cast<triangle_mesh>(object))
+        mat = &m->mat_ptr;
+
+    aabb local;
+    if (!mat || !noise_of(mat->get()) || !object->bounding_box(0, 1, local))
+        return;
+
+    point3 lo(infinity, infinity, infinity), hi(-infinity, -infinity, -infinity);
+    for (int c = 0; c < 8; c++) {
+        point3 corner((c & 1 ? local.max() : local.min()).x(),
+                      (c & 2 ? local.max() : local.min()).y(),
+                      (c & 4 ? local.max() : local.min()).z());
+        auto p = to_world.point(corner);
+        for (int a = 0; a < 3; a++) {
+            lo[a] = fmin(lo[a], p[a]);
+            hi[a] = fmax(hi[a], p[a]);
+        }
+    }
+    domain.shape = bake_domain::box_volume;
+    domain.object_to_world = affine();
+    domain.box = aabb(lo, hi);
+    bake(object.get(), *mat, domain);
+}
+
+void noise_baker::bake(const hittable* object, shared_ptr<material>& mat,
+                       const bake_domain& domain) {
+    if (placements[object].size() > 1) {
+        skipped++;
+        return;
+    }
+
+    auto tex = noise_of(mat.get());
+    auto result = bake_noise_texture(*tex, domain, options);
+    if (!result) {
+        skipped++;
+        return;
+    }
+
+    baked++;
+    memory_size += result->memory_size();
+    mat = make_shared<lambertian>(result);
+}
+
+/* Replaces the noise textures of the objects in WORLD with bakes, as
+   described above. Objects that share a noise texture each get their
+   own bake, and the original materials are left untouched for any
+   other users. An object placed in the scene by several transforms
+   keeps its noise, since a bake covers one placement. */
+void bake_noise_textures(hittable_list& world,
+                         const bake_options& options = bake_options()) {
+    noise_baker baker(options);
+    for (auto& object : world.objects)
+        baker.place(object, affine());
+    for (auto& object : world.objects)
+        baker.visit(object, affine());
+
+    std::cerr << "Baked noise textures for " << baker.baked << " objects ("
+              << baker.memory_size << " bytes), left " << baker.skipped
+              << " procedural.\n";
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "mapped-file.h"
+#include "mipmap.h"
+#include "rtw_stb_image.h"
+#include "texture-io.h"
+#include "util.h"
+
+/*
+   The texels of one image file, shared read-only by every texture
+   that uses the file. The file is only loaded on the first call to
+   pyramid(), so images that no visible surface samples are never
+   loaded. Loading is safe to trigger from several threads at once.
+
+   If PATH is a texture container, or an up-to-date container made
+   from PATH sits next to it (see texture_container_path()), the
+   container is mapped and sampled in place. Otherwise the image is
+   decoded and built into a MIP pyramid in memory.
+*/
+class image_data {
+public:
+    image_data(const std::string& _path) : path(_path), loaded(false) {}
+
+    image_data(const image_data&) = delete;
+    image_data& operator=(const image_data&) = delete;
+
+    /* Returns the image, which is empty if the file could not be
+       loaded. */
+    const mip_pyramid& pyramid() const {
+        if (!loaded.load(std::memory_order_acquire))
+            load();
+        return image;
+    }
+
+    /* Bytes held in memory by the decoded image (0 until decoded,
+       or if the image is mapped from a container). */
+    size_t memory_size() const {
+        return loaded && !file.is_open() ? image.memory_size() : 0;
+    }
+
+public:
+    const std::string path;  /* File the image is decoded from. */
+
+private:
+    void load() const;
+
+    mutable std::mutex load_mutex;
+    mutable std::atomic<bool> loaded;
+    mutable mip_pyramid image;
+    mutable mapped_file file;  /* The container, if mapped. */
+};
+
+/* Loads the image, unless another thread did so while this one
+   waited for the lock. */
+void image_data::load() const {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    if (loaded.load(std::memory_order_relaxed))
+        return;
+
+    auto container = is_texture_container(path) ? path
+                                                : texture_container_path(path);
+    if (container_is_current(container, path) &&
+        load_texture(container, file, image)) {
+        loaded.store(true, std::memory_order_release);
+        return;
+    }
+
+    int width, height;
+    int components_per_pixel = 3;
+    auto data = stbi_load(path.c_str(), &width, &height,
+                          &components_per_pixel, components_per_pixel);
+
+    if (data) {
+        image.build(data, width, height);
+        stbi_image_free(data);
+    }
+    else {
+        std::cerr << "ERROR: Could not load texture image file '"
+                  << path << "'.\n";
+    }
+
+    loaded.store(true, std::memory_order_release);
+}
+
+/*
+   A process-wide cache of images keyed by file path, so each file is
+   decoded at most once however many textures or scenes refer to it.
+   Entries stay cached until clear() is called.
+*/
+class texture_cache {
+public:
+    /* Returns the cache shared by the whole process. */
+    static texture_cache& global() {
+        static texture_cache cache;
+        return cache;
+    }
+
+    /* Returns the shared handle for the image at PATH. The image is
+       not decoded until its pixels are first requested. */
+    shared_ptr<const image_data> get(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& entry = images[path];
+        if (!entry)
+            entry = make_shared<image_data>(path);
+        return entry;
+    }
+
+    /* Number of images known to the cache, decoded or not. */
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return images.size();
+    }
+
+    /* Bytes held by decoded images. */
+    size_t memory_size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t total = 0;
+        for (const auto& entry : images)
+            total += entry.second->memory_size();
+        return total;
+    }
+
+    /* Drops the cache's references. Images stay alive while any
+       texture still holds a handle to them. */
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        images.clear();
+    }
+
+private:
+    texture_cache() {}
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, shared_ptr<const image_data>> images;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef TEXTURE_IO_H
+#define TEXTURE_IO_H
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "mapped-file.h"
+#include "mipmap.h"
+
+/*
+   Loading and saving of the texture container format, which holds an
+   image already decoded into the tiled MIP pyramid layout used by
+   mip_pyramid. Loading maps the file and points the pyramid straight
+   at it, so texels are only read from disk as lookups touch them, and
+   processes rendering with the same file share its pages.
+
+   Texture file layout (little-endian):
+       texture_file_header
+       mip_level levels[level_count]   at levels_offset
+       tiles of every level            at texels_offset
+
+   Level offsets are relative to texels_offset, which is aligned to a
+   cache line like every tile.
+*/
+
+const char texture_file_magic[8] = { 'R', 'T', 'T', 'E', 'X', 0, 0, 0 };
+const uint32_t texture_file_version = 1;
+
+struct texture_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t level_count;
+    uint64_t levels_offset;
+    uint64_t texels_offset;
+    uint64_t texels_size;
+};
+
+/* Returns the container path for the image at PATH, which replaces
+   its extension with ".rttex" (e.g. images/wof.png -> images/wof.rttex). */
+inline std::string texture_container_path(const std::string& path) {
+    auto slash = path.find_last_of('/');
+    auto dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + ".rttex";
+    return path.substr(0, dot) + ".rttex";
+}
+
+/* Returns true if PATH names a texture container. */
+inline bool is_texture_container(const std::string& path) {
+    return path.size() >= 6 && path.compare(path.size() - 6, 6, ".rttex") == 0;
+}
+
+/* Returns true if the container CONTAINER exists and is at least as
+   new as the image SOURCE it was converted from. */
+inline bool container_is_current(const std::string& container,
+                                 const std::string& source) {
+    struct stat container_stat, source_stat;
+    if (stat(container.c_str(), &container_stat) != 0)
+        return false;
+    if (stat(source.c_str(), &source_stat) != 0)
+        return true;
+    return container_stat.st_mtime >= source_stat.st_mtime;
+}
+
+/* Writes IMAGE to the container file at PATH. Returns false if the
+   file could not be written. */
+bool save_texture(const mip_pyramid& image, const std::string& path) {
+    const uint64_t alignment = mip_tile_bytes;
+
+    texture_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, texture_file_magic, sizeof(h.magic));
+    h.version = texture_file_version;
+    h.level_count = static_cast<uint32_t>(image.levels.size());
+    h.levels_offset = sizeof(h);
+    h.texels_offset = (h.levels_offset + h.level_count * sizeof(mip_level)
+                       + alignment - 1) & ~(alignment - 1);
+    h.texels_size = image.memory_size();
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+
+    const char zeros[alignment] = {};
+    auto levels_end = h.levels_offset + h.level_count * sizeof(mip_level);
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(image.levels.data(), sizeof(mip_level), h.level_count, f)
+           == h.level_count
+        && fwrite(zeros, 1, h.texels_offset - levels_end, f)
+           == h.texels_offset - levels_end
+        && fwrite(image.texels, 1, h.texels_size, f) == h.texels_size;
+
+    return fclose(f) == 0 && ok;
+}
+
+/* Maps the container file at PATH into FILE and attaches IMAGE to the
+   texels in the mapping, without copying them. Returns false if the
+   file is missing or malformed. */
+bool load_texture(const std::string& path, mapped_file& file,
+                  mip_pyramid& image) {
+    auto fail = [&](const char* reason) {
+        std::cerr << "ERROR: Could not load texture file '" << path << "' ("
+                  << reason << ").\n";
+        file.close();
+        return false;
+    };
+
+    if (!file.open(path))
+        return fail("cannot map file");
+
+    auto header = file.view<texture_file_header>(0, 1);
+    if (header.empty())
+        return fail("truncated header");
+
+    const texture_file_header& h = header[0];
+    if (memcmp(h.magic, texture_file_magic, sizeof(h.magic)) != 0)
+        return fail("bad magic");
+    if (h.version != texture_file_version)
+        return fail("unsupported version");
+
+    auto levels = file.view<mip_level>(h.levels_offset, h.level_count);
+    auto texels = file.view<unsigned char>(h.texels_offset, h.texels_size);
+    if (levels.size() != h.level_count || texels.size() != h.texels_size ||
+        h.level_count == 0)
+        return fail("truncated buffers");
+
+    /* Each level must be tiled as mip_pyramid lays it out, and lie
+       within the texels. Sizes are compared in tiles first, so a
+       crafted header cannot overflow them. */
+    uint64_t tile_count = h.texels_size / mip_tile_bytes;
+    for (const mip_level& l : levels) {
+        uint64_t tiles_x = (uint64_t(l.width) + mip_tile_size - 1)
+                           / mip_tile_size;
+        uint64_t tiles_y = (uint64_t(l.height) + mip_tile_size - 1)
+                           / mip_tile_size;
+        if (l.width == 0 || l.height == 0 || l.width > INT32_MAX ||
+            l.height > INT32_MAX || l.tiles_x != tiles_x ||
+            tiles_y > tile_count / tiles_x || l.offset % mip_tile_bytes != 0)
+            return fail("bad level");
+
+        uint64_t bytes = tiles_x * tiles_y * mip_tile_bytes;
+        if (l.offset > h.texels_size || bytes > h.texels_size - l.offset)
+            return fail("bad level");
+    }
+
+    image.attach(std::vector<mip_level>(levels.begin(), levels.end()),
+                 texels.data());
+    return true;
+}
+
+#endif
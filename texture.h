@@ -1,9 +1,13 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
+#include "aabb.h"
+#include "mapped-file.h"
 #include "perlin.h"
-#include "rtw_stb_image.h"
+#include "texture-cache.h"
 #include "util.h"
 
 /*
@@ -12,6 +16,13 @@
 class texture {
 public:
     virtual color value(double u, double v, const point3& p) const = 0;
+
+    /* Returns the texture averaged over footprint FP around (U, V).
+       Textures that do not filter return their value at (U, V). */
+    virtual color filtered_value(double u, double v, const point3& p,
+                                 const texture_footprint& fp) const {
+        return value(u, v, p);
+    }
 };
 
 /*
@@ -45,13 +56,35 @@ public:
           odd(make_shared<solid_color>(c2)) {}
     
     virtual color value(double u, double v, const point3& p) const override {
-        auto sines = sin(10*p.x()) * sin(10*p.y()) * sin(10*p.z());
-        if (sines < 0)
+        if (is_odd(p))
             return odd->value(u, v, p);
         else
             return even->value(u, v, p);
     }
 
+    virtual color filtered_value(double u, double v, const point3& p,
+                                 const texture_footprint& fp) const override {
+        if (is_odd(p))
+            return odd->filtered_value(u, v, p, fp);
+        else
+            return even->filtered_value(u, v, p, fp);
+    }
+
+    /* Returns true if point P lies in an odd square, i.e. where
+       sin(10x) sin(10y) sin(10z) < 0. Each sine is negative exactly
+       when floor(10x / pi) is odd, so the sign of the product follows
+       from the parities of the three cells without calling sin. */
+    static bool is_odd(const point3& p) {
+        int negatives = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            auto x = 10*p[axis];
+            if (x == 0)
+                return false;
+            negatives += static_cast<long long>(floor(x / pi)) & 1;
+        }
+        return negatives & 1;
+    }
+
 public:
     shared_ptr<texture> odd;   /* Color for the odd squares. */
     shared_ptr<texture> even;  /* Color for the even squares. */
@@ -64,95 +97,183 @@ class noise_texture : public texture {
 public:
     noise_texture() {}
     noise_texture(double sc) : scale(sc) {}
+    noise_texture(const perlin& n, double sc) : noise(n), scale(sc) {}
 
     virtual color value(double u, double v, const point3& p) const override {
-        
-        /* Select between different variations of Perlin noise. */
-        int perlin_type = 2;
-
-        switch(perlin_type) {
-
-            /* Regular Perlin noise. */
-            case 0:
-                return color(1, 1, 1) * 0.5 * (noise.noise(scale * p) + 1.0);
-            
-            /* Perlin noise with turbulence. */
-            case 1:
-                return color(1, 1, 1) * noise.turb(scale * p);
-
-            /* Perlin noise with phase (i.e., marble-like). */
-            case 2:
-                return color(1, 1, 1) * 0.5 
-                    * (sin(scale*p.z() + 10*noise.turb(p)) + 1.0);
-        }
-
-        /* Default: regular Perlin noise. */
-        return color(1, 1, 1) * 0.5 * (noise.noise(scale * p) + 1.0);
+        double gray;
+        intensity(&p, &gray, 1);
+        return color(1, 1, 1) * gray;
     }
 
+    /* Computes the gray level of the texture at the N points P into
+       OUT, evaluating the noise for several points at once. */
+    void intensity(const point3* p, double* out, int n) const;
+
 public:
     perlin noise;  /* Perlin noise. */
     double scale;  /* Scale to adjust noise frequency. */
+
+    /* Select between different variations of Perlin noise. */
+    int perlin_type = 2;
 };
 
+void noise_texture::intensity(const point3* p, double* out, int n) const {
+    switch (perlin_type) {
+
+        /* Perlin noise with turbulence. */
+        case 1:
+
+        /* Regular Perlin noise (also the default). */
+        default: {
+            const int chunk = 64;
+            point3 scaled[chunk];
+            for (int first = 0; first < n; first += chunk) {
+                int count = std::min(chunk, n - first);
+                for (int i = 0; i < count; i++)
+                    scaled[i] = scale * p[first+i];
+                if (perlin_type == 1)
+                    noise.turb(scaled, out + first, count);
+                else {
+                    noise.noise(scaled, out + first, count);
+                    for (int i = first; i < first + count; i++)
+                        out[i] = 0.5 * (out[i] + 1.0);
+                }
+            }
+            return;
+        }
+
+        /* Perlin noise with phase (i.e., marble-like). */
+        case 2:
+            noise.turb(p, out, n);
+            for (int i = 0; i < n; i++)
+                out[i] = 0.5 * (sin(scale*p[i].z() + 10*out[i]) + 1.0);
+            return;
+    }
+}
+
 /*
-   An image texture.
+   A noise texture baked into a grid of gray levels, which lookups
+   interpolate instead of evaluating the noise (see texture-bake.h).
+
+   A surface bake covers the texture coordinates of one object, with
+   sample (I, J) at U = I/(NX-1), V = J/(NY-1), and is interpolated
+   bilinearly at the (U, V) of each hit. A volume bake covers the box
+   BOUNDS with NX x NY x NZ samples at its corners and evenly in
+   between, and is interpolated trilinearly at the hit point. Lookups
+   clamp to the edges of the grid.
 */
-class image_texture : public texture {
+class baked_texture : public texture {
 public:
-    const static int bytes_per_pixel = 3;
+    enum mapping_kind : uint32_t { surface, volume };
 
-    image_texture() : data(nullptr), width(0), height(0),
-                      bytes_per_scanline(0) {}
+    baked_texture() : values(nullptr) {}
 
-    image_texture(const char* filename) {
-        auto components_per_pixel = bytes_per_pixel;
+    baked_texture(const baked_texture&) = delete;
+    baked_texture& operator=(const baked_texture&) = delete;
 
-        data = stbi_load(filename, &width, &height,
-                         &components_per_pixel, components_per_pixel);
+    virtual color value(double u, double v, const point3& p) const override {
+        double gray;
+        if (mapping == surface)
+            gray = bilinear(u * (nx-1), v * (ny-1));
+        else
+            gray = trilinear(grid_coordinate(p, 0), grid_coordinate(p, 1),
+                             grid_coordinate(p, 2));
+        return color(gray, gray, gray);
+    }
 
-        if (!data) {
-            std::cerr << "ERROR: Could not load texture image file '" 
-                      << filename << "'.\n";
-            width = height = 0;
-        }
+    /* Returns the position of P along AXIS in grid samples. */
+    double grid_coordinate(const point3& p, int axis) const {
+        int n = axis == 0 ? nx : axis == 1 ? ny : nz;
+        auto extent = bounds.max()[axis] - bounds.min()[axis];
+        if (extent <= 0)
+            return 0;
+        return (p[axis] - bounds.min()[axis]) / extent * (n-1);
+    }
 
-        bytes_per_scanline = bytes_per_pixel * width;
+    double sample(int i, int j, int k) const {
+        return values[(static_cast<size_t>(k) * ny + j) * nx + i];
     }
 
-    ~image_texture() {
-        delete data;
+    double bilinear(double x, double y, int k = 0) const;
+    double trilinear(double x, double y, double z) const;
+
+    /* Bytes taken by the samples. */
+    size_t memory_size() const {
+        return static_cast<size_t>(nx) * ny * nz * sizeof(float);
     }
 
+public:
+    mapping_kind mapping;
+    int nx, ny, nz;             /* Samples along each axis. */
+    aabb bounds;                /* Box covered by a volume bake. */
+    const float* values;        /* Samples, X fastest, then Y, then Z. */
+    std::vector<float> storage; /* Samples, unless mapped. */
+    mapped_file file;           /* Cached bake the samples are read from. */
+};
+
+/* Interpolates between the samples around grid position (X, Y) in
+   slice K, clamping at the edges of the grid. */
+double baked_texture::bilinear(double x, double y, int k) const {
+    x = clamp(x, 0, nx-1);
+    y = clamp(y, 0, ny-1);
+    int x0 = std::min(static_cast<int>(x), std::max(nx-2, 0));
+    int y0 = std::min(static_cast<int>(y), std::max(ny-2, 0));
+    int x1 = std::min(x0+1, nx-1), y1 = std::min(y0+1, ny-1);
+    auto fx = x - x0, fy = y - y0;
+
+    return (1-fy) * ((1-fx) * sample(x0, y0, k) + fx * sample(x1, y0, k))
+         + fy * ((1-fx) * sample(x0, y1, k) + fx * sample(x1, y1, k));
+}
+
+double baked_texture::trilinear(double x, double y, double z) const {
+    z = clamp(z, 0, nz-1);
+    int z0 = std::min(static_cast<int>(z), std::max(nz-2, 0));
+    int z1 = std::min(z0+1, nz-1);
+    auto fz = z - z0;
+
+    return (1-fz) * bilinear(x, y, z0) + fz * bilinear(x, y, z1);
+}
+
+/*
+   An image texture. The image is shared through the process-wide
+   texture cache and decoded on the first lookup.
+*/
+class image_texture : public texture {
+public:
+    image_texture() {}
+
+    image_texture(const char* filename)
+        : image(texture_cache::global().get(filename)) {}
+
     virtual color value(double u, double v, const point3& p) const override {
+        return filtered_value(u, v, p, texture_footprint());
+    }
+
+    /* Samples the MIP pyramid trilinearly, with the filter width set
+       by the longer side of the footprint FP in texels. */
+    virtual color filtered_value(double u, double v, const point3& p,
+                                 const texture_footprint& fp) const override {
+        const mip_pyramid* pyramid = image ? &image->pyramid() : nullptr;
 
         /* Return cyan if no image data. */
-        if (data == nullptr)
+        if (pyramid == nullptr || pyramid->empty())
             return color(0, 1, 1);
 
         /* Clamp U, V texture coordinates to [0, 1] x [1, 0]. */
         u = clamp(u, 0.0, 1.0);
         v = 1.0 - clamp(v, 0.0, 1.0);
 
-        auto i = static_cast<int>(u * width);
-        auto j = static_cast<int>(v * height);
-
-        /* Clamp integer mapping. */
-        if (i >= width) i = width-1;
-        if (j >= height) j = height-1;
-
-        const auto color_scale = 1.0 / 255.0;
-        auto pixel = data + j*bytes_per_scanline + i*bytes_per_pixel;
+        double width = pyramid->width(), height = pyramid->height();
+        auto width_x = sqrt(fp.dudx*fp.dudx*width*width +
+                            fp.dvdx*fp.dvdx*height*height);
+        auto width_y = sqrt(fp.dudy*fp.dudy*width*width +
+                            fp.dvdy*fp.dvdy*height*height);
 
-        return color(color_scale*pixel[0],
-                     color_scale*pixel[1],
-                     color_scale*pixel[2]);
+        return pyramid->lookup(u, v, fmax(width_x, width_y));
     }
 
-private:
-    unsigned char *data;
-    int width, height;
-    int bytes_per_scanline;
+public:
+    shared_ptr<const image_data> image;  /* Shared, lazily decoded image. */
 };
 
 #endif
@@ -0,0 +1,101 @@
+#ifndef TONE_MAP_H
+#define TONE_MAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include "color.h"
+#include "util.h"
+
+/*
+   Tone mapping from linear radiance to 8-bit display values. It runs
+   when an image is written rather than while it renders, so a saved
+   accumulation buffer can be regraded without rendering again (see
+   tonemap.cc).
+
+   Curves:
+       gamma2   square root, clamped (the renderer's original output)
+       srgb     the sRGB transfer function, clamped
+       filmic   a filmic S-curve (the ACES fit by Narkowicz), then sRGB,
+                which rolls highlights off instead of clipping them
+*/
+
+enum tone_curve { curve_gamma2, curve_srgb, curve_filmic };
+
+struct tone_map {
+    double exposure = 0;             /* In stops; +1 doubles brightness. */
+    tone_curve curve = curve_gamma2;
+
+    /* Converts the sum SUM of SAMPLES samples to 8-bit RGB in RGB.
+       With the defaults, the values are those of color_to_rgb8(). */
+    void apply(const color& sum, uint32_t samples, unsigned char rgb[3]) const;
+
+    /* Returns the sRGB encoded byte for linear value X in [0, 1]. */
+    static unsigned char encode_srgb(double x);
+
+    /* The filmic curve, mapping [0, infinity) onto [0, 1]. */
+    static double filmic(double x) {
+        x = fmax(x, 0.0);
+        return clamp((x * (2.51*x + 0.03)) / (x * (2.43*x + 0.59) + 0.14),
+                     0.0, 1.0);
+    }
+};
+
+/* Parses NAME ("gamma2", "srgb" or "filmic") into CURVE. Returns false
+   if the name is unknown. */
+inline bool parse_tone_curve(const std::string& name, tone_curve& curve) {
+    if (name == "gamma2")
+        curve = curve_gamma2;
+    else if (name == "srgb")
+        curve = curve_srgb;
+    else if (name == "filmic")
+        curve = curve_filmic;
+    else
+        return false;
+    return true;
+}
+
+void tone_map::apply(const color& sum, uint32_t samples,
+                     unsigned char rgb[3]) const {
+    if (samples == 0) {
+        rgb[0] = rgb[1] = rgb[2] = 0;
+        return;
+    }
+
+    auto scale = exp2(exposure) / samples;
+    for (int i = 0; i < 3; i++) {
+        auto x = scale * sum[i];
+        switch (curve) {
+            case curve_gamma2:
+                rgb[i] = static_cast<unsigned char>(
+                    256 * clamp(sqrt(x), 0.0, 0.999));
+                break;
+            case curve_srgb:
+                rgb[i] = encode_srgb(x);
+                break;
+            case curve_filmic:
+                rgb[i] = encode_srgb(filmic(x));
+                break;
+        }
+    }
+}
+
+/* Rounds 255 * linear_to_srgb(X) to the nearest byte by searching the
+   linear values where the byte changes, which avoids calling pow for
+   every pixel. */
+unsigned char tone_map::encode_srgb(double x) {
+    struct table {
+        double thresholds[255];
+        table() {
+            for (int k = 0; k < 255; k++)
+                thresholds[k] = srgb_to_linear((k + 0.5) / 255.0);
+        }
+    };
+    static const table encode;
+
+    auto found = std::upper_bound(encode.thresholds, encode.thresholds + 255, x);
+    return static_cast<unsigned char>(found - encode.thresholds);
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "framebuffer.h"
+#include "image-io.h"
+#include "tone-map.h"
+
+/* Regrades an accumulation buffer saved by the renderer (main
+   image.rtacc) into an image, without rendering again. The output
+   format follows its extension (.ppm, .pfm or .png).
+
+   Usage: tonemap [--exposure stops] [--curve gamma2|srgb|filmic]
+                  input.rtacc output */
+int main(int argc, char** argv) {
+    tone_map tone;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-' && argv[i][1] == '-'; i += 2) {
+        if (strcmp(argv[i], "--exposure") == 0)
+            tone.exposure = atof(argv[i+1]);
+        else if (strcmp(argv[i], "--curve") != 0 ||
+                 !parse_tone_curve(argv[i+1], tone.curve)) {
+            i = argc;
+            break;
+        }
+    }
+
+    if (argc - i != 2) {
+        std::cerr << "Usage: " << argv[0] << " [--exposure stops] "
+                  << "[--curve gamma2|srgb|filmic] input.rtacc output\n";
+        return 1;
+    }
+
+    std::string input = argv[i], output = argv[i+1];
+    framebuffer image;
+    if (!load_accumulation(input, image)) {
+        std::cerr << "ERROR: Could not load accumulation buffer '" << input
+                  << "'.\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!write_image(image, output, tone)) {
+        std::cerr << "ERROR: Could not write image '" << output << "'.\n";
+        return 1;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::cerr << output << ": " << image.width << "x" << image.height
+              << ", tone mapped in " << elapsed.count() << " s\n";
+    return 0;
+}
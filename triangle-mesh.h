@@ -0,0 +1,218 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "flat-bvh.h"
+#include "hittable.h"
+#include "mapped-file.h"
+#include "util.h"
+
+/*
+   Shared vertex, index and BVH buffers for a triangle mesh. Triangle
+   I uses vertices indices[3*I], indices[3*I+1] and indices[3*I+2],
+   and triangles are ordered so that every BVH leaf covers a
+   contiguous range. The buffers are either owned by the mesh or
+   point straight into a memory-mapped mesh file.
+*/
+class mesh_data {
+public:
+    mesh_data() {}
+    mesh_data(const mesh_data&) = delete;
+    mesh_data& operator=(const mesh_data&) = delete;
+
+    size_t vertex_count() const { return positions.size() / 3; }
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    /* Total bytes used by the vertex, index and BVH buffers. */
+    size_t memory_size() const {
+        return positions.size() * sizeof(float)
+             + indices.size() * sizeof(uint32_t)
+             + nodes.size() * sizeof(flat_node);
+    }
+
+    point3 vertex(uint32_t i) const {
+        return point3(positions[3*i], positions[3*i+1], positions[3*i+2]);
+    }
+
+public:
+    array_view<float> positions;   /* XYZ triples, one per vertex. */
+    array_view<uint32_t> indices;  /* Vertex triples, one per triangle. */
+    array_view<flat_node> nodes;   /* BVH nodes, root first. */
+
+    /* Backing storage for meshes built in memory. */
+    std::vector<float> owned_positions;
+    std::vector<uint32_t> owned_indices;
+    std::vector<flat_node> owned_nodes;
+
+    /* Backing storage for meshes loaded from a binary mesh file. */
+    mapped_file file;
+};
+
+/* Builds a mesh from vertex POSITIONS (XYZ triples) and triangle
+   INDICES (vertex triples), constructing the BVH and reordering the
+   triangles to match its leaves. */
+shared_ptr<mesh_data> build_mesh(std::vector<float> positions,
+                                 std::vector<uint32_t> indices);
+
+/*
+   An indexed triangle mesh sharing a single material. Rays are
+   tested against the mesh BVH and a watertight ray/triangle test.
+   Hits record the triangle index and its barycentric coordinates,
+   which become the texture coordinates of the hit.
+*/
+class triangle_mesh : public hittable {
+public:
+    triangle_mesh(shared_ptr<const mesh_data> d, shared_ptr<material> m)
+        : mesh(d), mat_ptr(m) {}
+
+    virtual bool hit(const ray& r, double t_min, double t_max,
+                     hit_record& rec) const override;
+    virtual bool bounding_box(double time0, double time1,
+                              aabb& output_box) const override;
+    virtual void get_surface(const ray& r, hit_record& rec) const override;
+
+public:
+    shared_ptr<const mesh_data> mesh;  /* Shared mesh buffers. */
+    shared_ptr<material> mat_ptr;      /* Reference to mesh material. */
+};
+
+/* Triangles per BVH leaf. */
+const uint32_t mesh_leaf_triangles = 4;
+
+shared_ptr<mesh_data> build_mesh(std::vector<float> positions,
+                                 std::vector<uint32_t> indices) {
+    auto data = make_shared<mesh_data>();
+    size_t tri_count = indices.size() / 3;
+    indices.resize(3 * tri_count);
+
+    std::vector<flat_bounds> tri_bounds(tri_count);
+    for (size_t t = 0; t < tri_count; t++)
+        for (int k = 0; k < 3; k++)
+            tri_bounds[t].grow(&positions[3 * indices[3*t+k]]);
+
+    std::vector<uint32_t> order;
+    data->owned_nodes = build_flat_bvh(tri_bounds, order, mesh_leaf_triangles);
+
+    /* Reorder the index buffer into BVH leaf order. */
+    data->owned_indices.resize(indices.size());
+    for (size_t t = 0; t < tri_count; t++)
+        for (int k = 0; k < 3; k++)
+            data->owned_indices[3*t+k] = indices[3*order[t]+k];
+
+    data->owned_positions.swap(positions);
+    data->positions = array_view<float>(data->owned_positions.data(),
+                                        data->owned_positions.size());
+    data->indices = array_view<uint32_t>(data->owned_indices.data(),
+                                         data->owned_indices.size());
+    data->nodes = array_view<flat_node>(data->owned_nodes.data(),
+                                        data->owned_nodes.size());
+    return data;
+}
+
+/* Traverses the mesh BVH front to back and tests each candidate
+   triangle with the watertight algorithm of Woop et al. (2013),
+   which never lets a ray slip through a shared edge or vertex. */
+bool triangle_mesh::hit(const ray& r, double t_min, double t_max,
+                        hit_record& rec) const {
+    const mesh_data& m = *mesh;
+    if (m.nodes.empty())
+        return false;
+
+    const vec3 org = r.origin();
+    const vec3 dir = r.direction();
+
+    /* Permute axes so that the largest direction component is Z,
+       and shear so that the ray runs along +Z. */
+    int kz = 0;
+    for (int a = 1; a < 3; a++)
+        if (fabs(dir[a]) > fabs(dir[kz]))
+            kz = a;
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+    if (dir[kz] < 0)
+        std::swap(kx, ky);
+
+    const double sx = dir[kx] / dir[kz];
+    const double sy = dir[ky] / dir[kz];
+    const double sz = 1.0 / dir[kz];
+
+    uint32_t hit_tri = 0;
+    double hit_b1 = 0, hit_b2 = 0;
+    auto closest_so_far = t_max;
+
+    auto test_leaf = [&](uint32_t first, uint32_t count, double& t_far) {
+        bool hit_leaf = false;
+        for (uint32_t tri = first; tri < first + count; tri++) {
+            vec3 a = m.vertex(m.indices[3*tri]) - org;
+            vec3 b = m.vertex(m.indices[3*tri+1]) - org;
+            vec3 c = m.vertex(m.indices[3*tri+2]) - org;
+
+            double ax = a[kx] - sx*a[kz], ay = a[ky] - sy*a[kz];
+            double bx = b[kx] - sx*b[kz], by = b[ky] - sy*b[kz];
+            double cx = c[kx] - sx*c[kz], cy = c[ky] - sy*c[kz];
+
+            /* Scaled barycentric coordinates. */
+            double e0 = bx*cy - by*cx;
+            double e1 = cx*ay - cy*ax;
+            double e2 = ax*by - ay*bx;
+
+            if ((e0 < 0 || e1 < 0 || e2 < 0) &&
+                (e0 > 0 || e1 > 0 || e2 > 0))
+                continue;
+
+            double det = e0 + e1 + e2;
+            if (det == 0)
+                continue;
+
+            double t = (e0*sz*a[kz] + e1*sz*b[kz] + e2*sz*c[kz]) / det;
+            if (t < t_min || t > t_far)
+                continue;
+
+            t_far = t;
+            hit_tri = tri;
+            hit_b1 = e1 / det;
+            hit_b2 = e2 / det;
+            hit_leaf = true;
+        }
+        return hit_leaf;
+    };
+
+    if (!traverse_flat_bvh(m.nodes.data(), 0, r, t_min, closest_so_far,
+                           test_leaf))
+        return false;
+
+    rec.set_hit(closest_so_far, this, static_cast<int>(hit_tri));
+    rec.u = hit_b1;
+    rec.v = hit_b2;
+    return true;
+}
+
+/* Store information about the point of intersection of ray R in
+   REC, using the geometric normal of the triangle that was hit. */
+void triangle_mesh::get_surface(const ray& r, hit_record& rec) const {
+    const mesh_data& m = *mesh;
+    point3 v0 = m.vertex(m.indices[3*rec.prim]);
+    point3 v1 = m.vertex(m.indices[3*rec.prim+1]);
+    point3 v2 = m.vertex(m.indices[3*rec.prim+2]);
+
+    rec.p = r.at(rec.t);
+    rec.set_face_normal(r, unit_vector(cross(v1 - v0, v2 - v0)));
+    rec.mat_ptr = mat_ptr.get();
+}
+
+/* Stores the bounding box of the BVH root in OUTPUT_BOX. Returns
+   false for an empty mesh. */
+bool triangle_mesh::bounding_box(double time0, double time1,
+                                 aabb& output_box) const {
+    if (mesh->nodes.empty())
+        return false;
+
+    const flat_node& root = mesh->nodes[0];
+    output_box = aabb(point3(root.bmin[0], root.bmin[1], root.bmin[2]),
+                      point3(root.bmax[0], root.bmax[1], root.bmax[2]));
+    return true;
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define UTIL_H
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
 #include <memory>
@@ -25,9 +26,60 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+/*
+   A PCG32 random number generator (the XSH RR variant of O'Neill's
+   PCG family). Its whole state is one 64-bit word, so a render can
+   reseed it for every sample and reproduce any sample on its own.
+*/
+class random_generator {
+public:
+    random_generator(uint64_t seed = 0x853c49e6748fea9bull) { reseed(seed); }
+
+    void reseed(uint64_t seed) {
+        state = 0;
+        next();
+        state += seed;
+        next();
+    }
+
+    /* Returns 32 random bits. */
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + increment;
+        auto xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+        auto rot = static_cast<uint32_t>(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+private:
+    static const uint64_t increment = 1442695040888963407ull;
+    uint64_t state;
+};
+
+/* Returns the generator behind random_double() for the calling
+   thread. Every thread starts from the same default seed. */
+inline random_generator& thread_random() {
+    thread_local random_generator generator;
+    return generator;
+}
+
+/* Restarts the random sequence of the calling thread from SEED. */
+inline void seed_random(uint64_t seed) {
+    thread_random().reseed(seed);
+}
+
+/* Combines hash H with VALUE into a well-mixed seed (a splitmix64
+   finalizer), e.g. to give every pixel sample its own sequence. */
+inline uint64_t mix_seed(uint64_t h, uint64_t value) {
+    uint64_t z = h ^ (value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
 /* Returns a random real in the range [0, 1). */
 inline double random_double() {
-    return rand() / (RAND_MAX + 1.0);
+    return thread_random().next() * (1.0 / 4294967296.0);
 }
 
 /* Returns a random real in the range [MIN, MAX). */
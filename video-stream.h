@@ -0,0 +1,236 @@
+#ifndef VIDEO_STREAM_H
+#define VIDEO_STREAM_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "framebuffer.h"
+#include "image-io.h"
+#include "tone-map.h"
+#include "util.h"
+
+/*
+   A sequence of frames streamed as uncompressed video to standard
+   output or a file such as a named pipe, for an encoder to consume
+   while the frames render, e.g.
+
+       main --video y4m --frames 48 - | ffmpeg -i - out.mp4
+
+   Formats:
+       y4m   YUV4MPEG2, 4:2:0 (C420jpeg) in BT.601 studio range, which
+             carries its own size and frame rate
+       rgb   raw 8-bit RGB frames with no header (for ffmpeg,
+             -f rawvideo -pix_fmt rgb24 -s WxH -r FPS)
+
+   Tone mapping, color conversion and output run on the stream's own
+   thread, so they overlap rendering of the next frame. At most
+   CAPACITY frames wait to be written; submit() blocks beyond that, so
+   a slow consumer holds back the render instead of filling memory.
+*/
+
+enum video_format { video_y4m, video_rgb };
+
+/* Parses NAME ("y4m" or "rgb") into FORMAT. Returns false if the name
+   is unknown. */
+inline bool parse_video_format(const std::string& name, video_format& format) {
+    if (name == "y4m")
+        format = video_y4m;
+    else if (name == "rgb")
+        format = video_rgb;
+    else
+        return false;
+    return true;
+}
+
+class video_stream {
+public:
+    video_stream() : out(nullptr), format(video_y4m), width(0), height(0),
+                     fps(24), capacity(2), failed(false),
+                     stopping(false) {}
+    ~video_stream() { close(); }
+
+    video_stream(const video_stream&) = delete;
+    video_stream& operator=(const video_stream&) = delete;
+
+    /* Opens PATH ("-" for standard output) for WIDTH x HEIGHT frames in
+       FORMAT at FPS frames per second, keeping at most CAPACITY frames
+       queued. Returns false if it cannot be opened. */
+    bool open(const std::string& path, video_format format, int width,
+              int height, int fps, const tone_map& tone = tone_map(),
+              int capacity = 2);
+
+    /* Queues FRAME to be written after the frames before it, waiting
+       while the queue is full. Returns false once the stream has
+       failed, e.g. because the consumer went away. */
+    bool submit(shared_ptr<const framebuffer> frame);
+
+    /* Writes the queued frames and closes the stream. Returns false if
+       any frame could not be written. */
+    bool close();
+
+private:
+    void run();
+
+    /* Converts IMAGE to the bytes of one frame of the stream in BYTES. */
+    void encode(const framebuffer& image, std::vector<unsigned char>& bytes) const;
+
+    FILE* out;
+    video_format format;
+    int width, height, fps;
+    tone_map tone;
+    size_t capacity;
+
+    std::mutex mutex;
+    std::condition_variable wake;   /* Signals queued frames or stopping. */
+    std::condition_variable space;  /* Signals room in the queue. */
+    std::deque<shared_ptr<const framebuffer>> queue;
+    bool failed;
+    bool stopping;
+    std::thread worker;
+};
+
+bool video_stream::open(const std::string& path, video_format _format,
+                        int _width, int _height, int _fps,
+                        const tone_map& _tone, int _capacity) {
+    close();
+    out = path == "-" ? stdout : fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+
+    /* A consumer that exits should fail the stream, not kill the
+       renderer. */
+    std::signal(SIGPIPE, SIG_IGN);
+
+    format = _format;
+    width = _width;
+    height = _height;
+    fps = _fps;
+    tone = _tone;
+    capacity = std::max(_capacity, 1);
+    failed = stopping = false;
+
+    if (format == video_y4m &&
+        fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                width, height, fps) <= 0)
+        failed = true;
+
+    worker = std::thread([this]() { run(); });
+    return true;
+}
+
+bool video_stream::submit(shared_ptr<const framebuffer> frame) {
+    std::unique_lock<std::mutex> lock(mutex);
+    space.wait(lock, [this]() { return failed || queue.size() < capacity; });
+    if (failed)
+        return false;
+    queue.push_back(std::move(frame));
+    wake.notify_all();
+    return true;
+}
+
+bool video_stream::close() {
+    if (!out)
+        return true;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+
+    bool ok = !failed;
+    if (out == stdout)
+        ok = fflush(out) == 0 && ok;
+    else
+        ok = fclose(out) == 0 && ok;
+    out = nullptr;
+    return ok;
+}
+
+/* Writes queued frames until the stream is closed and the queue is
+   empty, or a write fails. */
+void video_stream::run() {
+    std::vector<unsigned char> bytes;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty() || failed)
+            return;
+
+        auto frame = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        encode(*frame, bytes);
+        frame.reset();
+        bool ok = (format != video_y4m || fputs("FRAME\n", out) >= 0)
+            && fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size()
+            && fflush(out) == 0;
+
+        lock.lock();
+        if (!ok) {
+            failed = true;
+            queue.clear();
+        }
+        space.notify_all();
+    }
+}
+
+void video_stream::encode(const framebuffer& image,
+                          std::vector<unsigned char>& bytes) const {
+    auto rgb = image_rgb8(image, tone);
+    if (format == video_rgb) {
+        bytes.swap(rgb);
+        return;
+    }
+
+    /* BT.601 studio range, in the 8-bit integer form of the standard.
+       Chroma is taken from the mean of each 2x2 block of pixels, which
+       sits at its center as C420jpeg specifies. */
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    size_t luma = static_cast<size_t>(width) * height;
+    size_t chroma = static_cast<size_t>(cw) * ch;
+    bytes.resize(luma + 2 * chroma);
+    unsigned char* y_plane = bytes.data();
+    unsigned char* u_plane = y_plane + luma;
+    unsigned char* v_plane = u_plane + chroma;
+
+    for (size_t k = 0; k < luma; k++) {
+        int r = rgb[3*k], g = rgb[3*k + 1], b = rgb[3*k + 2];
+        y_plane[k] = static_cast<unsigned char>(
+            ((66*r + 129*g + 25*b + 128) >> 8) + 16);
+    }
+
+    for (int cy = 0; cy < ch; cy++) {
+        for (int cx = 0; cx < cw; cx++) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int y = 2*cy; y < std::min(2*cy + 2, height); y++) {
+                for (int x = 2*cx; x < std::min(2*cx + 2, width); x++) {
+                    auto p = &rgb[3 * (static_cast<size_t>(y) * width + x)];
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                    n++;
+                }
+            }
+            r = (r + n/2) / n;
+            g = (g + n/2) / n;
+            b = (b + n/2) / n;
+            size_t k = static_cast<size_t>(cy) * cw + cx;
+            u_plane[k] = static_cast<unsigned char>(
+                ((-38*r - 74*g + 112*b + 128) >> 8) + 128);
+            v_plane[k] = static_cast<unsigned char>(
+                ((112*r - 94*g - 18*b + 128) >> 8) + 128);
+        }
+    }
+}
+
+#endif